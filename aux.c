@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
+#include <unistd.h>
 
 #include "aux.h"
 
@@ -166,3 +167,50 @@ int snprinte(char str[], size_t size, const char *format, ...) {
   return len;
 }
 
+
+mtr_clock_t mtr_clock = { .gettime = clock_gettime, .poll = poll, .usleep = usleep };
+
+time_t unixtime(void) {
+  struct timespec now;
+  return mtr_clock.gettime(CLOCK_REALTIME, &now) ? time(NULL) : now.tv_sec;
+}
+
+lathist_t loop_lat[LAT_MAX];
+const char *lat_name[LAT_MAX] = { "wakeup", "redraw", "netparse", "dnsparse", "slip", "queued" };
+
+void lat_add(int stage, int64_t nsec) {
+  if (!run_opts.stat || (stage < 0) || (stage >= LAT_MAX))
+    return;
+  uint64_t ns = (nsec > 0) ? nsec : 0;
+  lathist_t *lat = &loop_lat[stage];
+  lat->count++;
+  lat->sum += ns;
+  if (ns > lat->max)
+    lat->max = ns;
+  int i = ns ? (63 - __builtin_clzll(ns)) : 0;
+  lat->hist[(i < LAT_BUCKETS) ? i : (LAT_BUCKETS - 1)]++;
+}
+
+inline bool lat_start(struct timespec *ts) { // NONNULL(1)
+  return run_opts.stat && !MONOTIME(ts);
+}
+
+void lat_since(int stage, const struct timespec *ts) { // NONNULL(2)
+  struct timespec now, dt;
+  if (!MONOTIME(&now)) {
+    timespecsub(&now, ts, &dt);
+    lat_add(stage, TS2NSEC(dt));
+  }
+}
+
+uint64_t lat_pct(const lathist_t *lat, int pct) { // NONNULL(1)
+  uint64_t want = (lat->count * pct + 99) / 100, sum = 0;
+  for (int i = 0; i < LAT_BUCKETS; i++) {
+    sum += lat->hist[i];
+    if (sum >= want) {
+      uint64_t upto = (i < (LAT_BUCKETS - 1)) ? (2ULL << i) : lat->max;
+      return (upto < lat->max) ? upto : lat->max;
+    }
+  }
+  return lat->max;
+}
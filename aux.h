@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "common.h"
 
@@ -31,4 +34,30 @@ char* fmt_datetime(time_t at, const char *fmt, size_t size, char buff[size]) NON
 char* datetime_c (time_t at, size_t size, char buff[size]) NONNULL(3);
 char* datetime_FT(time_t at, size_t size, char buff[size]) NONNULL(3);
 
+// time reads and waits of the engine, a simulation replaces them
+typedef struct mtr_clock {
+  int (*gettime)(clockid_t clk, struct timespec *ts);         // clock_gettime()
+  int (*poll)(struct pollfd *fds, nfds_t nfds, int timeout);  // poll()
+  int (*usleep)(useconds_t usec);                             // usleep()
+} mtr_clock_t;
+extern mtr_clock_t mtr_clock;
+#define MONOTIME(ts) mtr_clock.gettime(CLOCK_MONOTONIC, (ts))
+time_t unixtime(void);  // time(NULL) by 'mtr_clock'
+
+// latency histograms of loop stages, collected with -S
+enum { LAT_WAKEUP, LAT_REDRAW, LAT_NETPARSE, LAT_DNSPARSE, LAT_SLIP, LAT_QUEUED, LAT_MAX };
+enum { LAT_BUCKETS = 32 };  // log2 buckets of nanoseconds
+typedef struct lathist {
+  uint64_t count, sum, max;      // in nanoseconds
+  uint32_t hist[LAT_BUCKETS];    // [i]: less than 2^(i+1) nsec, the last one takes the rest
+} lathist_t;
+extern lathist_t loop_lat[LAT_MAX];
+extern const char *lat_name[LAT_MAX];
+void lat_add(int stage, int64_t nsec);
+bool lat_start(struct timespec *ts) NONNULL(1);               // false if it's not collected
+void lat_since(int stage, const struct timespec *ts) NONNULL(2);
+uint64_t lat_pct(const lathist_t *lat, int pct) NONNULL(1);    // upper bound of percentile
+#define LAT_TIMED(stage, call) { struct timespec _t0; bool _on = lat_start(&_t0); \
+  call; if (_on) lat_since((stage), &_t0); }
+
 #endif
@@ -0,0 +1,131 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// Benchmark of incremental ipinfo parser over captured responses fed in segments
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iistream.h"
+
+typedef struct {
+  const char *name;
+  int type;
+  const char *data;
+} sample_t;
+
+static const sample_t samples[] = {
+  { "http-ipapi", IIS_HTTP,
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Mon, 19 Oct 2026 06:53:47 GMT\r\n"
+    "Content-Type: text/plain; charset=utf-8\r\n"
+    "Content-Length: 162\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "X-Ttl: 60\r\n"
+    "X-Rl: 44\r\n"
+    "\r\n"
+    "success,United States,US,VA,Virginia,Ashburn,20149,39.03,-77.5,America/New_York,"
+    "Google LLC,Google Public DNS,AS15169 Google LLC,8.8.8.8,,,,,,,,,,,,,,,,,,,,,,,,,,\n" },
+  { "whois-ris", IIS_WHOIS,
+    "% This is RIPE NCC's Routing Information Service\n"
+    "% whois gateway to collected BGP Routing Tables, version 2.0\n"
+    "% IPv4 or IPv6 address to origin prefix match\n"
+    "%\n"
+    "% For more information visit http://www.ripe.net/ris/riswhois.html\n"
+    "\n"
+    "route:        8.8.8.0/24\n"
+    "origin:       AS15169\n"
+    "descr:        GOOGLE, US\n"
+    "lastupd-frst: 2024-05-14 04:23Z  195.66.224.175@rrc01\n"
+    "lastupd-last: 2026-10-18 12:06Z  80.77.16.114@rrc00\n"
+    "seen-at:      rrc00,rrc01,rrc03,rrc04,rrc05,rrc06,rrc07,rrc10,rrc11,rrc12,rrc13\n"
+    "num-rispeers: 312\n"
+    "source:       RISWHOIS\n"
+    "\n" },
+  { "whois-bulk", IIS_LINES,
+    "Bulk mode; whois.cymru.com [2026-10-19 06:55:10 +0000]\n"
+    "15169   | 8.8.8.8          | 8.8.8.0/24          | US | arin     | 2023-12-28 | GOOGLE, US\n"
+    "13335   | 1.1.1.1          | 1.1.1.0/24          | AU | apnic    | 2011-08-11 | CLOUDFLARENET, US\n"
+    "3356    | 4.69.184.193     | 4.0.0.0/9           | US | arin     | 1992-12-01 | LEVEL3, US\n"
+    "1299    | 62.115.14.116    | 62.115.0.0/16       | EU | ripencc  | 2000-08-23 | TWELVE99 Arelion, fka Telia Carrier, SE\n"
+    "NA      | 10.0.0.1         | NA                  |    | other    |            | NA\n" },
+};
+
+static const size_t segments[] = { 0 /*whole*/, 1460, 64, 1 };
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// feed one response in segments, return number of done records
+static int feed_sample(iistream_t *st, const sample_t *sample, size_t len, size_t seg) {
+  int done = 0;
+  iis_init(st, sample->type);
+  for (size_t off = 0; off < len;) {
+    size_t room = 0;
+    char *data = iis_room(st, &room);
+    size_t n = len - off;
+    if (seg && (n > seg))
+      n = seg;
+    if (n > room)
+      return -1;
+    memcpy(data, sample->data + off, n);
+    off += n;
+    int rc = iis_feed(st, n);
+    while (rc == IIS_DONE) {
+      done++;
+      iis_next(st);
+      rc = iis_feed(st, 0);
+    }
+    if (rc == IIS_FAIL)
+      return -1;
+  }
+  if (iis_fin(st) == IIS_DONE)
+    done++;
+  return done;
+}
+
+int main(int argc, char **argv) {
+  long iters = (argc > 1) ? atol(argv[1]) : 100000;
+  if (iters <= 0)
+    iters = 100000;
+  static iistream_t st;
+  printf("%-12s %8s %10s %8s %10s %10s\n", "sample", "segment", "iters", "records", "ns/resp", "MB/s");
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+    size_t len = strlen(samples[i].data);
+    for (size_t j = 0; j < sizeof(segments) / sizeof(segments[0]); j++) {
+      long n = segments[j] == 1 ? iters / 10 : iters; // byte by byte is slow
+      int records = 0;
+      double start = now_sec();
+      for (long k = 0; k < n; k++)
+        records = feed_sample(&st, &samples[i], len, segments[j]);
+      double spent = now_sec() - start;
+      if (records <= 0) {
+        fprintf(stderr, "%s: failed to parse\n", samples[i].name);
+        return EXIT_FAILURE;
+      }
+      printf("%-12s %8zu %10ld %8d %10.1f %10.1f\n", samples[i].name, segments[j] ? segments[j] : len,
+        n, records, spent * 1e9 / n, (len * n) / spent / 1e6);
+    }
+  }
+  return EXIT_SUCCESS;
+}
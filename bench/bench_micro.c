@@ -0,0 +1,276 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// Microbenchmarks of hot helpers: statistics and their formatting, mpls decoding,
+// checksums, arpa names, ipinfo parsing, chart glyphs and report renderers,
+// over a synthetic 30-hop path. Results are printed out as JSON.
+//   bench_micro [ITERATIONS]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <locale.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "net.h"
+#include "aux.h"
+#include "report.h"
+#include "micro.h"
+
+#ifdef ENABLE_DNS
+#include "dns.h"
+#endif
+
+#ifdef TUIMODE
+#include "tui/chart.h"
+#endif
+
+enum { ROUNDS = 200, SILENT_AT = 12, RESULTS_MAX = 64 };
+
+// globals of mtr.c that report.c and chart.c refer to
+char srchost[NAMELEN] = "bench";
+const char *dsthost = "10.0.29.1";
+char mtr_args[128] = "-r";
+#if defined(OUTPUT_FORMAT_JSON) || defined(OUTPUT_FORMAT_TOON)
+const char* mtr_optv[32] = {"-r"};
+uint mtr_optc = 1;
+#endif
+#ifdef TUIMODE
+int tuilook = OLDLOOK;
+#endif
+#ifdef WITH_UNICODE
+bool utf_compat;
+#endif
+
+volatile uintptr_t bm_sink;
+
+typedef struct {
+  const char *name;
+  long iters;
+  double ns;
+} result_t;
+
+static result_t results[RESULTS_MAX];
+static int nresult;
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bm_run(const char *name, long iters, void (*fn)(long iters)) {
+  if (iters < 1)
+    iters = 1;
+  double start = now_sec();
+  fn(iters);
+  double spent = now_sec() - start;
+  if (nresult < RESULTS_MAX)
+    results[nresult++] = (result_t){ .name = name, .iters = iters, .ns = spent * 1e9 / iters };
+}
+
+static void hop_addr(t_ipaddr *addr, int at, int ndx) {
+  memset(addr, 0, sizeof(*addr));
+  uint8_t *a = (uint8_t *)addr;
+  a[0] = 10; a[2] = at; a[3] = 1 + ndx;  // 10.0.HOP.1+NDX
+}
+
+// hops answer with rtt growing along the path, every 7th one is two-way ecmp
+static bool make_path(void) {
+  if (!net_replay_start(AF_INET))
+    return false;
+  t_ipaddr addr;
+  hop_addr(&addr, BM_HOPS - 1, 0);
+  net_replay_target(&addr);
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int at = 0; at < BM_HOPS; at++) {
+      struct timespec sent = { .tv_sec = 1 + r, .tv_nsec = at * 1000 };
+      if (net_replay_sent(at, &sent) < 0)
+        return false;
+      if (at == SILENT_AT)
+        continue;
+      int ndx = ((at % 7) == 3) ? (r & 1) : 0;
+      hop_addr(&addr, at, ndx);
+      int usec = (at + 1) * 1000 + ((r * 7919 + at * 104729) % 500);
+      struct timespec rtt = { .tv_nsec = usec * 1000L }, recv;
+      timespecadd(&sent, &rtt, &recv);
+      net_replay_reply(at, &addr, usec, &recv);
+    }
+  }
+#ifdef ENABLE_DNS
+  for (int at = 0; at < BM_HOPS; at++)
+    for (int ndx = 0; ndx < 2; ndx++) {
+      char name[64];
+      snprintf(name, sizeof(name), "hop%d-%d.core.example.net", at + 1, ndx);
+      hop_addr(&addr, at, ndx);
+      net_replay_name(at, &addr, name);
+    }
+#endif
+  return true;
+}
+
+#ifdef ENABLE_DNS
+static void run_ip2arpa4(long iters) {
+  t_ipaddr addr;
+  char buff[NAMELEN];
+  for (long i = 0; i < iters; i++) {
+    hop_addr(&addr, i % BM_HOPS, 0);
+    ip2arpa(sizeof(buff), buff, &addr, "in-addr.arpa", "ip6.arpa");
+    bm_sink += buff[0];
+  }
+}
+
+#ifdef ENABLE_IPV6
+static void run_ip2arpa6(long iters) {
+  t_ipaddr addr;
+  inet_pton(AF_INET6, "2001:db8:85a3::8a2e:370:7334", &addr);
+  char buff[NAMELEN];
+  for (long i = 0; i < iters; i++) {
+    ((uint8_t *)&addr)[15] = i;
+    ip2arpa(sizeof(buff), buff, &addr, "in-addr.arpa", "ip6.arpa");
+    bm_sink += buff[0];
+  }
+}
+#endif
+#endif
+
+#ifdef TUIMODE
+static WINDOW *chart_pad;
+
+static void run_chart_area(long iters) {
+  for (long i = 0; i < iters; i++) {
+    wmove(chart_pad, 0, 0);
+    chart_area(chart_pad, SAVED_PINGS, host[i % BM_HOPS].saved);
+  }
+}
+
+static void bench_charts(long iters) {
+  FILE *out = fopen("/dev/null", "w");
+  SCREEN *screen = out ? newterm("xterm", out, stdin) : NULL;
+  if (!screen) {
+    if (out) fclose(out);
+    return;
+  }
+  chart_pad = newpad(1, SAVED_PINGS + 1);
+  if (chart_pad) {
+    prepare_charts();
+    chart_scale(0);
+    static const char *names[] = {NULL, "chart_area_mode1", "chart_area_mode2", "chart_area_mode3"};
+    uint modes =
+#ifdef WITH_UNICODE
+      3;
+#else
+      2;
+#endif
+    for (uint mode = 1; mode <= modes; mode++) {
+      chart_mode = mode;
+      bm_run(names[mode], iters, run_chart_area);
+    }
+    delwin(chart_pad);
+  }
+  endwin();
+  delscreen(screen);
+  fclose(out);
+}
+#endif
+
+static void run_report_close(long iters) { for (long i = 0; i < iters; i++) report_close(false, true); }
+#ifdef OUTPUT_FORMAT_CSV
+static void run_csv_close(long iters) { for (long i = 0; i < iters; i++) csv_close(false); }
+#endif
+#ifdef OUTPUT_FORMAT_JSON
+static void run_json_close(long iters) { for (long i = 0; i < iters; i++) json_close(false); }
+#endif
+#ifdef OUTPUT_FORMAT_TOON
+static void run_toon_close(long iters) { for (long i = 0; i < iters; i++) toon_close(); }
+#endif
+#ifdef OUTPUT_FORMAT_XML
+static void run_xml_close(long iters) { for (long i = 0; i < iters; i++) xml_close(); }
+#endif
+
+// whole reports into /dev/null, one report per iteration
+static void bench_renderers(long iters) {
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+  if ((saved < 0) || (null < 0) || (dup2(null, STDOUT_FILENO) < 0)) {
+    perror("/dev/null");
+    exit(EXIT_FAILURE);
+  }
+  close(null);
+  bm_run("report_close", iters, run_report_close);
+#ifdef OUTPUT_FORMAT_CSV
+  bm_run("csv_close", iters, run_csv_close);
+#endif
+#ifdef OUTPUT_FORMAT_JSON
+  bm_run("json_close", iters, run_json_close);
+#endif
+#ifdef OUTPUT_FORMAT_TOON
+  bm_run("toon_close", iters, run_toon_close);
+#endif
+#ifdef OUTPUT_FORMAT_XML
+  bm_run("xml_close", iters, run_xml_close);
+#endif
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+}
+
+int main(int argc, char **argv) {
+  long iters = (argc > 1) ? atol(argv[1]) : 1000000;
+  if (iters <= 0)
+    iters = 1000000;
+  setlocale(LC_ALL, "");
+  run_opts = ini_opts;
+  run_opts.interactive = false;
+#ifdef ENABLE_DNS
+  run_opts.dns = true;
+#endif
+  for (int i = 0; i < stat_max; i++)
+    fld_index[(uint8_t)stats[i].key] = i;
+  set_fld_active(NULL);
+  if (!make_path()) {
+    fprintf(stderr, "failed to set up %d-hop path\n", BM_HOPS);
+    return EXIT_FAILURE;
+  }
+  // cheap helpers get all iterations, heavier ones a fraction
+  bm_net(iters);
+#ifdef ENABLE_DNS
+  bm_run("ip2arpa4", iters, run_ip2arpa4);
+#ifdef ENABLE_IPV6
+  bm_run("ip2arpa6", iters, run_ip2arpa6);
+#endif
+#endif
+#ifdef WITH_IPINFO
+  bm_ipinfo(iters / 10);
+#endif
+#ifdef TUIMODE
+  bench_charts(iters / 10);
+#endif
+  bench_renderers(iters / 1000);
+  //
+  printf("{\"bench\":\"micro\",\"hops\":%d,\"results\":[", BM_HOPS);
+  for (int i = 0; i < nresult; i++)
+    printf("%s\n  {\"name\":\"%s\",\"iters\":%ld,\"ns_per_op\":%.1f}", i ? "," : "",
+      results[i].name, results[i].iters, results[i].ns);
+  printf("\n]}\n");
+  return EXIT_SUCCESS;
+}
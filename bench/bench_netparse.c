@@ -0,0 +1,458 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// Benchmark of reply parsing and statistics: built-in ICMP/ICMPv6 replies, or ones
+// of a pcap file, go through the parser and net_stat() as received packets.
+// Every packet is preceded by a probe, and carries id and sequence of it. Replies go
+// as raw socket gives them, then as frames of AF_PACKET ring blocks ("/ring" rows).
+//   bench_netparse [ITERATIONS [FILE.pcap]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>  // constants of pcap packets even without ENABLE_IPV6
+
+#include "common.h"
+#include "net.h"
+
+#ifdef WITH_RING
+#include <linux/if_packet.h>
+#endif
+
+enum { LO_UDPPORT = 33433 };  // as net.c sends udp probes
+enum { HOPS = 10, PKTMAX = 512, PROBE_SIZE = 64 };
+
+typedef struct {
+  uint8_t data[PKTMAX];  // as raw socket gives it: ipv4 header, no ipv6 one
+  size_t len, off;       // length, and offset of probe's header to fill in
+  int at;
+  t_ipaddr from;
+} pkt_t;
+
+typedef struct {
+  char name[24];
+  int family, proto;
+  pkt_t *pkts;
+  size_t n;
+} sample_t;
+
+static sample_t samples[32];
+static size_t nsample;
+static uint16_t myid, myport;
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static sample_t *sample_get(const char *name, int family, int proto) {
+  for (size_t i = 0; i < nsample; i++)
+    if (!strcmp(samples[i].name, name))
+      return &samples[i];
+  if (nsample >= ARRAY_LEN(samples))
+    return NULL;
+  sample_t *s = &samples[nsample++];
+  snprintf(s->name, sizeof(s->name), "%s", name);
+  s->family = family;
+  s->proto = proto;
+  return s;
+}
+
+static pkt_t *pkt_add(sample_t *s) {
+  if (!s)
+    return NULL;
+  pkt_t *p = realloc(s->pkts, (s->n + 1) * sizeof(pkt_t));
+  if (!p) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  s->pkts = p;
+  p += s->n++;
+  memset(p, 0, sizeof(*p));
+  return p;
+}
+
+static uint16_t csum(const uint8_t *data, size_t len) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i + 1 < len; i += 2)
+    sum += (data[i] << 8) | data[i + 1];
+  if (len % 2)
+    sum += data[len - 1] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return htons(~sum);
+}
+
+static void hop_addr(int family, int at, t_ipaddr *addr) {
+  memset(addr, 0, sizeof(*addr));
+  uint8_t *a = (uint8_t *)addr;
+  if (family == AF_INET) {
+    a[0] = 10; a[2] = at; a[3] = 1;         // 10.0.AT.1
+  }
+#ifdef ENABLE_IPV6
+  else {
+    a[0] = 0xfd; a[13] = at; a[15] = 1;     // fd00::AT:1
+  }
+#endif
+}
+
+static size_t put_ip(uint8_t *buf, int family, int proto, int len, int at, int ttl) {
+  t_ipaddr src, dst;
+  hop_addr(family, at, &src);
+  hop_addr(family, HOPS - 1, &dst);
+  if (family == AF_INET) {
+    buf[0] = 0x45;
+    uint16_t tot = htons(len);
+    memcpy(buf + 2, &tot, 2);
+    buf[8] = ttl;
+    buf[9] = proto;
+    memcpy(buf + 12, &src, 4);
+    memcpy(buf + 16, &dst, 4);
+    return 20;
+  }
+#ifdef ENABLE_IPV6
+  buf[0] = 0x60;
+  uint16_t plen = htons(len - 40);
+  memcpy(buf + 4, &plen, 2);
+  buf[6] = proto;
+  buf[7] = ttl;
+  memcpy(buf + 8, &src, 16);
+  memcpy(buf + 24, &dst, 16);
+  return 40;
+#else
+  return 0;
+#endif
+}
+
+// reply from hop 'at': echo reply if 'type' is echo one, otherwise icmp error
+// with quoted probe of 'proto', and RFC4950 labels if 'labels' is not zero
+static void make_reply(sample_t *s, int at, uint8_t type, uint8_t code, int labels) {
+  pkt_t *p = pkt_add(s);
+  if (!p)
+    return;
+  p->at = at;
+  hop_addr(s->family, at, &p->from);
+  bool v4 = (s->family == AF_INET);
+  uint8_t *icmp = p->data + (v4 ? 20 : 0);
+  bool echo = (type == (v4 ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY));
+  size_t len = 8;
+  icmp[0] = type;
+  icmp[1] = code;
+  if (echo)
+    len += PROBE_SIZE - 28;
+  else {
+    uint8_t *orig = icmp + 8;
+    int iproto = (s->proto != IPPROTO_ICMP) ? s->proto : (v4 ? IPPROTO_ICMP : IPPROTO_ICMPV6);
+    size_t ohdr = put_ip(orig, s->family, iproto, PROBE_SIZE, HOPS - 1, 1);
+    uint8_t *th = orig + ohdr;
+    p->off = th - p->data;
+    if (s->proto == IPPROTO_ICMP)
+      th[0] = v4 ? ICMP_ECHO : ICMP6_ECHO_REQUEST;
+    else if (s->proto == IPPROTO_TCP) {
+      th[12] = 5 << 4;  // data offset
+      th[13] = 0x02;    // syn
+    }
+    size_t olen = ohdr + PROBE_SIZE - 20;
+    if (labels) {  // RFC4884: original datagram padded to 128 bytes, then extension
+      icmp[5] = 128 / 4;
+      uint8_t *ext = orig + 128, *obj = ext + 4;
+      ext[0] = 2 << 4;  // version
+      uint16_t objlen = htons(4 + 4 * labels);
+      memcpy(obj, &objlen, 2);
+      obj[2] = obj[3] = 1;  // mpls class and type
+      for (int i = 0; i < labels; i++) {
+        uint32_t lab = htonl(((16000 + at * 16 + i) << 12) | ((i == labels - 1) << 8) | (255 - at));
+        memcpy(obj + 4 + 4 * i, &lab, 4);
+      }
+      size_t elen = 4 + 4 + 4 * labels;
+      uint16_t sum = csum(ext, elen);
+      memcpy(ext + 2, &sum, 2);
+      len += 128 + elen;
+    } else
+      len += olen;
+  }
+  if (echo)
+    p->off = icmp - p->data;
+  if (v4)
+    put_ip(p->data, AF_INET, IPPROTO_ICMP, 20 + len, at, 64);
+  p->len = (icmp - p->data) + len;
+}
+
+static void make_samples(int family) {
+  bool v4 = (family == AF_INET);
+  const char *sfx = v4 ? "4" : "6";
+  uint8_t te = v4 ? ICMP_TIME_EXCEEDED : ICMP6_TIME_EXCEEDED, un = v4 ? ICMP_UNREACH : ICMP6_DST_UNREACH;
+  uint8_t pu = v4 ? ICMP_UNREACH_PORT : ICMP6_DST_UNREACH_NOPORT;
+  char name[24];
+  snprintf(name, sizeof(name), "icmp%s-pong", sfx);
+  make_reply(sample_get(name, family, IPPROTO_ICMP), HOPS - 1, v4 ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY, 0, 0);
+  snprintf(name, sizeof(name), "icmp%s-exceed", sfx);
+  sample_t *s = sample_get(name, family, IPPROTO_ICMP);
+  for (int at = 0; at < HOPS - 1; at++)
+    make_reply(s, at, te, 0, 0);
+#ifdef WITH_MPLS
+  snprintf(name, sizeof(name), "icmp%s-mpls", sfx);
+  s = sample_get(name, family, IPPROTO_ICMP);
+  for (int at = 0; at < HOPS - 1; at++)
+    make_reply(s, at, te, 0, 1 + at % 3);
+#endif
+  snprintf(name, sizeof(name), "udp%s-exceed", sfx);
+  s = sample_get(name, family, IPPROTO_UDP);
+  for (int at = 0; at < HOPS - 1; at++)
+    make_reply(s, at, te, 0, 0);
+  snprintf(name, sizeof(name), "udp%s-unreach", sfx);
+  make_reply(sample_get(name, family, IPPROTO_UDP), HOPS - 1, un, pu, 0);
+  snprintf(name, sizeof(name), "tcp%s-exceed", sfx);
+  s = sample_get(name, family, IPPROTO_TCP);
+  for (int at = 0; at < HOPS - 1; at++)
+    make_reply(s, at, te, 0, 0);
+#ifdef WITH_MPLS
+  snprintf(name, sizeof(name), "tcp%s-mpls", sfx);
+  s = sample_get(name, family, IPPROTO_TCP);
+  for (int at = 0; at < HOPS - 1; at++)
+    make_reply(s, at, te, 0, 2);
+#endif
+}
+
+// captured ICMP/ICMPv6 reply starting with IP header
+static void load_packet(const uint8_t *ip, size_t len, size_t *count) {
+  if (len < 1)
+    return;
+  int family = ((ip[0] >> 4) == 4) ? AF_INET : (((ip[0] >> 4) == 6) ? AF_INET6 : 0);
+  bool v4 = (family == AF_INET);
+#ifndef ENABLE_IPV6
+  if (!v4) // addresses are of ipv4 size
+    return;
+#endif
+  size_t iphl = v4 ? 20 : 40;
+  if (!family || (len < iphl + 8) || (v4 && ((ip[0] & 0xf) != 5)) || (ip[v4 ? 9 : 6] != (v4 ? IPPROTO_ICMP : IPPROTO_ICMPV6)))
+    return;
+  const uint8_t *icmp = ip + iphl, *th = icmp;
+  int proto = IPPROTO_ICMP;
+  if (icmp[0] != (v4 ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY)) {
+    if ((icmp[0] != (v4 ? ICMP_TIME_EXCEEDED : ICMP6_TIME_EXCEEDED)) && (icmp[0] != (v4 ? ICMP_UNREACH : ICMP6_DST_UNREACH)))
+      return;
+    const uint8_t *orig = icmp + 8;
+    if ((orig + iphl + 8) > (ip + len))
+      return;
+    proto = orig[v4 ? 9 : 6];
+    if (proto == IPPROTO_ICMPV6)
+      proto = IPPROTO_ICMP;
+    if ((proto != IPPROTO_ICMP) && (proto != IPPROTO_UDP) && (proto != IPPROTO_TCP))
+      return;
+    th = orig + (v4 ? (orig[0] & 0xf) * 4 : 40);
+    if ((th + 8) > (ip + len))
+      return;
+  }
+  char name[24];
+  snprintf(name, sizeof(name), "pcap-%s%s", (proto == IPPROTO_ICMP) ? "icmp" : ((proto == IPPROTO_UDP) ? "udp" : "tcp"), v4 ? "4" : "6");
+  sample_t *s = sample_get(name, family, proto);
+  size_t skip = v4 ? 0 : 40;  // raw ipv6 sockets give packets without ip header
+  if (!s || ((len - skip) > PKTMAX))
+    return;
+  pkt_t *p = pkt_add(s);
+  memcpy(p->data, ip + skip, len - skip);
+  p->len = len - skip;
+  p->off = th - ip - skip;
+  p->at = s->n % HOPS;
+  memcpy(&p->from, ip + (v4 ? 12 : 8), v4 ? 4 : 16);
+  (*count)++;
+}
+
+// classic pcap with ethernet, linux cooked or raw ip frames
+static bool load_pcap(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint32_t gh[6];
+  bool ok = (fread(gh, sizeof(gh), 1, f) == 1);
+  bool swap = ok && ((gh[0] == 0xd4c3b2a1) || (gh[0] == 0x4d3cb2a1));
+  if (ok && !swap && (gh[0] != 0xa1b2c3d4) && (gh[0] != 0xa1b23c4d))
+    ok = false;
+#define U32(v) (swap ? __builtin_bswap32(v) : (v))
+  uint32_t link = ok ? U32(gh[5]) : 0;
+  size_t l2 = (link == 1) ? 14 : ((link == 113) ? 16 : 0);
+  if (ok && (link != 1) && (link != 113) && (link != 101) && (link != 228) && (link != 229)) {
+    fprintf(stderr, "%s: unsupported link type %u\n", path, link);
+    ok = false;
+  }
+  size_t count = 0;
+  static uint8_t frame[65536];
+  uint32_t rh[4];
+  while (ok && (fread(rh, sizeof(rh), 1, f) == 1)) {
+    uint32_t caplen = U32(rh[2]);
+    if ((caplen > sizeof(frame)) || (fread(frame, caplen, 1, f) != 1))
+      break;
+    size_t off = l2;
+    if ((link == 1) && (caplen >= 18) && (frame[12] == 0x81) && (frame[13] == 0x00))
+      off += 4;  // vlan tag
+    if (caplen > off)
+      load_packet(frame + off, caplen - off, &count);
+  }
+#undef U32
+  fclose(f);
+  if (ok)
+    printf("%s: %zu replies\n", path, count);
+  return ok && count;
+}
+
+static void fill_probe(uint8_t *pkt, const sample_t *s, size_t off, int seq) {
+  uint8_t *h = pkt + off;
+  switch (s->proto) {
+    case IPPROTO_ICMP: {  // in host byte order as net.c sends them
+      uint16_t v[2] = { myid, seq };
+      memcpy(h + 4, v, sizeof(v));
+    } break;
+    case IPPROTO_UDP: {
+      uint16_t v[2] = { htons(myport), htons(LO_UDPPORT + seq) };
+      memcpy(h, v, sizeof(v));
+    } break;
+    case IPPROTO_TCP: {
+      uint16_t v = htons(seq);
+      memcpy(h, &v, sizeof(v));
+    } break;
+    default: break;
+  }
+}
+
+static int received(void) {
+  int sum = 0;
+  for (int at = 0; at < MAXHOST; at++)
+    sum += atoi(net_elem(at, 'R'));
+  return sum;
+}
+
+#ifdef WITH_RING
+enum { RING_FRAMES = 32 };  // frames per block, the same order as a poll gets
+enum { FRAME_NET = TPACKET_ALIGN(sizeof(struct tpacket3_hdr) + sizeof(struct sockaddr_ll)) };
+enum { BLOCK_HDR = TPACKET_ALIGN(sizeof(struct tpacket_block_desc)) };
+static uint8_t block[BLOCK_HDR + RING_FRAMES * TPACKET_ALIGN(FRAME_NET + 40 + PKTMAX)] __attribute__((aligned(16)));
+static size_t block_fill = BLOCK_HDR;
+static uint nframe;
+
+// frame as ring has it: cooked one starting with IP header, ipv6 one included
+static void frame_add(const uint8_t *pkt, const pkt_t *p, int family UNUSED) {
+  struct tpacket3_hdr *fh = (struct tpacket3_hdr *)(block + block_fill);
+  memset(fh, 0, FRAME_NET);
+  fh->tp_mac = fh->tp_net = FRAME_NET;
+  uint8_t *ip = block + block_fill + FRAME_NET;
+  size_t hl = 0;
+#ifdef ENABLE_IPV6
+  if (family == AF_INET6) {
+    memset(ip, 0, 40);
+    hl = put_ip(ip, AF_INET6, IPPROTO_ICMPV6, 40 + p->len, 0, 64);
+    memcpy(ip + 8, &p->from, 16);
+  }
+#endif
+  memcpy(ip + hl, pkt, p->len);
+  fh->tp_snaplen = fh->tp_len = hl + p->len;
+  fh->tp_next_offset = TPACKET_ALIGN(FRAME_NET + fh->tp_snaplen);
+  block_fill += fh->tp_next_offset;
+  nframe++;
+}
+
+// retire block to parser as kernel does it
+static void block_flush(const struct timespec *polled_at) {
+  struct tpacket_block_desc *bd = (struct tpacket_block_desc *)block;
+  memset(bd, 0, sizeof(*bd));
+  bd->version = TPACKET_V3;
+  bd->hdr.bh1.block_status = TP_STATUS_USER;
+  bd->hdr.bh1.num_pkts = nframe;
+  bd->hdr.bh1.offset_to_first_pkt = BLOCK_HDR;
+  bd->hdr.bh1.blk_len = block_fill;
+  if (!net_replay_block(block, polled_at) || (bd->hdr.bh1.block_status != TP_STATUS_KERNEL)) {
+    fprintf(stderr, "ring block is not given back\n");
+    exit(EXIT_FAILURE);
+  }
+  block_fill = BLOCK_HDR;
+  nframe = 0;
+}
+#define RUNS 2  // raw socket and ring
+#else
+#define RUNS 1
+#endif
+
+// replies of sample with 'iters' probes, return spent seconds
+static double replay(const sample_t *s, long iters, bool ring UNUSED) {
+  t_ipaddr target;
+  hop_addr(s->family, HOPS - 1, &target);
+  net_replay_target(&target);
+  net_set_type(s->proto);
+  net_replay_ids(&myid, &myport);
+  struct timespec clk = { .tv_sec = 1 };
+  uint8_t pkt[PKTMAX];
+  double start = now_sec();
+  for (long k = 0; k < iters; k++) {
+    const pkt_t *p = &s->pkts[k % s->n];
+    int seq = net_replay_sent(p->at, &clk);
+    memcpy(pkt, p->data, p->len);  // parser changes it in place
+    fill_probe(pkt, s, p->off, seq);
+    clk.tv_nsec += 1000000 + (k % 997) * 1000;  // 1-2ms rtt
+    if (clk.tv_nsec >= 1000000000) {
+      clk.tv_sec++;
+      clk.tv_nsec -= 1000000000;
+    }
+#ifdef WITH_RING
+    if (ring) {
+      frame_add(pkt, p, s->family);
+      if ((nframe == RING_FRAMES) || (k == iters - 1))
+        block_flush(&clk);
+      continue;
+    }
+#endif
+    net_replay_packet(pkt, p->len, &p->from, &clk);
+  }
+  return now_sec() - start;
+}
+
+int main(int argc, char **argv) {
+  long iters = (argc > 1) ? atol(argv[1]) : 1000000;
+  if (iters <= 0)
+    iters = 1000000;
+  run_opts = ini_opts;
+  run_opts.mpls = true;
+  if (argc > 2) {
+    if (!load_pcap(argv[2]))
+      return EXIT_FAILURE;
+  } else {
+    make_samples(AF_INET);
+#ifdef ENABLE_IPV6
+    make_samples(AF_INET6);
+#endif
+  }
+  printf("%-19s %5s %10s %8s %10s %12s\n", "sample", "pkts", "iters", "recv%", "ns/pkt", "pkts/s");
+  for (size_t i = 0; i < nsample; i++) {
+    sample_t *s = &samples[i];
+    for (int ring = 0; ring < RUNS; ring++) {
+      if (!s->n || !net_replay_start(s->family))
+        break;
+      double spent = replay(s, iters, ring);
+      printf("%-14s%-5s %5zu %10ld %8.1f %10.1f %12.0f\n", s->name, ring ? "/ring" : "", s->n, iters,
+        received() * 100.0 / iters, spent * 1e9 / iters, iters / spent);
+    }
+    free(s->pkts);
+  }
+  return EXIT_SUCCESS;
+}
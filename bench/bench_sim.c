@@ -0,0 +1,116 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// Benchmark of the whole probing loop on simulated clock and path:
+// scheduling, grace period, statistics and cache expiry, no real waits.
+//   bench_sim [CYCLES]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "net.h"
+#include "polling.h"
+#include "sim.h"
+
+enum { HOPS = 10, LOSSY = 3, SILENT = 6, LOSS = 20 };
+
+typedef struct {
+  const char *name;
+  int proto;
+  int cache;  // seconds, 0 to probe every cycle
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+  { "icmp",       IPPROTO_ICMP, 0 },
+  { "udp",        IPPROTO_UDP,  0 },
+  { "tcp",        IPPROTO_TCP,  0 },
+  { "icmp-cache", IPPROTO_ICMP, 30 },
+};
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_path(sim_hop_t hops[HOPS]) {
+  memset(hops, 0, HOPS * sizeof(sim_hop_t));
+  for (int i = 0; i < HOPS; i++) {
+    if (i != SILENT) {
+      uint8_t *a = (uint8_t *)&hops[i].addr;
+      a[0] = 10; a[2] = i; a[3] = 1;  // 10.0.HOP.1
+    }
+    hops[i].rtt = (i + 1) * 1000;
+    hops[i].jitter = (i + 1) * 100;
+    hops[i].loss = (i == LOSSY) ? LOSS : 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  long cycles = (argc > 1) ? atol(argv[1]) : 10000;
+  if (cycles <= 0)
+    cycles = 10000;
+  sim_hop_t hops[HOPS];
+  make_path(hops);
+  printf("%-10s %8s %8s %8s %10s %10s %8s %8s\n", "scenario", "cycles", "sent", "recv",
+    "virtual,s", "real,ms", "avgerr", "losserr");
+  for (size_t i = 0; i < ARRAY_LEN(scenarios); i++) {
+    const scenario_t *sc = &scenarios[i];
+    run_opts = ini_opts;
+    run_opts.interactive = false;
+    run_opts.dns = false;
+    run_opts.cycles = cycles;
+    run_opts.oncache = (sc->cache > 0);
+    run_opts.cache = sc->cache;
+    if (!net_replay_start(AF_INET))
+      return EXIT_FAILURE;
+    net_replay_target(&hops[HOPS - 1].addr);
+    net_set_type(sc->proto);
+    if (!sim_start(HOPS, hops, 1 + i)) {
+      perror("sim_start");
+      return EXIT_FAILURE;
+    }
+    double start = now_sec();
+    bool ok = poll_loop();
+    double spent = now_sec() - start;
+    sim_stop();
+    if (!ok) {
+      fprintf(stderr, "%s: poll_loop() failed\n", sc->name);
+      return EXIT_FAILURE;
+    }
+    struct timespec virt;
+    sim_elapsed(&virt);
+    long sent = 0, recv = 0;
+    double avgerr = 0;
+    for (int at = 0; at < HOPS; at++) {
+      sent += atol(net_elem(at, 'S'));
+      recv += atol(net_elem(at, 'R'));
+      if (at != SILENT)
+        avgerr = fmax(avgerr, fabs(atof(net_elem(at, 'A')) - hops[at].rtt / 1000.));
+    }
+    double losserr = fabs(atof(net_elem(LOSSY, 'L')) - LOSS);
+    printf("%-10s %8ld %8ld %8ld %10lld %10.1f %8.2f %8.2f\n", sc->name, cycles, sent, recv,
+      (long long)virt.tv_sec, spent * 1e3, avgerr, losserr);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef MICRO_H
+#define MICRO_H
+
+// Parts of bench_micro: micro_<module>.c include the module's source
+// to get at its static functions, and run them through bm_run().
+
+#include <stdint.h>
+
+enum { BM_HOPS = 30 };  // synthetic path length
+
+extern volatile uintptr_t bm_sink;  // results go here to be kept
+
+// time 'fn' over 'iters' calls, and save it under 'name'
+void bm_run(const char *name, long iters, void (*fn)(long iters));
+
+void bm_net(long iters);
+#ifdef WITH_IPINFO
+void bm_ipinfo(long iters);
+#endif
+
+#endif
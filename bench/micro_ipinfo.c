@@ -0,0 +1,70 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// bench_micro part: record splitting and whois parsing of ipinfo.c
+
+#include "../ipinfo.c"
+#include "micro.h"
+
+enum { WHOIS_ORIGIN = 2 };  // riswhois.ripe.net
+
+static const char txt_record[] = "13335 | 1.1.1.0/24 | AU | apnic | 2011-08-11";
+
+static const char whois_reply[] =
+  "% This is RIPE NCC's Routing Information Service\n"
+  "% whois gateway to collected BGP Routing Tables, version 2.0\n"
+  "% IPv4 or IPv6 address to origin prefix match\n"
+  "%\n"
+  "% For more information visit http://www.ripe.net/ris/riswhois.html\n"
+  "\n"
+  "route:          1.1.1.0/24\n"
+  "origin:         AS13335\n"
+  "descr:          CLOUDFLARENET, US\n"
+  "lastupd-frst:   2018-03-31 14:37Z  80.77.16.114@rrc18\n"
+  "lastupd-last:   2024-06-01 12:00Z  195.66.224.175@rrc01\n"
+  "seen-at:        rrc00,rrc01,rrc03,rrc04,rrc05,rrc06,rrc07,rrc10,rrc11,rrc12\n"
+  "num-rispeers:   330\n"
+  "source:         RISWHOIS\n"
+  "\n";
+
+static void run_split_with_sep(long iters) {
+  char buff[sizeof(txt_record)];
+  for (long i = 0; i < iters; i++) {
+    memcpy(buff, txt_record, sizeof(buff));
+    char* list[II_REC_ARR_LEN] = {buff};
+    bm_sink += split_with_sep(ARRAY_LEN(list), list, VSLASH, '"');
+  }
+}
+
+// parsed in place, so every reply is a fresh copy
+static void run_parse_whois(long iters) {
+  char buff[sizeof(whois_reply)];
+  for (long i = 0; i < iters; i++) {
+    memcpy(buff, whois_reply, sizeof(buff));
+    parse_whois((atndx_t){ .at = i % BM_HOPS, .ndx = 0 }, sizeof(buff) - 1, buff);
+  }
+  bm_sink += ipinfo_replies[0];
+}
+
+void bm_ipinfo(long iters) {
+  bm_run("split_with_sep", iters, run_split_with_sep);
+  char arg[8];
+  snprintf(arg, sizeof(arg), "%d", WHOIS_ORIGIN);
+  if (ipinfo_init(arg))
+    bm_run("parse_whois", iters, run_parse_whois);
+}
@@ -0,0 +1,119 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+// bench_micro part: statistics, stat formatting, mpls and checksums of net.c
+
+#include "../net.c"
+#include "micro.h"
+
+enum { SCRATCH_AT = BM_HOPS, PKT_SIZE = 64 };
+
+static char stat_keys[MAXFLD + 1];
+
+static void run_hop_stats(long iters) {
+  for (long i = 0; i < iters; i++) {
+    timemsec_t curr = { .ms = 10 + (i & 15), .frac = (i * 7919) % MICRO };
+    hop_stats(SCRATCH_AT, curr);
+  }
+  bm_sink += host[SCRATCH_AT].recv;
+}
+
+static void run_net_elem(long iters) {
+  size_t nkey = strlen(stat_keys);
+  for (long i = 0; i < iters; i++) {
+    const char *str = net_elem(i % BM_HOPS, stat_keys[i % nkey]);
+    bm_sink += str ? str[0] : 0;
+  }
+}
+
+static void run_net_settled_elem(long iters) {
+  size_t nkey = strlen(stat_keys);
+  for (long i = 0; i < iters; i++) {
+    const char *str = net_settled_elem(i % BM_HOPS, stat_keys[i % nkey]);
+    bm_sink += str ? str[0] : 0;
+  }
+}
+
+#ifdef WITH_MPLS
+enum { MPLS_LABELS = 2, MPLS_SIZE = MPLSMIN + (MPLS_LABELS - 1) * LAB_SZ };
+static uint8_t mpls_data[MPLS_SIZE];
+
+static void mpls_prepare(void) {
+  size_t off = MPLSMIN - (IES_SZ + IEO_SZ + LAB_SZ);
+  struct icmpext_struct *ies = (struct icmpext_struct *)&mpls_data[off];
+  ies->ver = ICMP_EXT_VER;
+  ies->sum = htons(0xffff);
+  off += IES_SZ;
+  struct icmpext_object *ieo = (struct icmpext_object *)&mpls_data[off];
+  ieo->len = htons(IEO_SZ + MPLS_LABELS * LAB_SZ);
+  ieo->class = ICMP_EXT_CLASS_MPLS;
+  ieo->type = ICMP_EXT_TYPE_MPLS;
+  off += IEO_SZ;
+  for (int i = 0; i < MPLS_LABELS; i++, off += LAB_SZ) {
+    uint32_t lab = htonl(((16000 + i) << 12) | ((i == MPLS_LABELS - 1) ? 0x100 : 0) | 1);
+    memcpy(&mpls_data[off], &lab, LAB_SZ);
+  }
+}
+
+// decodempls() swaps the object length in place, so it gets a fresh copy every time
+static void run_decodempls(long iters) {
+  uint8_t data[MPLS_SIZE];
+  for (long i = 0; i < iters; i++) {
+    memcpy(data, mpls_data, sizeof(data));
+    const mpls_data_t *mpls = decodempls(data, sizeof(data));
+    bm_sink += mpls ? mpls->n : 0;
+  }
+}
+#endif
+
+static void run_sum1616(long iters) {
+  uint16_t data[PKT_SIZE / 2];
+  for (size_t i = 0; i < ARRAY_LEN(data); i++)
+    data[i] = i * 0x0101;
+  for (long i = 0; i < iters; i++) {
+    data[0] = i;
+    bm_sink += sum1616(data, ARRAY_LEN(data), 0);
+  }
+}
+
+static void run_udpsum16(long iters) {
+  struct _iphdr ip = { .proto = IPPROTO_UDP, .saddr = htonl(0x0a000001), .daddr = htonl(0x0a00001e) };
+  int dsize = PKT_SIZE - sizeof(ip) - sizeof(struct udphdr);
+  struct udphdr udp = { .uh_sport = htons(LO_UDPPORT), .uh_ulen = htons(PKT_SIZE - sizeof(ip)) };
+  for (long i = 0; i < iters; i++) {
+    udp.uh_dport = htons(LO_UDPPORT + 1 + (i % MAXSEQ));
+    bm_sink += udpsum16(&ip, &udp, udp.uh_ulen, dsize);
+  }
+}
+
+void bm_net(long iters) {
+  size_t n = 0;
+  for (int i = 0; (i < stat_max) && (n < MAXFLD); i++)
+    if (stats[i].key != UNDERSCORE)
+      stat_keys[n++] = stats[i].key;
+  stat_keys[n] = 0;
+  bm_run("hop_stats", iters, run_hop_stats);
+  bm_run("net_elem", iters, run_net_elem);
+  bm_run("net_settled_elem", iters, run_net_settled_elem);
+#ifdef WITH_MPLS
+  mpls_prepare();
+  bm_run("decodempls", iters, run_decodempls);
+#endif
+  bm_run("sum1616", iters, run_sum1616);
+  bm_run("udpsum16", iters, run_udpsum16);
+}
@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+#
+#   mtr  --  a network diagnostic tool
+#   Copyright (C) 1997,1998  Matt Kimball
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License version 2 as
+#   published by the Free Software Foundation.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program; if not, write to the Free Software
+#   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+
+"""End-to-end benchmark of mtr over an emulated path (needs root).
+
+A chain of network namespaces linked with veth pairs:
+
+  src -- hop1 -- hop2 -- ... -- hopN -- dst
+           `--- hop2' --'                       (ECMP branches with --ecmp)
+
+Every forward link gets netem delay/jitter/loss, ICMP errors of routers can be
+rate limited, and a responder can stand for a router to reply with RFC4950 MPLS
+labels. mtr runs in each protocol mode, and its report is compared with the
+configured path: found addresses, delay and loss per hop. Resource usage of
+every run is taken from rusage (CPU, context switches), and syscall counts
+from strace if it's asked for.
+
+  sudo bench/netns_path.py -b _build/mtr -n 5 -d 2 -l 1 --ecmp 2:2 --mpls 3
+"""
+
+import argparse
+import json
+import os
+import re
+import resource
+import shutil
+import subprocess
+import sys
+import time
+
+PREFIX = 'mtrb'
+DST4, DST6 = '10.78.0.1', 'fd78::1'
+MODES = {'icmp': [], 'udp': ['-u'], 'tcp': ['-t']}
+
+
+def sh(*args, ns=None, check=True):
+    cmd = (['ip', 'netns', 'exec', ns] if ns else []) + [str(a) for a in args]
+    r = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if check and r.returncode:
+        sys.exit('FAIL: %s: %s' % (' '.join(cmd), r.stderr.strip()))
+    return r
+
+
+def sysctl(ns, *kv):
+    sh('sysctl', '-qw', *kv, ns=ns)
+
+
+# RFC4884/RFC4950 responder: ipv4/ipv6 probes expiring at the hop are answered
+# with time-exceeded carrying MPLS labels, the kernel's own replies are muted
+RESPONDER = r'''
+import socket, struct, sys
+ifs, labels = set(sys.argv[1].split(',')), [int(l) for l in sys.argv[2].split(',')]
+def csum(b):
+    if len(b) % 2: b += b'\0'
+    s = sum(struct.unpack('!%dH' % (len(b) // 2), b))
+    while s >> 16: s = (s & 0xffff) + (s >> 16)
+    return ~s & 0xffff
+def ext():
+    obj = b''.join(struct.pack('!I', (l << 12) | ((i == len(labels) - 1) << 8) | 1) for i, l in enumerate(labels))
+    obj = struct.pack('!HBB', 4 + len(obj), 1, 1) + obj
+    e = struct.pack('!BBH', 0x20, 0, 0) + obj
+    return e[:2] + struct.pack('!H', csum(e)) + e[4:]
+s4 = socket.socket(socket.AF_INET, socket.SOCK_RAW, socket.IPPROTO_ICMP)
+s6 = socket.socket(socket.AF_INET6, socket.SOCK_RAW, socket.IPPROTO_ICMPV6)
+sn = socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(3))
+while True:
+    pkt, (ifn, proto, ptype, _, _) = sn.recvfrom(65535)
+    if (ifn not in ifs) or (ptype == socket.PACKET_OUTGOING):
+        continue
+    ip = pkt[14:]
+    orig = (ip[:128] + bytes(128))[:128]
+    if (proto == 0x0800) and (len(ip) >= 28) and (ip[8] == 1):
+        icmp = struct.pack('!BBHBBH', 11, 0, 0, 0, 128 // 4, 0) + orig + ext()
+        icmp = icmp[:2] + struct.pack('!H', csum(icmp)) + icmp[4:]
+        s4.sendto(icmp, (socket.inet_ntop(socket.AF_INET, ip[12:16]), 0))
+    elif (proto == 0x86dd) and (len(ip) >= 48) and (ip[7] == 1):
+        icmp = struct.pack('!BBHBBH', 3, 0, 0, 128 // 8, 0, 0) + orig + ext()
+        s6.sendto(icmp, (socket.inet_ntop(socket.AF_INET6, ip[8:24]), 0))
+'''
+
+
+class Path:
+    def __init__(self, opt):
+        self.opt = opt
+        self.width = [1] * (opt.routers + 2)  # src, hops, dst
+        if opt.ecmp:
+            hop, width = (int(v) for v in opt.ecmp.split(':'))
+            if not 1 <= hop <= opt.routers:
+                sys.exit('FAIL: ECMP hop must be in 1..%d' % opt.routers)
+            self.width[hop] = width
+        if opt.mpls and ((not 1 <= opt.mpls <= opt.routers) or (self.width[opt.mpls] > 1)):
+            sys.exit('FAIL: MPLS hop must be a single router in 1..%d' % opt.routers)
+        self.nodes = [['%s-%d-%d' % (PREFIX, h, i) for i in range(w)] for h, w in enumerate(self.width)]
+        self.links = []  # (id, left node, right node, hop of the left one)
+        self.responder = None
+
+    def ns_all(self):
+        return [ns for hop in self.nodes for ns in hop]
+
+    def build(self):
+        self.clean()
+        for ns in self.ns_all():
+            sh('ip', 'netns', 'add', ns)
+            sh('ip', '-n', ns, 'link', 'set', 'lo', 'up')
+            sysctl(ns, 'net.ipv4.ip_forward=1', 'net.ipv6.conf.all.forwarding=1',
+                   'net.ipv4.fib_multipath_hash_policy=1', 'net.ipv6.fib_multipath_hash_policy=1',
+                   'net.ipv6.conf.all.accept_dad=0', 'net.ipv6.conf.default.accept_dad=0')
+            if self.opt.ratelimit is not None:
+                sysctl(ns, 'net.ipv4.icmp_ratelimit=%d' % self.opt.ratelimit,
+                       'net.ipv6.icmp.ratelimit=%d' % self.opt.ratelimit)
+        dst = self.nodes[-1][0]
+        sh('ip', '-n', dst, 'addr', 'add', DST4 + '/32', 'dev', 'lo')
+        sh('ip', '-n', dst, 'addr', 'add', DST6 + '/128', 'dev', 'lo', 'nodad')
+        lid = 0
+        for hop in range(len(self.nodes) - 1):
+            for left in self.nodes[hop]:
+                for right in self.nodes[hop + 1]:
+                    lid += 1
+                    dev = 'v%d' % lid
+                    sh('ip', 'link', 'add', dev, 'netns', left, 'type', 'veth', 'peer', 'name', dev, 'netns', right)
+                    for ns, n in ((left, 1), (right, 2)):
+                        sh('ip', '-n', ns, 'addr', 'add', '10.77.%d.%d/24' % (lid, n), 'dev', dev)
+                        sh('ip', '-n', ns, 'addr', 'add', 'fd77:0:%x::%d/64' % (lid, n), 'dev', dev, 'nodad')
+                        sh('ip', '-n', ns, 'link', 'set', dev, 'up')
+                    self.links.append((lid, left, right, hop))
+                    self.netem(left, dev)
+        for hop, nodes in enumerate(self.nodes):
+            for ns in nodes:
+                fwd = [(l, 2) for l in self.links if l[1] == ns]
+                back = [(l, 1) for l in self.links if l[2] == ns]
+                if fwd:
+                    self.route(ns, 'default', fwd)
+                if back:  # to the source side
+                    self.route(ns, '10.77.0.0/16', back, 'fd77::/32')
+                    if hop == len(self.nodes) - 1:
+                        self.route(ns, 'default', back)
+        if self.opt.mpls:
+            self.start_responder()
+
+    def netem(self, ns, dev):
+        o = self.opt
+        if not (o.delay or o.jitter or o.loss):
+            return
+        args = ['tc', '-n', ns, 'qdisc', 'add', 'dev', dev, 'root', 'netem', 'limit', '10000']
+        if o.delay or o.jitter:
+            args += ['delay', '%gms' % o.delay] + (['%gms' % o.jitter] if o.jitter else [])
+        if o.loss:
+            args += ['loss', '%g%%' % o.loss]
+        sh(*args)
+
+    def route(self, ns, prefix, links, prefix6=None):
+        for fam, pfx in (('-4', prefix), ('-6', prefix6 or prefix)):
+            hops = []
+            for (lid, _, _, _), n in links:
+                gw = ('10.77.%d.%d' if fam == '-4' else 'fd77:0:%x::%d') % (lid, n)
+                hops.append(['via', gw, 'dev', 'v%d' % lid])
+            args = ['ip', fam, '-n', ns, 'route', 'add', pfx]
+            if len(hops) == 1:
+                args += hops[0]
+            else:
+                for h in hops:
+                    args += ['nexthop'] + h
+            sh(*args)
+
+    def start_responder(self):
+        ns = self.nodes[self.opt.mpls][0]
+        # kernel's own time-exceeded is muted by the global icmp limit, it covers icmpv6 errors
+        # too (types of net.ipv6.icmp.ratemask). NOTE: on kernels where this limit (or its
+        # credit) is not per namespace, it's the host's one: icmp errors of the whole host
+        # can be muted till the namespaces are deleted
+        sysctl(ns, 'net.ipv4.icmp_msgs_per_sec=0', 'net.ipv4.icmp_msgs_burst=0')
+        ifs = ','.join('v%d' % l[0] for l in self.links if l[2] == ns)
+        labels = '%d,%d' % (16000 + self.opt.mpls, 100)
+        self.responder = subprocess.Popen(['ip', 'netns', 'exec', ns, sys.executable, '-c', RESPONDER, ifs, labels])
+
+    def clean(self):
+        if self.responder:
+            self.responder.kill()
+            self.responder.wait()
+            self.responder = None
+        names = sh('ip', 'netns', 'list').stdout.split('\n')
+        for name in names:
+            name = name.split(' ')[0]
+            if name.startswith(PREFIX + '-'):
+                sh('ip', 'netns', 'del', name, check=False)
+
+    # what a run is expected to show at hop (1..N+1): replies come from addresses
+    # of the links towards the source, probes go through 'hop' lossy links
+    def expect(self, hop):
+        o = self.opt
+        return {'hosts': self.width[hop - 1] * self.width[hop], 'avg': hop * o.delay,
+                'loss': 100 * (1 - (1 - o.loss / 100) ** hop)}
+
+
+# plain report: " 1. ADDR  LOSS%  SENT  AVRG", then other addresses and labels
+def parse_report(out):
+    hops, at = {}, None
+    for line in out.splitlines():
+        m = re.match(r'\s*(\d+)\.\s+(\S+)\s+([\d.]+)%\s+(\d+)\s+([\d.]+)', line)
+        if m:
+            at = int(m.group(1))
+            hops[at] = {'hosts': [m.group(2)], 'loss': float(m.group(3)), 'sent': int(m.group(4)),
+                        'avg': float(m.group(5)), 'mpls': 0}
+        elif at and '[Lbl:' in line:
+            hops[at]['mpls'] += 1
+        elif at and re.match(r'\s+\S+\s*$', line) and (line.strip() != '???'):
+            hops[at]['hosts'].append(line.strip())
+    return hops
+
+
+def run_mtr(opt, mode, family):
+    args = [opt.mtr, '-n', '-r', '-F', 'LSA', '-c', opt.cycles, '-%d' % family] + MODES[mode]
+    if opt.mpls:
+        args.append('-e')
+    args += opt.args.split() + [DST4 if family == 4 else DST6]
+    cmd = ['ip', 'netns', 'exec', '%s-0-0' % PREFIX]
+    trace = None
+    if opt.strace:
+        trace = '/tmp/%s-strace.%d' % (PREFIX, os.getpid())
+        cmd += ['strace', '-f', '-c', '-o', trace]
+    before = resource.getrusage(resource.RUSAGE_CHILDREN)
+    start = time.monotonic()
+    proc = subprocess.run(cmd + [str(a) for a in args], stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    wall = time.monotonic() - start
+    after = resource.getrusage(resource.RUSAGE_CHILDREN)
+    if proc.returncode:
+        sys.exit('FAIL: %s: %s' % (' '.join(str(a) for a in args), proc.stderr.strip()))
+    usage = {'wall': wall}
+    for k in ('utime', 'stime', 'nvcsw', 'nivcsw'):
+        usage[k] = getattr(after, 'ru_' + k) - getattr(before, 'ru_' + k)
+    if trace:
+        with open(trace) as f:
+            m = re.search(r'^\s*100\.00\s+\S+\s+\S+\s+(\d+)', f.read(), re.M)
+        usage['syscalls'] = int(m.group(1)) if m else None
+        os.unlink(trace)
+    return parse_report(proc.stdout), usage
+
+
+def report(path, results, as_json):
+    if as_json:
+        print(json.dumps(results, indent=1))
+        return
+    for r in results:
+        u = r['usage']
+        print('%s ipv%d: %.1fs wall, cpu %.0fms user %.0fms sys, %d voluntary %d involuntary switches%s' % (
+            r['mode'], r['family'], u['wall'], u['utime'] * 1e3, u['stime'] * 1e3, u['nvcsw'], u['nivcsw'],
+            ', %d syscalls' % u['syscalls'] if u.get('syscalls') else ''))
+        print('  %3s %9s %8s %8s %7s %7s %s' % ('hop', 'hosts', 'avg', 'expect', 'loss%', 'expect', 'mpls'))
+        for h in r['hops']:
+            print('  %3d %4d/%-4d %8.2f %8.2f %7.1f %7.1f %s' % (h['hop'], h['hosts'], h['expect']['hosts'],
+                  h['avg'], h['expect']['avg'], h['loss'], h['expect']['loss'],
+                  h['mpls'] if h['hop'] == path.opt.mpls else ''))
+        print('  error: avg %.2fms, loss %.1f%%' % (r['error']['avg'], r['error']['loss']))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    p.add_argument('-b', '--mtr', default='mtr', help='mtr binary (default: mtr)')
+    p.add_argument('-n', '--routers', type=int, default=4, help='routers between source and target (4)')
+    p.add_argument('-d', '--delay', type=float, default=0, help='delay per link, ms')
+    p.add_argument('-j', '--jitter', type=float, default=0, help='delay jitter per link, ms')
+    p.add_argument('-l', '--loss', type=float, default=0, help='loss per link, percent')
+    p.add_argument('-e', '--ecmp', help='HOP:WIDTH parallel routers at hop')
+    p.add_argument('-r', '--ratelimit', type=int, help='icmp ratelimit of routers, ms')
+    p.add_argument('-m', '--mpls', type=int, default=0, help='hop replying with MPLS labels')
+    p.add_argument('-c', '--cycles', type=int, default=10, help='mtr cycles per run (10)')
+    p.add_argument('-M', '--modes', default='icmp,udp,tcp', help='protocol modes (icmp,udp,tcp)')
+    p.add_argument('-f', '--families', default='4,6', help='address families (4,6)')
+    p.add_argument('-a', '--args', default='', help='extra mtr arguments')
+    p.add_argument('-s', '--strace', action='store_true', help='count syscalls with strace')
+    p.add_argument('-J', '--json', action='store_true', help='print results as JSON')
+    p.add_argument('-k', '--keep', action='store_true', help='keep namespaces after runs')
+    opt = p.parse_args()
+    if os.geteuid():
+        sys.exit('FAIL: namespaces need root')
+    if opt.strace and not shutil.which('strace'):
+        sys.exit('FAIL: strace is not found')
+    if os.sep in opt.mtr:
+        opt.mtr = os.path.abspath(opt.mtr)
+    path = Path(opt)
+    results = []
+    try:
+        path.build()
+        for family in (int(f) for f in opt.families.split(',')):
+            for mode in opt.modes.split(','):
+                if mode not in MODES:
+                    sys.exit('FAIL: unknown mode %s' % mode)
+                hops, usage = run_mtr(opt, mode, family)
+                res = {'mode': mode, 'family': family, 'usage': usage, 'hops': []}
+                davg = dloss = 0
+                for hop in range(1, opt.routers + 2):
+                    got = hops.get(hop, {'hosts': [], 'loss': 100, 'avg': 0, 'sent': 0, 'mpls': 0})
+                    exp = path.expect(hop)
+                    res['hops'].append({'hop': hop, 'hosts': len(got['hosts']), 'avg': got['avg'],
+                                        'loss': got['loss'], 'mpls': got['mpls'], 'expect': exp})
+                    davg += abs(got['avg'] - exp['avg'])
+                    dloss += abs(got['loss'] - exp['loss'])
+                res['error'] = {'avg': davg / (opt.routers + 1), 'loss': dloss / (opt.routers + 1)}
+                results.append(res)
+    finally:
+        if not opt.keep:
+            path.clean()
+        elif path.responder:
+            path.responder = None  # leave it running with namespaces
+    report(path, results, opt.json)
+
+
+if __name__ == '__main__':
+    main()
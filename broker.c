@@ -0,0 +1,402 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/ip_icmp.h>
+
+#if defined(LOG_NET) && !defined(LOGMOD)
+#define LOGMOD
+#endif
+
+#if !defined(LOG_NET) && defined(LOGMOD)
+#undef LOGMOD
+#endif
+
+#include "broker.h"
+#include "net.h"
+#include "nls.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#if !defined(ICMP_TIME_EXCEEDED) && defined(ICMP_TIMXCEED)
+#define ICMP_TIME_EXCEEDED ICMP_TIMXCEED
+#endif
+
+enum { FD_LISTEN, FD_RAW4, FD_RAW6, FD_CLIENT, MAX_CLIENTS = 64, FD_MAX = FD_CLIENT + MAX_CLIENTS };
+enum { KEY_ICMP, KEY_UDP, KEY_MAX };
+
+static struct pollfd fds[FD_MAX];
+static uint8_t owner[KEY_MAX][UINT16_MAX + 1]; // key -> client's slot in fds[] (0 if free)
+static volatile sig_atomic_t stopped;
+
+static bool broker_addr(const char *path, struct sockaddr_un *sun) {
+  memset(sun, 0, sizeof(*sun));
+  sun->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sun->sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strncpy(sun->sun_path, path, sizeof(sun->sun_path) - 1);
+  return true;
+}
+
+int broker_connect(const char *path) { // NONNULL(1)
+  struct sockaddr_un sun;
+  if (!broker_addr(path, &sun))
+    return -1;
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (sock < 0)
+    return -1;
+  if (connect(sock, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+    int e = errno;
+    close(sock);
+    errno = e;
+    return -1;
+  }
+  return sock;
+}
+
+bool broker_send(int sock, const broker_req_t *req, const uint8_t *data, size_t size) { // NONNULL(2, 3)
+  struct iovec iov[] = {
+    { .iov_base = (void *)req,  .iov_len = sizeof(*req) },
+    { .iov_base = (void *)data, .iov_len = size },
+  };
+  struct msghdr msg = { .msg_iov = iov, .msg_iovlen = ARRAY_LEN(iov) };
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)(sizeof(*req) + size);
+}
+
+// Returns size of packet following the header, or -1 (ECONNRESET if broker is gone)
+ssize_t broker_recv(int sock, broker_rep_t *rep, uint8_t *buff, size_t size) { // NONNULL(2, 3)
+  struct iovec iov[] = {
+    { .iov_base = rep,  .iov_len = sizeof(*rep) },
+    { .iov_base = buff, .iov_len = size },
+  };
+  struct msghdr msg = { .msg_iov = iov, .msg_iovlen = ARRAY_LEN(iov) };
+  ssize_t len = recvmsg(sock, &msg, MSG_DONTWAIT);
+  if (len == 0)
+    errno = ECONNRESET;
+  else if ((len > 0) && ((len < (ssize_t)sizeof(*rep)) || (rep->ver != BROKER_VER)))
+    errno = EPROTO;
+  else if (len > 0)
+    return len - sizeof(*rep);
+  return -1;
+}
+
+
+// Icmp id or udp source port of probe: the key to find out its client
+static inline uint8_t echo_request(int family UNUSED) {
+#ifdef ENABLE_IPV6
+  if (family == AF_INET6)
+    return ICMP6_ECHO_REQUEST;
+#endif
+  return ICMP_ECHO;
+}
+
+static int probe_key(int proto, const uint8_t *data, ssize_t size, uint16_t *key) {
+  uint16_t val;
+  if (size < 8)
+    return -1;
+  switch (proto) {
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:
+      memcpy(&val, data + 4, sizeof(val));
+      *key = val; // as is, mtr keeps it in host byte order
+      return KEY_ICMP;
+    case IPPROTO_UDP:
+      memcpy(&val, data, sizeof(val));
+      *key = ntohs(val);
+      return KEY_UDP;
+    default: break;
+  }
+  return -1;
+}
+
+static void broker_reply(int slot, const broker_rep_t *rep, const uint8_t *data, size_t size) {
+  struct iovec iov[] = {
+    { .iov_base = (void *)rep,  .iov_len = sizeof(*rep) },
+    { .iov_base = (void *)data, .iov_len = size },
+  };
+  struct msghdr msg = { .msg_iov = iov, .msg_iovlen = data ? ARRAY_LEN(iov) : 1 };
+  if (sendmsg(fds[slot].fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    LOGMSG("client#%d: %s", slot - FD_CLIENT, strerror(errno)); // slow client loses replies
+}
+
+static void broker_drop(int slot) {
+  LOGMSG("client#%d: disconnected", slot - FD_CLIENT);
+  close(fds[slot].fd);
+  fds[slot].fd = -1;
+  for (int k = 0; k < KEY_MAX; k++)
+    for (uint i = 0; i <= UINT16_MAX; i++)
+      if (owner[k][i] == slot)
+        owner[k][i] = 0;
+}
+
+static void broker_accept(void) {
+  int sock = accept(fds[FD_LISTEN].fd, NULL, NULL);
+  if (sock < 0) {
+    WARN("accept()");
+    return;
+  }
+  for (int slot = FD_CLIENT; slot < FD_MAX; slot++)
+    if (fds[slot].fd < 0) {
+      fds[slot].fd = sock;
+      fds[slot].events = POLLIN;
+      LOGMSG("client#%d: connected", slot - FD_CLIENT);
+      return;
+    }
+  LOGMSG("no free slots for clients (max=%d)", MAX_CLIENTS);
+  close(sock);
+}
+
+// Shape of mtr's probes: echo request with code 0, or udp datagram from unprivileged port
+// with its own length, and payload not larger than mtr's maximum
+static int probe_shape(const broker_req_t *req, const uint8_t *data, ssize_t size) {
+  if ((size - 8) > (MAXPACKET - MINPACKET))
+    return EMSGSIZE;
+  if (req->proto == IPPROTO_ICMP)
+    return ((data[0] == echo_request(req->family)) && !data[1]) ? 0 : EPERM;
+  uint16_t sport, ulen;
+  memcpy(&sport, data, sizeof(sport));
+  memcpy(&ulen, data + 4, sizeof(ulen));
+  if (ntohs(sport) < IPPORT_RESERVED)
+    return EACCES;
+  return (ntohs(ulen) == size) ? 0 : EINVAL;
+}
+
+// Probe request: only echo requests and udp probes, with ids the client owns
+static void broker_request(int slot) {
+  uint8_t buff[sizeof(broker_req_t) + MAXPACKET];
+  ssize_t len = recv(fds[slot].fd, buff, sizeof(buff), MSG_DONTWAIT);
+  if (len <= 0) {
+    if ((len == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+      broker_drop(slot);
+    return;
+  }
+  broker_req_t req;
+  memcpy(&req, buff, (len < (ssize_t)sizeof(req)) ? (size_t)len : sizeof(req));
+  const uint8_t *data = buff + sizeof(req);
+  ssize_t size = len - sizeof(req);
+  broker_rep_t rep = { .ver = BROKER_VER, .family = req.family };
+  uint16_t key = 0;
+  int kind = -1;
+  if ((len < (ssize_t)sizeof(req)) || (req.ver != BROKER_VER))
+    rep.error = EPROTO;
+  else if ((req.family != AF_INET)
+#ifdef ENABLE_IPV6
+        && (req.family != AF_INET6)
+#endif
+    ) rep.error = EAFNOSUPPORT;
+  else if ((req.proto != IPPROTO_ICMP) && (req.proto != IPPROTO_UDP))
+    rep.error = EPROTONOSUPPORT;
+  else if (!req.ttl || ((kind = probe_key(req.proto, data, size, &key)) < 0))
+    rep.error = EINVAL;
+  else if (owner[kind][key] && (owner[kind][key] != slot))
+    rep.error = EADDRINUSE;
+  else if (!(rep.error = probe_shape(&req, data, size))) {
+    owner[kind][key] = slot;
+    if (!net_raw_send(req.family, req.proto, req.ttl, req.tos, req.dst, data, size))
+      rep.error = errno;
+  }
+  if (rep.error) {
+    LOGMSG("client#%d: proto=%d key=%u: %s", slot - FD_CLIENT, req.proto, key, strerror(rep.error));
+    broker_reply(slot, &rep, NULL, 0);
+  }
+}
+
+// Key of our probe in reply: echo reply's id, or header of original datagram in icmp error
+static int reply_key(int family, const uint8_t *packet, ssize_t size, uint16_t *key) {
+  ssize_t off = (family == AF_INET) ? (packet[0] & 0xf) * 4 : 0;
+  if (size < off + 8)
+    return -1;
+  uint8_t type = packet[off];
+  bool echo = false, error = false;
+  switch (family) {
+    case AF_INET:
+      echo  = (type == ICMP_ECHOREPLY);
+      error = (type == ICMP_TIME_EXCEEDED) || (type == ICMP_UNREACH);
+      break;
+#ifdef ENABLE_IPV6
+    case AF_INET6:
+      echo  = (type == ICMP6_ECHO_REPLY);
+      error = (type == ICMP6_TIME_EXCEEDED) || (type == ICMP6_DST_UNREACH);
+      break;
+#endif
+    default: break;
+  }
+  if (echo)
+    return probe_key(IPPROTO_ICMP, packet + off, size - off, key);
+  if (!error)
+    return -1;
+  off += 8; // original datagram
+  int proto = -1;
+  if (family == AF_INET) {
+    if (size < off + 20)
+      return -1;
+    proto = packet[off + 9];
+    off += (packet[off] & 0xf) * 4;
+  } else {
+    if (size < off + 40)
+      return -1;
+    proto = packet[off + 6]; // extension headers are not expected in probes
+    off += 40;
+  }
+  if ((proto == IPPROTO_ICMP) || (proto == IPPROTO_ICMPV6)) // probe must be an echo request
+    if ((size <= off) || (packet[off] != echo_request(family)))
+      return -1;
+  return probe_key(proto, packet + off, size - off, key);
+}
+
+static void broker_forward(int family, int sock) {
+  uint8_t packet[MAXPACKET];
+  struct sockaddr_storage from;
+  union { struct cmsghdr hdr; uint8_t buf[64]; } control;
+  struct iovec iov = { .iov_base = packet, .iov_len = sizeof(packet) };
+  struct msghdr msg = { .msg_name = &from, .msg_namelen = sizeof(from), .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+  ssize_t size = recvmsg(sock, &msg, MSG_DONTWAIT);
+  if (size <= 0)
+    return;
+  uint16_t key = 0;
+  int kind = reply_key(family, packet, size, &key);
+  if ((kind < 0) || !owner[kind][key])
+    return;
+  broker_rep_t rep = { .ver = BROKER_VER, .family = family };
+  if (family == AF_INET)
+    memcpy(rep.from, &((struct sockaddr_in *)&from)->sin_addr, sizeof(struct in_addr));
+#ifdef ENABLE_IPV6
+  else
+    memcpy(rep.from, &((struct sockaddr_in6 *)&from)->sin6_addr, sizeof(struct in6_addr));
+#endif
+#ifdef SO_TIMESTAMPNS
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    if ((cm->cmsg_level == SOL_SOCKET) && (cm->cmsg_type == SCM_TIMESTAMPNS))
+      memcpy(&rep.kts, CMSG_DATA(cm), sizeof(rep.kts));
+#endif
+  broker_reply(owner[kind][key], &rep, packet, size);
+}
+
+static void on_signal(int sig UNUSED) { stopped = 1; }
+
+static int broker_listen(const char *path) {
+  struct sockaddr_un sun;
+  if (!broker_addr(path, &sun)) {
+    warn("%s", path);
+    return -1;
+  }
+  struct stat st;
+  if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) { // left after previous run, unless it's served
+    int live = broker_connect(path);
+    if (live >= 0) {
+      close(live);
+      errno = EADDRINUSE;
+      warn("%s", path);
+      return -1;
+    }
+    unlink(path);
+  }
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (sock < 0) {
+    warn("socket(AF_UNIX, SOCK_SEQPACKET)");
+    return -1;
+  }
+  // created private, then opened to the owner's group: rw-rw----, owned by the real user
+  mode_t mask = umask(S_IRWXG | S_IRWXO);
+  bool bound = (bind(sock, (struct sockaddr *)&sun, sizeof(sun)) == 0);
+  umask(mask);
+  if (!bound || (chown(path, getuid(), getgid()) < 0) || (chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) < 0)
+      || (listen(sock, MAX_CLIENTS) < 0)) {
+    warn("%s", path);
+    if (bound)
+      unlink(path);
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+// Serve clients till SIGINT or SIGTERM, access is controlled by socket file permissions (0660)
+bool broker_serve(const char *path) { // NONNULL(1)
+  int raw[] = { net_raw_recvsock(AF_INET),
+#ifdef ENABLE_IPV6
+    net_raw_recvsock(AF_INET6),
+#else
+    -1,
+#endif
+  };
+  if (raw[0] < 0) {
+    warnx("%s", RAWSOCK_ERR);
+    return false;
+  }
+  int lsock = broker_listen(path);
+  if (lsock < 0)
+    return false;
+#ifdef SO_TIMESTAMPNS
+  int on = 1;
+  for (uint i = 0; i < ARRAY_LEN(raw); i++)
+    if ((raw[i] >= 0) && (setsockopt(raw[i], SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0))
+      LOGMSG("setsockopt(sock=%d, SO_TIMESTAMPNS): %s", raw[i], strerror(errno));
+#endif
+  struct sigaction sa = { .sa_handler = on_signal };
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  for (int i = 0; i < FD_MAX; i++) {
+    fds[i].fd = -1;
+    fds[i].events = POLLIN;
+  }
+  fds[FD_LISTEN].fd = lsock;
+  fds[FD_RAW4].fd = raw[0];
+  fds[FD_RAW6].fd = raw[1];
+  LOGMSG("listen on %s", path);
+  bool okay = true;
+  while (!stopped) {
+    if (poll(fds, FD_MAX, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      warn("poll()");
+      okay = false;
+      break;
+    }
+    if (fds[FD_LISTEN].revents & POLLIN)
+      broker_accept();
+    if (fds[FD_RAW4].revents & POLLIN)
+      broker_forward(AF_INET, fds[FD_RAW4].fd);
+#ifdef ENABLE_IPV6
+    if (fds[FD_RAW6].revents & POLLIN)
+      broker_forward(AF_INET6, fds[FD_RAW6].fd);
+#endif
+    for (int slot = FD_CLIENT; slot < FD_MAX; slot++)
+      if ((fds[slot].fd >= 0) && fds[slot].revents)
+        broker_request(slot);
+  }
+  for (int slot = FD_CLIENT; slot < FD_MAX; slot++)
+    if (fds[slot].fd >= 0)
+      close(fds[slot].fd);
+  close(lsock);
+  unlink(path);
+  return okay;
+}
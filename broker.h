@@ -0,0 +1,52 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "common.h"
+
+// Probe broker: privileged mtr with raw sockets sends probes for unprivileged
+// mtr clients connected to its unix socket, and forwards them replies to their
+// probes (icmp id or udp source port is owned by the client that used it first)
+
+#define BROKER_VER 1
+
+typedef struct broker_req { // client to broker, followed by icmp or udp header and payload
+  uint8_t ver, family, proto, ttl;
+  uint8_t tos, pad[3];
+  uint8_t dst[16];
+} broker_req_t;
+
+typedef struct broker_rep { // broker to client, followed by packet as read from raw socket
+  uint8_t ver, family;
+  uint16_t pad;
+  int32_t error;            // errno of rejected or failed request (without packet)
+  struct timespec kts;      // kernel realtime timestamp, 0 if unknown
+  uint8_t from[16];
+} broker_rep_t;
+
+int broker_connect(const char *path) NONNULL(1);
+bool broker_send(int sock, const broker_req_t *req, const uint8_t *data, size_t size) NONNULL(2, 3);
+ssize_t broker_recv(int sock, broker_rep_t *rep, uint8_t *buff, size_t size) NONNULL(2, 3);
+bool broker_serve(const char *path) NONNULL(1);
+
+#endif
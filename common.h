@@ -14,6 +14,19 @@
 #include <sys/param.h>
 #endif
 
+// unprivileged datagram sockets: ping sockets and IP_RECVERR error queues
+#if defined(HAVE_LINUX_ERRQUEUE_H) && defined(MSG_ERRQUEUE)
+#define WITH_DGRAM
+#endif
+// AF_PACKET receive ring with socket filter
+#if defined(HAVE_LINUX_IF_PACKET_H) && defined(HAVE_LINUX_FILTER_H)
+#define WITH_RING
+#endif
+// probe events in shared memory
+#ifdef HAVE_SHM_OPEN
+#define WITH_EVRING
+#endif
+
 #ifndef INET_ADDRSTRLEN
 #define INET_ADDRSTRLEN  16
 #endif
@@ -186,7 +199,8 @@ typedef struct opts_s {
     chart,    // -d 1st and 2nd bits
     minttl,   // -f first_ttl
     maxttl,   // -m max_ttl
-    qos;      // -q qos
+    qos,      // -q qos
+    mda;      // -K confidence of multipath detection [%], 0 if it's off
   int
     cycles,   // -c cycles_to_run
     pattern,  // -b payload_pattern
@@ -194,8 +208,10 @@ typedef struct opts_s {
     size,     // -s packet_size
     syn,      // -T tcp_timeout
     cache,    // -x
+    flow,     // -k flow-stable probes' flow, -1 if it varies per probe
     port;     // port from 'target:port' in tcp/udp modes
 } opts_t;
+enum { REPORT_PINGS = 100, CACHE_TIMEOUT = 60 }; // default cycles, cache timeout [sec]
 
 // options' cksum
 typedef union opt_sum_u {
@@ -239,6 +255,7 @@ typedef union opt_sum_u {
 
 #define OPT_SUM(tag) do {opt_sum.s.tag = (run_opts.tag != ini_opts.tag);} while(0)
 #define USED_PROTO (run_opts.udp ? "UDP" : (run_opts.tcp ? "TCP" : "ICMP"))
+#define PROTO_NAME(proto) (((proto) == IPPROTO_UDP) ? "UDP" : (((proto) == IPPROTO_TCP) ? "TCP" : "ICMP"))
 #define CHART_MODE (run_opts.chart | (run_opts.color ? (1 << 3) : 0))
 
 // logging, warnings, errors
@@ -286,6 +303,15 @@ typedef union opt_sum_u {
 #endif
 #endif // VA_OPT
 
+// USDT tracepoints of 'mtr' provider: nop instructions unless a tracer is attached
+#ifdef WITH_USDT
+#include <sys/sdt.h>
+#define TRACEPOINT(name, ...) STAP_PROBEV(mtr, name, __VA_ARGS__)
+#else
+#define TRACEPOINT(name, ...) NOOP
+#endif
+#define TS2NSEC(t) ((int64_t)(t).tv_sec * NANO + (t).tv_nsec)
+
 // time conversions
 #define time2msec(t) ((t).tv_sec * MIL + (t).tv_nsec / MICRO)
 #define time2mfrac(t) ((t).tv_nsec % MICRO)
@@ -60,6 +60,9 @@
 /* MPLS decoding */
 #cmakedefine WITH_MPLS
 
+/* USDT tracepoints */
+#cmakedefine WITH_USDT
+
 /* output formats */
 #cmakedefine OUTPUT_FORMAT_RAW
 #cmakedefine OUTPUT_FORMAT_TXT
@@ -93,6 +96,18 @@
 /* sys/param.h header */
 #cmakedefine HAVE_SYS_PARAM_H
 
+/* linux/filter.h header (socket filters) */
+#cmakedefine HAVE_LINUX_FILTER_H
+
+/* linux/if_packet.h header (packet ring) */
+#cmakedefine HAVE_LINUX_IF_PACKET_H
+
+/* linux/errqueue.h header (datagram sockets) */
+#cmakedefine HAVE_LINUX_ERRQUEUE_H
+
+/* shm_open() (events in shared memory) */
+#cmakedefine HAVE_SHM_OPEN
+
 /* sys/types.h types */
 #cmakedefine HAVE_UINT
 #cmakedefine HAVE_ULONG
@@ -20,6 +20,10 @@
 #include "display.h"
 #include "polling.h"
 #include "report.h"
+#include "net.h"
+#ifdef ENABLE_DNS
+#include "dns.h"
+#endif
 #ifdef TUIMODE
 #include "tui.h"
 #endif
@@ -27,10 +31,6 @@
 #include "split.h"
 #endif
 
-void (*eachpass_fn)(void);
-void (*dispclear_fn)(void);
-key_action_t (*keyaction_fn)(void);
-
 bool display_open(void) {
   switch (display_mode) {
 #ifdef TUIMODE
@@ -38,6 +38,9 @@ bool display_open(void) {
 #endif
 #ifdef SPLITMODE
     case DisplaySplit: split_open(); break;
+#endif
+#ifdef OUTPUT_FORMAT_RAW
+    case DisplayRaw: raw_rawtarget(); break;
 #endif
     default: break;
   }
@@ -87,6 +90,14 @@ static inline void display_set_callbacks(void) {
       eachpass_fn  = split_redraw;
       break;
 #endif
+#ifdef OUTPUT_FORMAT_RAW
+    case DisplayRaw:
+      net_newhop_fn = raw_rawhost;
+      net_reply_fn  = raw_rawping;
+      net_sent_fn   = raw_rawxmit;
+      poll_cycle_fn = raw_rawtime;
+      break;
+#endif
 #ifdef OUTPUT_FORMAT_TXT
     case DisplayTXT:
 #endif
@@ -28,8 +28,5 @@ void display_close(bool next);
 void display_confirm_fin(void);
 
 void display_loop(void);
-extern void (*eachpass_fn)(void);
-extern void (*dispclear_fn)(void);
-extern key_action_t (*keyaction_fn)(void);
 
 #endif
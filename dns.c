@@ -39,6 +39,7 @@
 #include "net.h"
 #include "nls.h"
 #include "aux.h"
+#include "intern.h"
 
 #ifdef ENABLE_IPV6
 #if defined(__GLIBC__) || defined(__linux__)
@@ -126,8 +127,20 @@ t_sockaddr *custom_res;  // -N option
 //   first one by net-module
 //   second by ipinfo-module
 dns_handler_fn dns_ptr_handler, dns_txt_handler;
+// and for 'ns_t_a'/'ns_t_aaaa' replies (ipinfo tcp-origins)
+dns_addr_fn dns_addr_handler;
 //
 
+enum { ADDRQ_MAX = 8 };           // max addresses taken from one reply
+static char addrq_name[NS_MAXDNAME]; // pending address query
+
+// query id is [hash:6 slot:10], the slot keeps hop and path the query is sent for
+enum { QID_SLOTS = 1024, QID_MASK = QID_SLOTS - 1 };
+static struct { uint16_t at, ndx; } qid_slot[QID_SLOTS];
+static uint qid_next;
+#define QID2AT(id)  (qid_slot[(id) & QID_MASK].at)
+#define QID2NDX(id) (qid_slot[(id) & QID_MASK].ndx)
+
 static bool dns_ready;
 static int resfd4 = -1;
 #ifdef ENABLE_IPV6
@@ -289,6 +302,18 @@ void ip2arpa(uint size, char buff[size], const t_ipaddr *ipaddr,
      suff4 ? suff4 : ARPA4_SUFFIX); }
 }
 
+static uint16_t new_qid(const char *str, int at, int ndx) NONNULL(1);
+static uint16_t new_qid(const char *str, int at, int ndx) {
+  uint16_t hash = 0;
+  uint8_t ch = 0;
+  while ((ch = *str++))
+    hash = ((hash << 5) + hash) ^ ch; // h * 33 ^ ch
+  uint slot = qid_next++ & QID_MASK;
+  qid_slot[slot].at = at;
+  qid_slot[slot].ndx = ndx;
+  return (hash & ~QID_MASK) | slot;
+}
+
 static int send2ns(int fd, uint ns_max,  const struct sockaddr *ns_list, socklen_t ns_addrlen,
   uint8_t *query, uint len, uint *qcnt) NONNULL(3, 5);
 static int send2ns(int fd, uint ns_max,  const struct sockaddr *ns_list, socklen_t ns_addrlen,
@@ -318,7 +343,7 @@ RESDEB_ON
 RESDEB_OFF
   }
   //
-  ns_put16(str2hint(qstr, at, ndx), ns_query_buff);
+  ns_put16(new_qid(qstr, at, ndx), ns_query_buff);
 RESDEB_ON
   LOGMSG("[%d:%d type=%s id=%u]: %s", at, ndx, p_type(type), ns_get16(ns_query_buff), qstr);
 RESDEB_OFF
@@ -332,10 +357,27 @@ RESDEB_OFF
   if (rc < 0)
       rc = send2ns(resfd6, nscount6, (struct sockaddr *)nsaddr6, sizeof(nsaddr6[0]), ns_query_buff, len, qcnt);
 #endif
+  if (rc >= 0)
+    TRACEPOINT(dns_query, ns_get16(ns_query_buff), at + 1, ndx, type, qstr);
   return rc;
 }
 #undef SENDTONS
 
+int dns_addr_query(const char *name, int family UNUSED) {
+  int type =
+#ifdef ENABLE_IPV6
+    (family == AF_INET6) ? ns_t_aaaa :
+#endif
+    ns_t_a;
+  if (snprinte(addrq_name, sizeof(addrq_name), "%s", name) <= 0)
+    return -1;
+  return dns_send_query(0, 0, addrq_name, type);
+}
+
+static inline bool addrq_match(const char *name) {
+  return addrq_name[0] && !strncasecmp(addrq_name, name, sizeof(addrq_name));
+}
+
 inline const char *dns_ptr_cache(uint at, uint ndx) {
   return addr_exist(&IP_AT_NDX(at, ndx)) ? RPTR_AT_NDX(at, ndx) : NULL;
 }
@@ -352,13 +394,13 @@ const char *dns_ptr_lookup(int at, int ndx) {
   if (!QPTR_AT_NDX(at, ndx)) {
     char query[NAMELEN] = {0};
     ip2arpa(sizeof(query), query, &IP_AT_NDX(at, ndx), NULL, NULL);
-    QPTR_AT_NDX(at, ndx) = strndup(query, sizeof(query));
+    QPTR_AT_NDX(at, ndx) = intern_str(query, sizeof(query));
     if (!QPTR_AT_NDX(at, ndx)) {
-      WARN("[%d:%d]: strndup()", at, ndx);
+      WARNX("[%d:%d]: intern_str()", at, ndx);
       return NULL;
   }}
 
-  time_t now = time(NULL);
+  time_t now = unixtime();
   if (((now - QPTR_TS_AT_NDX(at, ndx)) >= PAUSE_BETWEEN_QUERIES)
 #ifdef WITH_IPINFO
    && ((now - QTXT_TS_AT_NDX(at, ndx)) >= TXT_PTR_PAUSE)
@@ -370,8 +412,25 @@ const char *dns_ptr_lookup(int at, int ndx) {
   return NULL;
 }
 
+// look up names of all known addresses
+void backresolv_lookups(void) {
+  if (run_opts.dns) {
+    int max = net_max();
+    for (int at = net_min(); at < max; at++) {
+      if (addr_exist(&CURRENT_IP(at))) {
+        dns_ptr_lookup(at, host[at].current);
+        for (int ndx = 0; ndx < PATHS_AT(at); ndx++) // multipath
+          if (ndx != host[at].current) // not looked up yet
+            dns_ptr_lookup(at, ndx);
+      }
+    }
+  }
+}
+
 
 static atndx_t *get_qatn(const char* q, int at, int ndx) {
+  if ((at < 0) || (at >= MAXHOST) || (ndx >= PATHS_AT(at)))
+    return NULL;
   const char *query[] = { QPTR_AT_NDX(at, ndx)
 #ifdef WITH_IPINFO
    , QTXT_AT_NDX(at, ndx)
@@ -388,12 +447,12 @@ static atndx_t *get_qatn(const char* q, int at, int ndx) {
 }
 
 static atndx_t *find_query(const char* q, uint16_t hint) {
-  atndx_t *re = get_qatn(q, ID2AT(hint), ID2NDX(hint)); // correspond to [hash:7 at:6 ndx:3]
+  atndx_t *re = get_qatn(q, QID2AT(hint), QID2NDX(hint));
   if (re)
     return re;     // found by hint
   int max = net_max();
   for (int at = net_min(); at < max; at++)
-    for (int ndx = 0; ndx < MAXPATH; ndx++) {
+    for (int ndx = 0; ndx < PATHS_AT(at); ndx++) {
       re = get_qatn(q, at, ndx);
       if (re)
         return re; // found
@@ -424,6 +483,12 @@ RESDEB_OFF
 
 static void dns_got_nosuch_name(const char *query, uint16_t id) NONNULL(1);
 static void dns_got_nosuch_name(const char *query, uint16_t id) {
+  if (addrq_match(query)) {
+    addrq_name[0] = 0;
+    if (dns_addr_handler)
+      dns_addr_handler(af, 0, NULL, 0);
+    return;
+  }
   atndx_t *an = find_query_with_id(query, id);
   if (an) {
     char answer[NS_MAXDNAME] = {0};
@@ -532,6 +597,42 @@ static void dns_extract_answer(ns_msg *msg, int section) {
 #endif
 }
 
+// take A/AAAA records of pending address query (CNAMEs are passed over)
+static bool dns_extract_addrs(ns_msg *msg) NONNULL(1);
+static bool dns_extract_addrs(ns_msg *msg) {
+  ns_rr rr = {0};
+  if ((ns_parserr(msg, ns_s_qd, 0, &rr) < 0) || !addrq_match(ns_rr_name(rr)))
+    return false;
+  t_ipaddr addr[ADDRQ_MAX];
+  uint count = 0;
+  uint32_t ttl = UINT32_MAX;
+  int family = af;
+  int max = ns_msg_count(*msg, ns_s_an);
+  for (int i = 0; (i < max) && (count < ARRAY_LEN(addr)); i++) {
+    if (ns_parserr(msg, ns_s_an, i, &rr) < 0)
+      continue;
+    int type = ns_rr_type(rr);
+    size_t len = (type == ns_t_a) ? sizeof(struct in_addr) :
+#ifdef ENABLE_IPV6
+      (type == ns_t_aaaa) ? sizeof(struct in6_addr) :
+#endif
+      0;
+    if (!len || (ns_rr_rdlen(rr) != len))
+      continue;
+    dns_printrr(msg, &rr);
+    memset(&addr[count], 0, sizeof(addr[0]));
+    memcpy(&addr[count++], ns_rr_rdata(rr), len);
+    family = (type == ns_t_a) ? AF_INET : AF_INET6;
+    if (ns_rr_ttl(rr) < ttl)
+      ttl = ns_rr_ttl(rr);
+  }
+  LOGMSG("%s: got %u address%s, ttl=%u", addrq_name, count, (count == 1) ? "" : "es", count ? ttl : 0);
+  addrq_name[0] = 0;
+  if (dns_addr_handler)
+    dns_addr_handler(family, count, addr, count ? ttl : 0);
+  return true;
+}
+
 static bool dns_query_checkin(ns_msg *msg) NONNULL(1);
 static bool dns_query_checkin(ns_msg *msg) {
   bool fail = !ns_msg_count(*msg, ns_s_an);
@@ -548,7 +649,7 @@ static bool dns_query_checkin(ns_msg *msg) {
       if (fail)
         LOGMSG("Parsing query: %s", strerror(errno));
       else {
-        fail = !find_query_with_id(ns_rr_name(rr), ns_msg_id(*msg));
+        fail = !addrq_match(ns_rr_name(rr)) && !find_query_with_id(ns_rr_name(rr), ns_msg_id(*msg));
         if (fail)
           LOGMSG("Not our request: %s", ns_rr_name(rr));
         else
@@ -586,15 +687,17 @@ static void dns_parse_reply(const uint8_t *data, size_t len) {
     LOGMSG("Parse reply: %s", strerror(errno));
   else {
     LOGMSG("got %zu bytes, id=%u at=%u ndx=%u, counts(qd:%u an:%u ns:%u ar:%u)",
-      len, ns_msg_id(msg), ID2AT(ns_msg_id(msg)), ID2NDX(ns_msg_id(msg)),
+      len, ns_msg_id(msg), QID2AT(ns_msg_id(msg)), QID2NDX(ns_msg_id(msg)),
       ns_msg_count(msg, ns_s_qd),
       ns_msg_count(msg, ns_s_an),
       ns_msg_count(msg, ns_s_ns),
       ns_msg_count(msg, ns_s_ar));
+    TRACEPOINT(dns_reply, ns_msg_id(msg), QID2AT(ns_msg_id(msg)) + 1, QID2NDX(ns_msg_id(msg)),
+      ns_msg_getflag(msg, ns_f_rcode), len);
     if (dns_qd_okay(&msg)) {
       int rcode = ns_msg_getflag(msg, ns_f_rcode);
       if (rcode == ns_r_noerror) {
-        if (dns_query_checkin(&msg))
+        if (dns_query_checkin(&msg) && !dns_extract_addrs(&msg))
           dns_extract_answer(&msg, ns_s_an);
       } else {
         if (rcode != ns_r_nxdomain)
@@ -31,11 +31,15 @@ int dns_wait(int family);
 void dns_parse(int fd, int family);
 const char *dns_ptr_lookup(int at, int ndx);
 const char *dns_ptr_cache(uint at, uint ndx);
+void backresolv_lookups(void);
 int dns_send_query(int at, int ndx, const char *qstr, int type);
+int dns_addr_query(const char *name, int family) NONNULL(1);
 void ip2arpa(uint size, char buff[size], const t_ipaddr *ipaddr,
   const char *suff4, const char *suff6) NONNULL(2, 3);
 
 typedef void (*dns_handler_fn)(int at, int ndx, const char* answer, size_t alen);
 extern dns_handler_fn dns_ptr_handler, dns_txt_handler;
+typedef void (*dns_addr_fn)(int family, uint count, const t_ipaddr addr[], uint32_t ttl);
+extern dns_addr_fn dns_addr_handler;
 
 #endif
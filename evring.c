@@ -0,0 +1,111 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "evring.h"
+#include "aux.h"
+
+_Static_assert(sizeof(evring_hdr_t) == 64, "evring header");
+_Static_assert(sizeof(evring_rec_t) == 128, "evring record");
+_Static_assert(!(EVRING_NREC & (EVRING_NREC - 1)), "evring size");
+
+static evring_hdr_t *evr;
+static size_t evr_size;
+static char evr_path[NAMELEN]; // unlinked at close, mapped readers keep it
+
+bool evring_open(const char *name) {
+  char path[NAMELEN];
+  if (snprinte(path, sizeof(path), "%s%s", (name[0] == '/') ? "" : "/", name) < 0)
+    return false;
+  int fd = shm_open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    WARN("shm_open(%s)", path);
+    return false;
+  }
+  size_t size = sizeof(evring_hdr_t) + EVRING_NREC * sizeof(evring_rec_t);
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, size) < 0)
+    WARN("ftruncate(%s)", path);
+  else if ((map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    WARN("mmap(%s)", path);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  evr = map;
+  evr_size = size;
+  snprinte(evr_path, sizeof(evr_path), "%s", path);
+  evr->version = EVRING_VER;
+  evr->recsize = sizeof(evring_rec_t);
+  evr->nrec = EVRING_NREC;
+  evr->pid = getpid();
+  struct timespec mono, real;
+  if (!MONOTIME(&mono) && !mtr_clock.gettime(CLOCK_REALTIME, &real))
+    evr->mono2real = (real.tv_sec - mono.tv_sec) * (int64_t)NANO + (real.tv_nsec - mono.tv_nsec);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(evr->magic, EVRING_MAGIC, sizeof(evr->magic));
+  return true;
+}
+
+void evring_close(void) {
+  if (evr) {
+    munmap(evr, evr_size);
+    evr = NULL;
+  }
+  if (evr_path[0]) {
+    shm_unlink(evr_path);
+    evr_path[0] = 0;
+  }
+}
+
+// seqlock per record: odd sequence, fence, data, fence, even sequence, then head
+void evring_put(int family, int proto, const void *target, const void *addr, int ttl, int type,
+    const struct timespec *recv_at, int usec, const uint32_t *mpls, int nmpls) {
+  if (!evr)
+    return;
+  uint64_t n = evr->head; // the only writer
+  evring_rec_t *rec = EVRING_SLOT(evr, n);
+  __atomic_store_n(&rec->seq, 2 * n + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  size_t len = (family == AF_INET) ? sizeof(struct in_addr) : sizeof(rec->addr);
+  memset(rec->target, 0, sizeof(rec->target));
+  memset(rec->addr, 0, sizeof(rec->addr));
+  memcpy(rec->target, target, len);
+  memcpy(rec->addr, addr, len);
+  rec->mono = recv_at->tv_sec * (uint64_t)NANO + recv_at->tv_nsec;
+  rec->rtt = (usec > 0) ? usec : 0;
+  rec->family = family;
+  rec->proto = proto;
+  rec->ttl = ttl;
+  rec->type = type;
+  if (nmpls > (int)ARRAY_LEN(rec->mpls))
+    nmpls = ARRAY_LEN(rec->mpls);
+  rec->nmpls = (nmpls > 0) ? nmpls : 0;
+  for (int i = 0; i < rec->nmpls; i++)
+    rec->mpls[i] = mpls[i];
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&rec->seq, 2 * n + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&evr->head, n + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t evring_count(void) { return evr ? evr->head : 0; }
@@ -0,0 +1,94 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef EVRING_H
+#define EVRING_H
+
+// Probe events in shared memory (shm_open() object): a header followed by
+// a circle of fixed-size records, one writer (mtr) and any number of readers.
+// Record #n is in slot n % nrec, its 'seq' is odd while it's written and
+// 2n+2 when it's complete; 'head' is the number of records written so far.
+// mtr unlinks the object at exit, readers having it mapped keep it till munmap().
+// The layout doesn't depend on mtr's build, this header is for readers too.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define EVRING_MAGIC "MTREVR"
+#define EVRING_VER   1
+
+enum { EVRING_NREC = 4096 };                  // slots, power of 2
+enum { EVR_PONG, EVR_EXCEED, EVR_UNREACH, EVR_REPLY }; // reply types, the last is unclassified
+
+typedef struct evring_hdr {
+  char magic[6];       // set last, when the header is ready
+  uint16_t version;
+  uint32_t recsize, nrec;
+  uint32_t pid;        // writer
+  uint32_t pad0;
+  int64_t mono2real;   // add to 'mono' of records to get realtime [nsec]
+  uint64_t head;       // records written
+  uint8_t pad[24];
+} evring_hdr_t;        // 64 bytes, records follow it
+
+typedef struct evring_rec {
+  uint64_t seq;
+  uint64_t mono;       // reply time (CLOCK_MONOTONIC) [nsec]
+  uint8_t target[16];  // ipv4 addresses take the first 4 bytes
+  uint8_t addr[16];    // replied host
+  uint32_t mpls[8];    // label stack entries: label:20 exp:3 bos:1 ttl:8
+  uint32_t rtt;        // [usec]
+  uint8_t family, proto, ttl, type, nmpls;
+  uint8_t pad[39];
+} evring_rec_t;        // 128 bytes
+
+#define EVRING_SLOT(hdr, n) ((evring_rec_t *)((hdr) + 1) + ((n) & ((hdr)->nrec - 1)))
+
+// reader: copy record #'*next' and advance it, return false if there's nothing new;
+// records overwritten before they are read are skipped and added to 'lost'
+static inline bool evring_read(evring_hdr_t *hdr, uint64_t *next, evring_rec_t *rec, uint64_t *lost) {
+  uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+  for (; *next < head; (*next)++, (*lost)++) {
+    if ((head - *next) > hdr->nrec) {
+      *lost += head - *next - hdr->nrec;
+      *next = head - hdr->nrec;
+    }
+    const evring_rec_t *slot = EVRING_SLOT(hdr, *next);
+    uint64_t seq = 2 * *next + 2;
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+      continue;
+    memcpy(rec, slot, sizeof(*rec));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+      (*next)++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// writer
+bool evring_open(const char *name);
+void evring_close(void);
+void evring_put(int family, int proto, const void *target, const void *addr, int ttl, int type,
+  const struct timespec *recv_at, int usec, const uint32_t *mpls, int nmpls);
+uint64_t evring_count(void);
+
+#endif
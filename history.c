@@ -0,0 +1,453 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "history.h"
+#include "net.h"
+#include "polling.h"
+#include "aux.h"
+
+#define HIST_MAGIC "MTRHIST"
+#define HIST_VER   1
+#define HIST_IDX   ".idx"
+
+enum { HIST_KEY_MS = 10 * 60 * MIL }; // keyframe with sync of files, at least every 10min
+enum { HIST_PERIOD = 60 };            // default period, in seconds
+
+typedef struct hist_hop {
+  int sent;             // sent at the beginning of period
+  int recv, ndx;        // replies in period, address of the last one
+  int min, max, last;   // [usec]
+  long long sum, jsum;  // sum of rtt and jitter
+  int jn;               // jitter samples
+  bool has_last;
+  // recorded state since keyframe
+  bool known;
+  uint8_t addr[16];
+  uint32_t mpls[MAX_MPLS_LABEL];
+  int nmpls;
+  int64_t avg;
+} hist_hop_t;
+
+static FILE *hist, *hist_idx;
+static int hist_cycles;    // period in cycles, 0 for default
+static long hist_pending;  // cycles since last record
+static int64_t hist_ms, hist_key_ms;
+static hist_hop_t hh[MAXHOST];
+static bool hist_hooked;
+static void (*hist_reply_next)(int at, int ndx, int usec);
+static void (*hist_cycle_next)(long cycle);
+
+static int64_t hist_now(void) {
+  struct timespec now;
+  if (mtr_clock.gettime(CLOCK_REALTIME, &now) < 0)
+    return hist_ms;
+  return now.tv_sec * (int64_t)MIL + now.tv_nsec / (NANO / MIL);
+}
+
+static inline size_t addr_len(int family) {
+  return (family == AF_INET) ? sizeof(struct in_addr) : 16;
+}
+
+static inline void put_varint(uint64_t v) {
+  do {
+    uint8_t b = v & 0x7f;
+    v >>= 7;
+    putc(v ? (b | 0x80) : b, hist);
+  } while (v);
+}
+
+static inline void put_svarint(int64_t v) { put_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+
+static inline int64_t hist_units(long long usec) { return (usec + HIST_RTT_UNIT / 2) / HIST_RTT_UNIT; }
+
+static void hist_sync(void) {
+  if ((fflush(hist) == EOF) || (fflush(hist_idx) == EOF))
+    WARN("fflush");
+  if ((fdatasync(fileno(hist)) < 0) || (fdatasync(fileno(hist_idx)) < 0))
+    WARN("fdatasync");
+}
+
+// target restated: a point to start decoding from
+static void hist_keyframe(int64_t now) {
+  long off = ftell(hist);
+  if (off >= 0) {
+    int64_t entry[2] = {now, off};
+    for (int i = 0; i < 2; i++) {
+      uint8_t le[8];
+      for (int j = 0; j < 8; j++)
+        le[j] = (uint64_t)entry[i] >> (8 * j);
+      fwrite(le, 1, sizeof(le), hist_idx);
+    }
+  }
+  putc('T', hist);
+  put_varint(now);
+  putc(af, hist);
+  putc(mtrtype, hist);
+  fwrite(net_target(), 1, addr_len(af), hist);
+  put_varint((uint64_t)hist_cycles * run_opts.interval * MIL);
+  for (int at = 0; at < MAXHOST; at++)
+    hh[at].known = false, hh[at].avg = 0, hh[at].nmpls = 0;
+  hist_ms = hist_key_ms = now;
+  hist_sync();
+}
+
+static void hist_record(void) {
+  int64_t now = hist_now();
+  if ((now - hist_key_ms) >= HIST_KEY_MS)
+    hist_keyframe(now);
+  int max = net_max();
+  putc('P', hist);
+  put_varint((now > hist_ms) ? (now - hist_ms) : 0);
+  put_varint(max);
+  hist_ms = now;
+  for (int at = 0; at < max; at++) {
+    hist_hop_t *h = &hh[at];
+    int sent = host[at].sent - h->sent;
+    h->sent = host[at].sent;
+    uint8_t flags = 0;
+    uint32_t mpls[MAX_MPLS_LABEL];
+    int nmpls = 0;
+    const t_ipaddr *addr = NULL;
+    if (h->recv) {
+      flags |= HH_RTT;
+      addr = &IP_AT_NDX(at, h->ndx);
+      if (!h->known || memcmp(h->addr, addr, addr_len(af)))
+        flags |= HH_ADDR;
+#ifdef WITH_MPLS
+      const mpls_data_t *m = &MPLS_AT_NDX(at, h->ndx);
+      for (; (nmpls < m->n) && (nmpls < MAX_MPLS_LABEL); nmpls++) {
+        const mpls_label_t *l = &m->label[nmpls];
+        mpls[nmpls] = ((uint32_t)l->u.lab << 12) | (l->u.exp << 9) | (l->u.bos << 8) | l->u.ttl;
+      }
+#endif
+      if ((nmpls != h->nmpls) || memcmp(mpls, h->mpls, nmpls * sizeof(mpls[0])))
+        flags |= HH_MPLS;
+    }
+    putc(flags, hist);
+    put_varint((sent > 0) ? sent : 0);
+    put_varint(h->recv);
+    if (flags & HH_ADDR) {
+      memcpy(h->addr, addr, addr_len(af));
+      fwrite(h->addr, 1, addr_len(af), hist);
+      h->known = true;
+    }
+    if (flags & HH_MPLS) {
+      put_varint(nmpls);
+      for (int i = 0; i < nmpls; i++)
+        put_varint(mpls[i]);
+      memcpy(h->mpls, mpls, nmpls * sizeof(mpls[0]));
+      h->nmpls = nmpls;
+    }
+    if (flags & HH_RTT) {
+      int64_t avg = hist_units(h->sum / h->recv);
+      put_svarint(avg - h->avg);
+      int64_t min = hist_units(h->min), max = hist_units(h->max);
+      put_varint((avg > min) ? (avg - min) : 0);
+      put_varint((max > avg) ? (max - avg) : 0);
+      put_varint(h->jn ? hist_units(h->jsum / h->jn) : 0);
+      h->avg = avg;
+    }
+    h->recv = h->jn = 0;
+    h->sum = h->jsum = 0;
+  }
+  hist_pending = 0;
+  if (ferror(hist)) {
+    WARNX("write error");
+    clearerr(hist);
+  }
+}
+
+static void hist_reply(int at, int ndx, int usec) {
+  if ((at >= 0) && (at < MAXHOST) && (usec >= 0)) {
+    hist_hop_t *h = &hh[at];
+    if (!h->recv || (usec < h->min))
+      h->min = usec;
+    if (!h->recv || (usec > h->max))
+      h->max = usec;
+    if (h->has_last) {
+      h->jsum += abs(usec - h->last);
+      h->jn++;
+    }
+    h->last = usec;
+    h->has_last = true;
+    h->sum += usec;
+    h->recv++;
+    h->ndx = ndx;
+  }
+  if (hist_reply_next)
+    hist_reply_next(at, ndx, usec);
+}
+
+static void hist_cycle(long cycle) {
+  if (++hist_pending >= hist_cycles)
+    hist_record();
+  if (hist_cycle_next)
+    hist_cycle_next(cycle);
+}
+
+bool hist_open(const char *arg) {
+  char path[NAMELEN];
+  if (snprinte(path, sizeof(path), "%s", arg) < 0)
+    return false;
+  char *cycles = strrchr(path, ',');
+  if (cycles) {
+    *cycles++ = 0;
+    hist_cycles = str2l(cycles);
+    if (hist_cycles <= 0) {
+      WARNX("%s: %s", cycles, strerror(EINVAL));
+      return false;
+    }
+  }
+  hist_close();
+  hist = fopen(path, "ab");
+  if (!hist) {
+    WARN("fopen(%s)", path);
+    return false;
+  }
+  char idx[NAMELEN];
+  if ((snprinte(idx, sizeof(idx), "%s" HIST_IDX, path) < 0) || !(hist_idx = fopen(idx, "ab"))) {
+    WARN("fopen(%s%s)", path, HIST_IDX);
+    fclose(hist);
+    hist = NULL;
+    return false;
+  }
+  if (fseek(hist, 0, SEEK_END))
+    WARN("fseek(%s)", path);
+  if (!ftell(hist)) {
+    fputs(HIST_MAGIC, hist);
+    putc(HIST_VER, hist);
+  }
+  return true;
+}
+
+void hist_target(void) {
+  if (!hist)
+    return;
+  if (!hist_hooked) { // over display callbacks
+    hist_reply_next = net_reply_fn;
+    hist_cycle_next = poll_cycle_fn;
+    net_reply_fn  = hist_reply;
+    poll_cycle_fn = hist_cycle;
+    hist_hooked = true;
+  }
+  if (hist_cycles <= 0) {
+    hist_cycles = HIST_PERIOD / run_opts.interval;
+    if (hist_cycles < 1)
+      hist_cycles = 1;
+  }
+  memset(hh, 0, sizeof(hh));
+  hist_pending = 0;
+  hist_keyframe(hist_now());
+}
+
+void hist_flush(void) {
+  if (hist && hist_pending)
+    hist_record();
+}
+
+void hist_close(void) {
+  if (hist_hooked) {
+    net_reply_fn  = hist_reply_next;
+    poll_cycle_fn = hist_cycle_next;
+    hist_hooked = false;
+  }
+  if (hist) {
+    hist_flush();
+    hist_sync();
+    fclose(hist);
+    hist = NULL;
+  }
+  if (hist_idx) {
+    fclose(hist_idx);
+    hist_idx = NULL;
+  }
+}
+
+
+//// reader
+
+static bool get_varint(FILE *in, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc(in);
+    if (c == EOF)
+      return false;
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static inline bool get_svarint(FILE *in, int64_t *v) {
+  uint64_t u;
+  if (!get_varint(in, &u))
+    return false;
+  *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+  return true;
+}
+
+// offset of the last keyframe before 'from' [sec]
+static long hist_seek(const char *path, time_t from) {
+  char idx[NAMELEN];
+  if (snprinte(idx, sizeof(idx), "%s" HIST_IDX, path) < 0)
+    return 0;
+  FILE *in = fopen(idx, "rb");
+  if (!in)
+    return 0;
+  long off = 0;
+  uint8_t le[16];
+  while (fread(le, 1, sizeof(le), in) == sizeof(le)) {
+    int64_t entry[2] = {0};
+    for (int i = 0; i < 2; i++)
+      for (int j = 0; j < 8; j++)
+        entry[i] |= (int64_t)le[8 * i + j] << (8 * j);
+    if (entry[0] > from * (int64_t)MIL)
+      break;
+    off = entry[1];
+  }
+  fclose(in);
+  return off;
+}
+
+#define HIST_GET(fn, v) { if (!fn(in, (v))) goto trunc; }
+
+bool hist_dump(const char *arg) {
+  char path[NAMELEN];
+  if (snprinte(path, sizeof(path), "%s", arg) < 0)
+    return false;
+  time_t from = 0;
+  char *comma = strrchr(path, ',');
+  if (comma) {
+    *comma++ = 0;
+    from = str2l(comma);
+  }
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    WARN("fopen(%s)", path);
+    return false;
+  }
+  char magic[sizeof(HIST_MAGIC)] = {0};
+  if ((fread(magic, 1, sizeof(magic), in) != sizeof(magic)) ||
+      memcmp(magic, HIST_MAGIC, sizeof(magic) - 1) || (magic[sizeof(magic) - 1] != HIST_VER)) {
+    WARNX("%s: %s", path, strerror(EINVAL));
+    fclose(in);
+    return false;
+  }
+  long off = from ? hist_seek(path, from) : 0;
+  if (off && fseek(in, off, SEEK_SET))
+    WARN("fseek(%s)", path);
+  static hist_hop_t hops[MAXHOST];
+  int family = 0;
+  int64_t ms = 0;
+  bool keyed = false;
+  int c;
+  while ((c = getc(in)) != EOF) {
+    uint64_t u;
+    if (c == 'T') {
+      HIST_GET(get_varint, &u); ms = u;
+      int f = getc(in), proto = getc(in);
+      if ((f != AF_INET) && (f != AF_INET6))
+        goto trunc;
+      family = f;
+      uint8_t target[16];
+      if (fread(target, 1, addr_len(family), in) != addr_len(family))
+        goto trunc;
+      HIST_GET(get_varint, &u);
+      char str[INET6_ADDRSTRLEN], dt[64];
+      printf("target %s proto %d period %.1fs at %s\n", inet_ntop(family, target, str, sizeof(str)),
+        proto, u / (double)MIL, datetime_FT(ms / MIL, sizeof(dt), dt));
+      memset(hops, 0, sizeof(hops));
+      keyed = true;
+    } else if ((c == 'P') && keyed) {
+      uint64_t hopn;
+      HIST_GET(get_varint, &u); ms += u;
+      HIST_GET(get_varint, &hopn);
+      if (hopn > MAXHOST)
+        goto trunc;
+      bool show = (ms >= from * (int64_t)MIL);
+      char dt[64];
+      datetime_FT(ms / MIL, sizeof(dt), dt);
+      for (uint at = 0; at < hopn; at++) {
+        hist_hop_t *h = &hops[at];
+        int flags = getc(in);
+        uint64_t sent, recv;
+        if (flags == EOF)
+          goto trunc;
+        HIST_GET(get_varint, &sent);
+        HIST_GET(get_varint, &recv);
+        if (flags & HH_ADDR) {
+          if (fread(h->addr, 1, addr_len(family), in) != addr_len(family))
+            goto trunc;
+          h->known = true;
+        }
+        if (flags & HH_MPLS) {
+          HIST_GET(get_varint, &u);
+          if (u > MAX_MPLS_LABEL)
+            goto trunc;
+          h->nmpls = u;
+          for (int i = 0; i < h->nmpls; i++) {
+            HIST_GET(get_varint, &u);
+            h->mpls[i] = u;
+          }
+        }
+        char str[INET6_ADDRSTRLEN];
+        const char *addr = (recv && h->known) ? inet_ntop(family, h->addr, str, sizeof(str)) : UNKN_ITEM;
+        if (show)
+          printf("%s %2u. %-15s %3" PRIu64 " %3" PRIu64, dt, at + 1, addr, sent, recv);
+        if (flags & HH_RTT) {
+          int64_t d;
+          uint64_t dmin, dmax, jttr;
+          HIST_GET(get_svarint, &d);
+          HIST_GET(get_varint, &dmin);
+          HIST_GET(get_varint, &dmax);
+          HIST_GET(get_varint, &jttr);
+          h->avg += d;
+          const double k = HIST_RTT_UNIT / (double)MIL; // in msec
+          if (show)
+            printf(" %7.2f %7.2f %7.2f %7.2f", (h->avg - (int64_t)dmin) * k, h->avg * k,
+              (h->avg + (int64_t)dmax) * k, jttr * k);
+          for (int i = 0; show && (i < h->nmpls); i++)
+            printf(" [%u:%u:%u:%u]", h->mpls[i] >> 12, (h->mpls[i] >> 9) & 7,
+              (h->mpls[i] >> 8) & 1, h->mpls[i] & 0xff);
+        }
+        if (show)
+          putchar('\n');
+      }
+    } else {
+      WARNX("%s: unknown frame at %ld", path, ftell(in) - 1);
+      break;
+    }
+  }
+  fclose(in);
+  return true;
+trunc:
+  WARNX("%s: truncated at %ld", path, ftell(in));
+  fclose(in);
+  return true;
+}
+#undef HIST_GET
@@ -0,0 +1,47 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// Append-only history of per-hop measurements, a record every 'period' cycles.
+//
+// File: magic "MTRHIST" and version byte, then frames of a type byte and a body.
+// Numbers are LEB128 varints, signed ones are zigzag encoded, times are in msec
+// since the Epoch, RTTs are in HIST_RTT_UNIT usec.
+//  'T' target (keyframe, also restated every 10 min): time, family byte, proto byte,
+//      address (4 or 16 bytes), period [msec]
+//  'P' period: time delta, number of hops, then for each hop:
+//      flags byte, sent, received,
+//      HH_ADDR: address of the last reply, HH_MPLS: number of labels and labels,
+//      HH_RTT: avg delta (signed, from the previous avg at the hop), avg-min, max-avg, jitter
+// Delta state (time, addresses, labels, avg) is reset at keyframes.
+// Index 'FILE.idx': (time, offset) pairs of keyframes as two little-endian int64.
+
+#include <stdbool.h>
+
+enum { HIST_RTT_UNIT = 10 };                    // usec
+enum { HH_ADDR = 1, HH_MPLS = 2, HH_RTT = 4 };  // per hop flags
+
+bool hist_open(const char *arg);  // "FILE[,CYCLES]"
+void hist_target(void);           // start records of the current target
+void hist_flush(void);            // record pending data
+void hist_close(void);
+bool hist_dump(const char *arg);  // print history file as text
+
+#endif
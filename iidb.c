@@ -0,0 +1,212 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#if defined(LOG_IPINFO) && !defined(LOGMOD)
+  #define LOGMOD
+#endif
+#if !defined(LOG_IPINFO) && defined(LOGMOD)
+  #undef LOGMOD
+#endif
+
+#include "iidb.h"
+#include "iitrie.h"
+#include "common.h"
+
+// The table is mapped into memory as is, its ranges are split into prefixes
+// and put into a trie, whose nodes keep offsets of table lines.
+// Fields are parsed out only on match.
+
+static char *iimap;
+static size_t iimap_size;
+static iitrie_t iitrie;
+
+static inline void key_setbit(uint8_t *key, uint n) {
+  key[n >> 3] |= 0x80 >> (n & 7);
+}
+
+static inline int key_bit(const uint8_t *key, uint n) {
+  return (key[n >> 3] >> (7 - (n & 7))) & 1;
+}
+
+// split [start, end] range into the largest aligned prefixes
+static bool insert_range(int family, uint8_t *start, const uint8_t *end, uint32_t line) {
+  uint bits = (family == AF_INET6) ? 128 : 32;
+  uint bytes = bits / 8;
+  while (memcmp(start, end, bytes) <= 0) {
+    uint8_t last[IITRIE_KEYLEN];
+    memcpy(last, start, bytes);
+    uint host = 0;
+    for (; host < bits; host++) {
+      uint n = bits - 1 - host;
+      if (key_bit(start, n))
+        break; // not aligned
+      key_setbit(last, n);
+      if (memcmp(last, end, bytes) > 0)
+        break; // too big
+    }
+    if (!iitrie_add(&iitrie, family, start, bits - host, line))
+      return false;
+    for (uint i = 0; i < host; i++) // next one starts right after
+      key_setbit(start, bits - 1 - i);
+    int i = bytes - 1;
+    for (; i >= 0; i--)
+      if (++start[i])
+        break;
+    if (i < 0) // end of address space
+      break;
+  }
+  return true;
+}
+
+static bool load_line(uint32_t off, const char *line, size_t len) {
+  if (!len || (*line == '#'))
+    return true;
+  char buff[IIDB_LINE_MAX];
+  if (len >= sizeof(buff))
+    len = sizeof(buff) - 1;
+  memcpy(buff, line, len);
+  buff[len] = 0;
+  char *field[3] = {buff};
+  for (int i = 1; i < 3; i++) {
+    field[i] = strchr(field[i - 1], '\t');
+    if (!field[i])
+      return true; // not a range, skip it
+    *field[i]++ = 0;
+  }
+  if ((field[2][0] == '0') && ((field[2][1] == '\t') || !field[2][1]))
+    return true; // not routed
+  uint8_t start[IITRIE_KEYLEN], end[IITRIE_KEYLEN];
+  if ((inet_pton(AF_INET, field[0], start) > 0) && (inet_pton(AF_INET, field[1], end) > 0))
+    return insert_range(AF_INET, start, end, off);
+  if ((inet_pton(AF_INET6, field[0], start) > 0) && (inet_pton(AF_INET6, field[1], end) > 0))
+    return insert_range(AF_INET6, start, end, off);
+  return true;
+}
+
+bool iidb_open(const char *path) {
+  if (iimap)
+    return true;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    WARN("open(%s)", path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    WARN("fstat(%s)", path);
+    close(fd);
+    return false;
+  }
+  if ((st.st_size <= 0) || ((uintmax_t)st.st_size >= IITRIE_NONE)) {
+    errno = EFBIG;
+    WARN("%s: %lld bytes", path, (long long)st.st_size);
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    WARN("mmap(%s)", path);
+    return false;
+  }
+  iimap = map;
+  iimap_size = st.st_size;
+  //
+  bool ok = iitrie_init(&iitrie, iimap_size / 32 /* about 2 nodes per line */);
+  for (size_t off = 0; ok && (off < iimap_size);) {
+    const char *line = iimap + off;
+    const char *eol = memchr(line, '\n', iimap_size - off);
+    size_t len = eol ? (size_t)(eol - line) : (iimap_size - off);
+    ok = load_line(off, line, len);
+    off += len + 1;
+  }
+  if (!ok) {
+    iidb_close();
+    return false;
+  }
+  LOGMSG("%s: %zu bytes, %u nodes", path, iimap_size, iitrie.count);
+  return true;
+}
+
+void iidb_close(void) {
+  iitrie_free(&iitrie);
+  if (iimap) {
+    munmap(iimap, iimap_size);
+    iimap = NULL;
+  }
+  iimap_size = 0;
+}
+
+int iidb_lookup(int family, const void *addr, unsigned len, char* record[len], size_t size, char buff[size]) {
+  if (!iimap || (len < 4))
+    return 0;
+  uint bits = (family == AF_INET6) ? 128 : 32;
+  uint plen = 0;
+  uint32_t off = iitrie_match(&iitrie, family, addr, &plen);
+  if (off == IITRIE_NONE)
+    return 0;
+  // route: matched prefix
+  uint8_t key[IITRIE_KEYLEN] = {0};
+  memcpy(key, addr, bits / 8);
+  for (uint i = plen; i < bits; i++)
+    key[i >> 3] &= (uint8_t)~(0x80 >> (i & 7));
+  char ip[INET6_ADDRSTRLEN] = {0};
+  if (!inet_ntop(family, key, ip, sizeof(ip)))
+    return 0;
+  int rlen = snprintf(buff, size, "%s/%u", ip, plen);
+  if ((rlen < 0) || ((size_t)rlen + 1 >= size))
+    return 0;
+  // the rest of fields: as is from the table
+  char *line = buff + rlen + 1;
+  size_t room = size - rlen - 1;
+  const char *src = iimap + off;
+  const char *eol = memchr(src, '\n', iimap_size - off);
+  size_t llen = eol ? (size_t)(eol - src) : (iimap_size - off);
+  if (llen >= room)
+    llen = room - 1;
+  memcpy(line, src, llen);
+  line[llen] = 0;
+  char *field[5] = {line};
+  int count = 1;
+  for (; count < 5; count++) {
+    field[count] = strchr(field[count - 1], '\t');
+    if (!field[count])
+      break;
+    *field[count]++ = 0;
+  }
+  if (count < 3)
+    return 0;
+  memset(record, 0, len * sizeof(record[0]));
+  record[0] = field[2]; // ASN
+  record[1] = buff;     // Route
+  record[2] = (count > 3) ? field[3] : NULL; // CC
+  record[3] = (count > 4) ? field[4] : NULL; // AS-Name
+  return count - 1;
+}
@@ -0,0 +1,40 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef IIDB_H
+#define IIDB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Local prefix-to-ASN table in ip2asn TSV format:
+//   range_start  range_end  AS_number  country_code  AS_description
+
+#ifndef IP2ASN_FILE
+#define IP2ASN_FILE "/usr/share/ip2asn/ip2asn-combined.tsv"
+#endif
+#define IP2ASN_ENV "MTR_IP2ASN"  // environment variable to override the path
+
+enum { IIDB_LINE_MAX = 512 };
+
+bool iidb_open(const char *path);
+void iidb_close(void);
+// longest prefix match: ASN, Route, CC, AS-Name are put into 'buff', returns number of fields
+int iidb_lookup(int family, const void *addr, unsigned len, char* record[len], size_t size, char buff[size]);
+
+#endif
@@ -0,0 +1,145 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "iistream.h"
+
+enum { ST_STATUS, ST_HEADER, ST_BODY, ST_DONE };
+
+#define HTTP_PREFIX "HTTP/1."
+#define CONTENT_LENGTH "Content-Length:"
+
+void iis_init(iistream_t *st, int type) {
+  st->type   = type;
+  st->state  = (type == IIS_HTTP) ? ST_STATUS : ST_BODY;
+  st->status = 0;
+  st->clen   = -1;
+  st->len = st->pos = st->body = st->blen = 0;
+  st->saved  = 0;
+  st->buf[0] = 0;
+}
+
+char* iis_room(iistream_t *st, size_t *size) {
+  *size = (st->state == ST_DONE) ? 0 : (sizeof(st->buf) - 1 - st->len);
+  return st->buf + st->len;
+}
+
+static int iis_done(iistream_t *st, size_t body, size_t blen) {
+  st->body  = body;
+  st->blen  = blen;
+  st->saved = st->buf[body + blen];
+  st->buf[body + blen] = 0;
+  st->state = ST_DONE;
+  return IIS_DONE;
+}
+
+// next line in [pos, len), return its length without CR/LF, or -1 if it's not complete yet
+static long iis_line(iistream_t *st, size_t *start) {
+  const char *line = st->buf + st->pos;
+  const char *nl = memchr(line, '\n', st->len - st->pos);
+  if (!nl)
+    return -1;
+  *start = st->pos;
+  st->pos = nl - st->buf + 1;
+  size_t llen = nl - line;
+  if (llen && (line[llen - 1] == '\r'))
+    llen--;
+  return llen;
+}
+
+static int iis_http_line(iistream_t *st, const char *line, size_t llen) {
+  if (st->state == ST_STATUS) { // "HTTP/1.x NNN ..."
+    const size_t plen = sizeof(HTTP_PREFIX) - 1;
+    if ((llen < plen + 5) || strncmp(line, HTTP_PREFIX, plen))
+      return IIS_FAIL;
+    st->status = atoi(line + plen + 2);
+    st->state = ST_HEADER;
+  } else if (!llen) {           // end of header
+    st->state = ST_BODY;
+    st->body = st->pos;
+  } else {
+    const size_t tlen = sizeof(CONTENT_LENGTH) - 1;
+    if ((llen > tlen) && !strncasecmp(line, CONTENT_LENGTH, tlen)) {
+      char *end = NULL;
+      errno = 0;
+      long n = strtol(line + tlen, &end, 10);
+      if (errno || (end == line + tlen) || (n < 0) || (n > IIS_BUFSIZE))
+        return IIS_FAIL;
+      st->clen = n;
+    }
+  }
+  return IIS_MORE;
+}
+
+// account 'n' new bytes put in 'room', and parse them
+int iis_feed(iistream_t *st, size_t n) {
+  if (st->state == ST_DONE)
+    return IIS_DONE;
+  st->len += n;
+  st->buf[st->len] = 0;
+  while (st->state != ST_BODY) { // http: status and header
+    size_t start = 0;
+    long llen = iis_line(st, &start);
+    if (llen < 0)
+      break;
+    if (iis_http_line(st, st->buf + start, llen) < 0)
+      return IIS_FAIL;
+  }
+  if (st->state == ST_BODY) switch (st->type) {
+    case IIS_HTTP:
+      if ((st->clen >= 0) && (st->len - st->body >= (size_t)st->clen))
+        return iis_done(st, st->body, st->clen);
+      break;
+    case IIS_LINES: {
+      size_t start = 0;
+      long llen = iis_line(st, &start);
+      if (llen >= 0)
+        return iis_done(st, start, llen);
+    } break;
+    default: break;
+  }
+  return (st->len < sizeof(st->buf) - 1) ? IIS_MORE : IIS_FAIL; // fail if there's no room
+}
+
+// end of connection: the rest is taken as is
+int iis_fin(iistream_t *st) {
+  if (st->state == ST_DONE)
+    return IIS_DONE;
+  if ((st->state != ST_BODY) || (st->len <= st->body))
+    return IIS_FAIL;
+  if ((st->type == IIS_HTTP) && (st->clen >= 0)) // truncated
+    return IIS_FAIL;
+  return iis_done(st, st->body, st->len - st->body);
+}
+
+// drop done data, keep the rest of buffer for next response or line
+void iis_next(iistream_t *st) {
+  if (st->state != ST_DONE)
+    return;
+  st->buf[st->body + st->blen] = st->saved;
+  size_t used = (st->type == IIS_LINES) ? st->pos : (st->body + st->blen);
+  size_t rest = st->len - used;
+  iis_init(st, st->type);
+  memmove(st->buf, st->buf + used, rest);
+  st->len = rest;
+  st->buf[rest] = 0;
+}
@@ -0,0 +1,51 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef IISTREAM_H
+#define IISTREAM_H
+
+#include <stddef.h>
+
+// Incremental parser of tcp ipinfo responses, data is tokenized in place:
+//   http:  status line, header, body framed by Content-Length (or end of connection)
+//   whois: everything till end of connection
+//   lines: every line separately (bulk whois)
+
+enum { IIS_HTTP, IIS_WHOIS, IIS_LINES };
+enum { IIS_FAIL = -1, IIS_MORE = 0, IIS_DONE = 1 };
+enum { IIS_BUFSIZE = 8192 };
+
+typedef struct {
+  int type, state;
+  int status;         // http status code
+  long clen;          // http content length, -1 if unknown
+  size_t len;         // bytes in buffer
+  size_t pos;         // parsed up to
+  size_t body, blen;  // done data: offset and length
+  char saved;         // char replaced by NUL at the end of done data
+  char buf[IIS_BUFSIZE + 1];
+} iistream_t;
+
+void iis_init(iistream_t *st, int type);
+char* iis_room(iistream_t *st, size_t *size);
+int iis_feed(iistream_t *st, size_t n);
+int iis_fin(iistream_t *st);
+void iis_next(iistream_t *st);
+#define IIS_DATA(st) ((st)->buf + (st)->body)
+
+#endif
@@ -0,0 +1,154 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "iitrie.h"
+#include "common.h"
+
+enum { ROOT4, ROOT6 };
+#define ROOT(family) (((family) == AF_INET6) ? ROOT6 : ROOT4)
+#define BITS(family) (((family) == AF_INET6) ? 128 : 32)
+
+static inline int key_bit(const uint8_t *key, uint n) {
+  return (key[n >> 3] >> (7 - (n & 7))) & 1;
+}
+
+static uint common_bits(const uint8_t *a, const uint8_t *b, uint lim) {
+  uint n = 0;
+  for (uint i = 0; n < lim; i++) {
+    uint8_t x = a[i] ^ b[i];
+    if (!x) {
+      n += 8;
+      continue;
+    }
+    for (; !(x & 0x80); x <<= 1)
+      n++;
+    break;
+  }
+  return (n < lim) ? n : lim;
+}
+
+static uint32_t new_node(iitrie_t *trie, const uint8_t *key, uint plen, uint32_t val) {
+  if (trie->count >= trie->max) {
+    uint32_t max = trie->max ? (trie->max * 2) : 16;
+    iinode_t *nodes = realloc(trie->node, max * sizeof(iinode_t));
+    if (!nodes) {
+      WARN("realloc(%zu)", max * sizeof(iinode_t));
+      return 0;
+    }
+    trie->node = nodes;
+    trie->max = max;
+  }
+  iinode_t *node = &trie->node[trie->count];
+  memset(node, 0, sizeof(*node));
+  node->val  = val;
+  node->plen = plen;
+  uint bytes = (plen + 7) / 8;
+  memcpy(node->key, key, bytes);
+  if (plen & 7)
+    node->key[bytes - 1] &= (uint8_t)(0xff << (8 - (plen & 7)));
+  return trie->count++;
+}
+
+bool iitrie_init(iitrie_t *trie, uint32_t hint) {
+  memset(trie, 0, sizeof(*trie));
+  if (hint) {
+    trie->node = malloc(hint * sizeof(iinode_t));
+    if (trie->node)
+      trie->max = hint;
+  }
+  static const uint8_t any[IITRIE_KEYLEN];
+  if ((new_node(trie, any, 0, IITRIE_NONE) == ROOT4) && (new_node(trie, any, 0, IITRIE_NONE) == ROOT6))
+    return true;
+  iitrie_free(trie);
+  return false;
+}
+
+void iitrie_free(iitrie_t *trie) {
+  if (trie->node)
+    free(trie->node);
+  memset(trie, 0, sizeof(*trie));
+}
+
+bool iitrie_add(iitrie_t *trie, int family, const void *key, unsigned plen, uint32_t val) {
+  if (!trie->node || (plen > BITS(family))) {
+    errno = EINVAL;
+    return false;
+  }
+  for (uint32_t cur = ROOT(family);;) {
+    if (trie->node[cur].plen == plen) {
+      if (trie->node[cur].val == IITRIE_NONE)
+        trie->node[cur].val = val;
+      return true;
+    }
+    int bit = key_bit(key, trie->node[cur].plen);
+    uint32_t next = trie->node[cur].child[bit];
+    if (!next) {
+      uint32_t leaf = new_node(trie, key, plen, val);
+      if (leaf)
+        trie->node[cur].child[bit] = leaf;
+      return leaf != 0;
+    }
+    uint nlen = trie->node[next].plen;
+    uint common = common_bits(key, trie->node[next].key, (plen < nlen) ? plen : nlen);
+    if (common == nlen) {
+      cur = next;
+      continue;
+    }
+    // fork: either the new prefix itself or a glue node with common part
+    uint32_t fork = new_node(trie, key, common, (common == plen) ? val : IITRIE_NONE);
+    if (!fork)
+      return false;
+    if (common < plen) {
+      uint32_t leaf = new_node(trie, key, plen, val);
+      if (!leaf)
+        return false;
+      trie->node[fork].child[key_bit(key, common)] = leaf;
+    }
+    trie->node[fork].child[key_bit(trie->node[next].key, common)] = next;
+    trie->node[cur].child[bit] = fork;
+    return true;
+  }
+}
+
+uint32_t iitrie_match(const iitrie_t *trie, int family, const void *key, unsigned *plen) {
+  if (!trie->node)
+    return IITRIE_NONE;
+  uint bits = BITS(family), len = 0;
+  uint32_t cur = ROOT(family), found = trie->node[cur].val;
+  while (trie->node[cur].plen < bits) {
+    uint32_t next = trie->node[cur].child[key_bit(key, trie->node[cur].plen)];
+    if (!next)
+      break;
+    const iinode_t *node = &trie->node[next];
+    if (common_bits(key, node->key, node->plen) < node->plen)
+      break;
+    if (node->val != IITRIE_NONE) {
+      found = node->val;
+      len = node->plen;
+    }
+    cur = next;
+  }
+  if (plen)
+    *plen = len;
+  return found;
+}
@@ -0,0 +1,49 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef IITRIE_H
+#define IITRIE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Path-compressed binary trie of IPv4/IPv6 prefixes for longest-prefix match
+
+enum { IITRIE_KEYLEN = 16 };
+#define IITRIE_NONE UINT32_MAX
+
+typedef struct {
+  uint32_t child[2]; // 0 is no child (roots are never children)
+  uint32_t val;      // user value, or IITRIE_NONE
+  uint8_t  plen;
+  uint8_t  key[IITRIE_KEYLEN];
+} iinode_t;
+
+typedef struct {
+  iinode_t *node;
+  uint32_t count, max;
+} iitrie_t;
+
+bool iitrie_init(iitrie_t *trie, uint32_t hint);
+void iitrie_free(iitrie_t *trie);
+// the first value is kept for the same prefix
+bool iitrie_add(iitrie_t *trie, int family, const void *key, unsigned plen, uint32_t val);
+// value of the longest matching prefix, or IITRIE_NONE
+uint32_t iitrie_match(const iitrie_t *trie, int family, const void *key, unsigned *plen);
+
+#endif
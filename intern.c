@@ -0,0 +1,131 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "intern.h"
+#include "common.h"
+
+enum { CHUNK_SIZE = 64 * 1024, TABLE_INIT = 1024 };
+
+typedef struct chunk {
+  struct chunk *next;
+  size_t size, used;
+  char data[];
+} chunk_t;
+
+// global
+size_t intern_count[2];
+size_t intern_bytes;
+//
+
+static chunk_t *chunks;
+static const char **table; // open addressing with linear probing
+static size_t table_size;
+
+static uint32_t str_hash(const char *str, size_t len) { // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static char* arena_alloc(size_t size) {
+  if (!chunks || ((chunks->size - chunks->used) < size)) {
+    size_t csize = (size > CHUNK_SIZE) ? size : CHUNK_SIZE;
+    chunk_t *chunk = malloc(sizeof(chunk_t) + csize);
+    if (!chunk) {
+      WARN("malloc(%zu)", sizeof(chunk_t) + csize);
+      return NULL;
+    }
+    chunk->size = csize;
+    chunk->used = 0;
+    if (chunks && (csize > CHUNK_SIZE)) { // keep the current chunk for small ones
+      chunk->next = chunks->next;
+      chunks->next = chunk;
+    } else {
+      chunk->next = chunks;
+      chunks = chunk;
+    }
+    intern_bytes += csize;
+    chunk->used = size;
+    return chunk->data;
+  }
+  char *ptr = chunks->data + chunks->used;
+  chunks->used += size;
+  return ptr;
+}
+
+static bool table_grow(void) {
+  size_t size = table_size ? (table_size * 2) : TABLE_INIT;
+  const char **grown = calloc(size, sizeof(grown[0]));
+  if (!grown) {
+    WARN("calloc(%zu)", size * sizeof(grown[0]));
+    return false;
+  }
+  for (size_t i = 0; i < table_size; i++) {
+    const char *str = table[i];
+    if (str) {
+      size_t n = str_hash(str, strlen(str)) & (size - 1);
+      while (grown[n])
+        n = (n + 1) & (size - 1);
+      grown[n] = str;
+    }
+  }
+  free(table);
+  table = grown;
+  table_size = size;
+  return true;
+}
+
+const char* intern_str(const char *str, size_t maxlen) {
+  if (!str)
+    return NULL;
+  if (((intern_count[0] + 1) * 2 > table_size) && !table_grow())
+    return NULL;
+  /*summ*/ intern_count[1]++;
+  size_t len = strnlen(str, maxlen);
+  size_t n = str_hash(str, len) & (table_size - 1);
+  for (; table[n]; n = (n + 1) & (table_size - 1))
+    if (!strncmp(table[n], str, len) && !table[n][len])
+      return table[n];
+  char *copy = arena_alloc(len + 1);
+  if (!copy)
+    return NULL;
+  memcpy(copy, str, len);
+  copy[len] = 0;
+  table[n] = copy;
+  intern_count[0]++;
+  return copy;
+}
+
+void intern_reset(void) {
+  while (chunks) {
+    chunk_t *next = chunks->next;
+    free(chunks);
+    chunks = next;
+  }
+  free(table);
+  table = NULL;
+  table_size = 0;
+  intern_count[0] = intern_bytes = 0;
+}
@@ -0,0 +1,33 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Interned strings: every distinct string is kept once in the arena,
+// they live till intern_reset() that frees them all at once
+
+const char* intern_str(const char *str, size_t maxlen);
+void intern_reset(void);
+
+extern size_t intern_count[2]; // number of strings (distinct, requested)
+extern size_t intern_bytes;    // arena size
+
+#endif
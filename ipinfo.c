@@ -17,6 +17,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <errno.h>
@@ -40,6 +41,10 @@
 #endif
 
 #include "ipinfo.h"
+#include "iistream.h"
+#include "iidb.h"
+#include "iitrie.h"
+#include "intern.h"
 #include "polling.h"
 #include "net.h"
 #ifdef ENABLE_DNS
@@ -56,25 +61,72 @@ enum { TCP_RESP_LINES = 100, NETDATA_MAXSIZE = 3000 };
 enum { WHOIS_LAST_NDX = 2 };
 #define HTTP_GET "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: %s\r\nAccept: */*\r\n\r\n"
 
-typedef struct { int sock, state, slot; } ipitseq_t;
+typedef struct { int sock, state, slot; iistream_t *st; } ipitseq_t;
 enum { TSEQ_CREATED, TSEQ_READY };  // tcp-socket state: created or ready, otherwise -1
 
+// persistent http connections with pipelined requests
+enum { HTTP_CONN_MAX = 2, HTTP_PIPELINE_MAX = 4, HTTP_KEEPALIVE = 15 /* in seconds */ };
+enum { IPITSEQ_MAX = MAXHOST * MAXPATH }; // http connections are numbered beyond that
+// bulk whois session: addresses are collected for a while, then sent at once
+enum { WHOIS_BULK_MAX = 32, WHOIS_BULK_WINDOW = 1 /* in seconds */ };
+enum { BULK_CONN_SEQ = IPITSEQ_MAX + HTTP_CONN_MAX };
+#define WHOIS_BULK_BEGIN "begin\nverbose\n"
+#define WHOIS_BULK_END   "end\n"
+typedef struct {
+  int sock, state, slot;
+  int seq[WHOIS_BULK_MAX];    // collected addresses, then sent ones
+  int count;
+  time_t first, ts;           // time of the first collected address, last activity
+  iistream_t st;
+} bulkconn_t;
+
+typedef struct {
+  int sock, state, slot;
+  int seq[HTTP_PIPELINE_MAX]; // requests in order of sending
+  int queued, sent;
+  time_t ts;                  // last activity
+  iistream_t st;
+} httpconn_t;
+
 // global
 bool ipinfo_tcpmode;     // true if ipinfo origin is tcp (http or whois)
 uint ipinfo_queries[3];  // number of queries (sum, http, whois)
 uint ipinfo_replies[3];  // number of replies (sum, http, whois)
+uint ipinfo_shared[2];   // records shared by prefix (hits, prefixes)
 bool ipinfo_rewidth;     // indicator to redraw titles
 bool ipinfo_ready;
 //
 
 static int origin_no;     // set once at init
 static int itemname_max;  // set once at init
+static int route_no;      // number of route field, or -1 (set once at init)
 
 static int ipinfo_syn_timeout = 3;     // in seconds
 static ipitseq_t *ipitseq;             // for tcp-origins
 
-// origin types: dns txt, http csv, whois pairs
-enum { OT_DNS = 0 /*sure*/, OT_HTTP, OT_WHOIS };
+// resolved addresses of tcp-origin
+enum { ORIGADDR_MAX = 8, ORIGADDR_MINTTL = 60, ORIGADDR_RETRY = 3 /* in seconds */ };
+typedef struct {
+  t_ipaddr addr[ORIGADDR_MAX];
+  uint count, next;
+  int family;
+  bool fixed;           // numeric host, no need to resolve
+  time_t expire, asked;
+} origaddr_t;
+static origaddr_t origaddr;
+
+// records shared by route: addresses within known prefix get them without querying
+typedef struct { char* rec[II_REC_ARR_LEN]; } shared_t;
+static iitrie_t shared_trie;
+static shared_t *shared;
+static uint32_t shared_count, shared_max;
+
+static httpconn_t httpconn[HTTP_CONN_MAX];
+static bulkconn_t bulkconn;
+static bool tcpconn_ready;
+
+// origin types: dns txt, http csv, whois pairs, local table
+enum { OT_DNS = 0 /*sure*/, OT_HTTP, OT_WHOIS, OT_FILE };
 enum { WHOIS_PORT = 43, HTTP_PORT = 80 };
 
 #define SETFIELDS false
@@ -89,16 +141,18 @@ typedef struct {
   const char* uname[II_REC_ARR_LEN];
   const char* skip_str[II_REC_ARR_LEN]; // skip by string: "query ip", ...
   int   asnth; // ASN-field-number in ipinfo field-list
-  int   type; // 0 - dns, 1 - http, 2 - whois
+  int   type; // 0 - dns, 1 - http, 2 - whois, 3 - file
   int   skip_ndx[II_REC_ARR_LEN]; // skip by index: 1, ...
   int   width[II_REC_ARR_LEN];
   char  sep;
   char  comb_last_fields;
+  bool  bulk; // whois: "begin/end" bulk mode, address is the 2nd field
 } origin_t;
 
 #define ORIG_TYPE (origins[origin_no].type)
 #define ORIG_HOST (origins[origin_no].host)
 #define ORIG_UNKN (origins[origin_no].unkn)
+#define ORIG_BULK (origins[origin_no].bulk)
 #define ORIG_SKIP_NDX   (origins[origin_no].skip_ndx)
 #define ORIG_SKIP_STR   (origins[origin_no].skip_str)
 #define ORIG_NAME(num)  (origins[origin_no].name[num])
@@ -174,6 +228,34 @@ static origin_t origins[] = {
     .sep   = VSLASH,
     .comb_last_fields = '/', /* route / prefix */
   },
+// 7
+  { .host  =
+#ifdef ENABLE_DNS
+      "whois.cymru.com",
+#else
+      NULL,
+#endif
+    .host6 =
+#ifdef ENABLE_DNS
+      "whois.cymru.com",
+#else
+      NULL,
+#endif
+    .name     = {_II_ASN_STR, /*IP,*/ _II_ROUTE_STR, _II_CC_STR, _II_REG_STR, _II_ALLOC_STR, _II_ASNAME_STR},
+    .asnth    = 0,
+    .unkn     = "NA",
+    .sep      = VSLASH,
+    .type     = OT_WHOIS,
+    .skip_ndx = {2},
+    .bulk     = true,
+  },
+// 8
+  { .host  = IP2ASN_FILE, .host6 = IP2ASN_FILE,
+    .name  = {_II_ASN_STR, _II_ROUTE_STR, _II_CC_STR, _II_ASNAME_STR},
+    .asnth = 0,
+    .unkn  = "None",
+    .type  = OT_FILE,
+  },
 };
 
 //
@@ -242,23 +324,29 @@ static void readjust_nth_width(uint nth, int width) {
   }
 }
 
-static void adjust_width(uint len, ii_record_view_t record[len]) NONNULL(2);
-static void adjust_width(uint len, ii_record_view_t record[len]) {
-  for (uint i = 0; (i < len) && record[i].view; i++)
+static void adjust_width(uint len, const ii_record_view_t *record) {
+  if (record)
+    for (uint i = 0; (i < len) && record[i].view; i++)
     readjust_nth_width(i, ustrnlen(record[i].view, NAMELEN));
 }
 
-static bool set_newrec(int at, int ndx, int j, char *dup, int sndx) {
-  if (dup) {
-    char **p = (sndx < 0) ? &II_VIEW_AT(at, ndx, j) : &II_SRC_AT(at, ndx, j, sndx);
-    if (*p)
-      free(*p);
-    *p = dup;
+// set interned string
+static bool set_newrec(int at, int ndx, int j, const char *str, int sndx) {
+  if (str) {
+    if (!II_REC_ARR(at, ndx)) { // table of records is allocated only for addresses with data
+      II_REC_ARR(at, ndx) = calloc(II_REC_ARR_LEN, sizeof(ii_record_view_t));
+      if (!II_REC_ARR(at, ndx)) {
+        WARN("[%d:%d] calloc()", at, ndx);
+        return false;
+      }
+    }
+    const char **p = (sndx < 0) ? &II_REC_ARR(at, ndx)[j].view : &II_REC_ARR(at, ndx)[j].src[sndx];
+    *p = str;
   } else if (sndx < 0)
-    WARN("no dup[%d:%d:%d]", at, ndx, j);
+    WARNX("no str[%d:%d:%d]", at, ndx, j);
   else
-    WARN("no dup[%d:%d:%d:%d]", at, ndx, j, sndx);
-  return dup != NULL;
+    WARNX("no str[%d:%d:%d:%d]", at, ndx, j, sndx);
+  return str != NULL;
 }
 
 static inline int snprint_addmulti(uint len, char buff[len],
@@ -281,7 +369,7 @@ static void save_fields(int at, int ndx, uint rlen, char* record[rlen], bool add
       char *str = trim(record[i]);
       if (str && str[0] && !str_in_skip_list(str, ORIG_SKIPSTR_LEN, ORIG_SKIP_STR)) {
         char buff[NAMELEN] = {0};
-        char *pview = buff, *view = II_VIEW_AT(at, ndx, j);
+        const char *pview = buff, *view = II_VIEW_AT(at, ndx, j);
         int len = snprinte(buff, sizeof(buff), "%s", str);
         if (len > 0) {
           char mbuff[NAMELEN] = {0};
@@ -291,8 +379,8 @@ static void save_fields(int at, int ndx, uint rlen, char* record[rlen], bool add
               pview = mbuff;
           }
           if (len > 0) {
-            bool view_ok = set_newrec(at, ndx, j, strndup(pview, NAMELEN), -1);
-            bool src_ok  = set_newrec(at, ndx, j, strndup(buff, sizeof(buff)), srcndx);
+            bool view_ok = set_newrec(at, ndx, j, intern_str(pview, NAMELEN), -1);
+            bool src_ok  = set_newrec(at, ndx, j, intern_str(buff, sizeof(buff)), srcndx);
             if (!view_ok || !src_ok)
               break;
           }
@@ -311,7 +399,7 @@ static bool same_ii_src(int at, int ndx, int num, const char *first) NONNULL(4);
 static bool same_ii_src(int at, int ndx, int num, const char *first) {
     bool same = true;
     for (uint i = 1; i < II_SRC_ARR_LEN; i++) {
-      char *str = II_SRC_AT(at, ndx, num, i);
+      const char *str = II_SRC_AT(at, ndx, num, i);
       if (str)
         same = STR_EQ(first, str, NAMELEN);
       if (!same || !str)
@@ -333,18 +421,18 @@ static void review_at(int at, int ndx) {
       int len = (more && !run_opts.multi && !same) ?
         snprinte(buff, sizeof(buff), "%s*", first) :
         snprinte(buff, sizeof(buff), "%s", first);
-      if ((len > 0) && !set_newrec(at, ndx, i, strndup(buff, sizeof(buff)), -1))
+      if ((len > 0) && !set_newrec(at, ndx, i, intern_str(buff, sizeof(buff)), -1))
         break;
       fin = !more || (more && !run_opts.multi) || same;
     }
     //
     if (!fin) {
       for (uint k = 1; k < II_SRC_ARR_LEN; k++) {
-        char *str = II_SRC_AT(at, ndx, i, k);
+        const char *str = II_SRC_AT(at, ndx, i, k);
         if (str) {
           char buff[NAMELEN] = {0};
           int len = snprinte(buff, sizeof(buff), "%s, %s", II_VIEW_AT(at, ndx, i), str);
-          if ((len > 0) && !set_newrec(at, ndx, i, strndup(buff, sizeof(buff)), -1))
+          if ((len > 0) && !set_newrec(at, ndx, i, intern_str(buff, sizeof(buff)), -1))
             break;
         }
       }
@@ -365,9 +453,103 @@ static void reset_view(void) {
   memset(origins[origin_no].width, 0, sizeof(origins[origin_no].width)); // reset widths
   int max = net_max();
   for (int at = net_min(); at < max; at++)
-    for (int ndx = 0; ndx < MAXPATH; ndx++)
-      if (addr_exist(&IP_AT_NDX(at, ndx)))
-        review_at(at, ndx);
+    for (int ndx = 0; ndx < PATHS_AT(at); ndx++)
+      review_at(at, ndx);
+}
+
+// "prefix/len" of the same family as address
+static bool str2prefix(const char *str, t_ipaddr *prefix, uint *plen) {
+  char buff[INET6_ADDRSTRLEN + 5] = {0};
+  snprinte(buff, sizeof(buff), "%s", str);
+  char *slash = strchr(buff, '/');
+  if (!slash)
+    return false;
+  *slash++ = 0;
+  errno = 0;
+  long len = str2l(slash);
+  long max = (af == AF_INET6) ? 128 : 32;
+  if (errno || (len <= 0) || (len > max)) { // default route is not shared
+    errno = 0;
+    return false;
+  }
+  *plen = len;
+  return inet_pton(af, buff, prefix) > 0;
+}
+
+static bool addr_in_prefix(const t_ipaddr *addr, const t_ipaddr *prefix, uint plen) {
+  const uint8_t *a = (const uint8_t*)addr, *p = (const uint8_t*)prefix;
+  uint bytes = plen / 8, bits = plen % 8;
+  if (memcmp(a, p, bytes))
+    return false;
+  uint8_t mask = (uint8_t)(0xff << (8 - bits));
+  return !bits || !((a[bytes] ^ p[bytes]) & mask);
+}
+
+// keep single-source record of address by its route
+static void share_prefix(int at, int ndx) {
+  if ((route_no < 0) || !shared_trie.node || II_SRC_AT(at, ndx, route_no, 1))
+    return;
+  const char *route = II_SRC_AT(at, ndx, route_no, 0);
+  t_ipaddr prefix;
+  uint plen = 0, known = 0;
+  if (!route || !str2prefix(route, &prefix, &plen)
+      || !addr_in_prefix(&IP_AT_NDX(at, ndx), &prefix, plen))
+    return;
+  if ((iitrie_match(&shared_trie, af, &prefix, &known) != IITRIE_NONE) && (known == plen))
+    return; // already known
+  if (shared_count >= shared_max) {
+    uint32_t max = shared_max ? (shared_max * 2) : 64;
+    shared_t *more = realloc(shared, max * sizeof(shared_t));
+    if (!more) {
+      WARN("realloc(%zu)", max * sizeof(shared_t));
+      return;
+    }
+    shared = more;
+    shared_max = max;
+  }
+  shared_t *rec = &shared[shared_count];
+  memset(rec, 0, sizeof(*rec));
+  for (int i = 0; i < itemname_max; i++) {
+    const char *str = II_SRC_AT(at, ndx, i, 0);
+    if (str)
+      rec->rec[i] = strndup(str, NAMELEN);
+  }
+  if (iitrie_add(&shared_trie, af, &prefix, plen, shared_count)) {
+    shared_count++;
+    /*summ*/ ipinfo_shared[1]++;
+    LOGMSG("[%d:%d] share %s", at, ndx, route);
+  } else
+    for (int i = 0; i < itemname_max; i++)
+      free(rec->rec[i]);
+}
+
+// set record of address from known prefix
+static bool shared_lookup(int at, int ndx) {
+  if (!shared_count)
+    return false;
+  uint32_t no = iitrie_match(&shared_trie, af, &IP_AT_NDX(at, ndx), NULL);
+  if ((no == IITRIE_NONE) || (no >= shared_count))
+    return false;
+  for (int i = 0; i < itemname_max; i++) {
+    const char *str = shared[no].rec[i] ? shared[no].rec[i] : UNKN;
+    const char *istr = intern_str(str, NAMELEN);
+    if (!set_newrec(at, ndx, i, istr, -1) || !set_newrec(at, ndx, i, istr, 0))
+      break;
+  }
+  adjust_width(II_REC_ARR_LEN, II_REC_ARR(at, ndx));
+  /*summ*/ ipinfo_shared[0]++;
+  LOGMSG("[%d:%d] got shared %s", at, ndx, route_no >= 0 ? shared[no].rec[route_no] : "");
+  return true;
+}
+
+static void free_shared(void) {
+  for (uint32_t n = 0; n < shared_count; n++)
+    for (int i = 0; i < itemname_max; i++)
+      free(shared[n].rec[i]);
+  free(shared);
+  shared = NULL;
+  shared_count = shared_max = 0;
+  iitrie_free(&shared_trie);
 }
 
 #ifdef ENABLE_DNS
@@ -381,6 +563,7 @@ static inline void save_txt_prepare(char *txt, char comb, char delim) {
 }
 
 static void save_txt_answer(int at, int ndx, const char *answer, size_t alen) {
+  TRACEPOINT(ipinfo_reply, at + 1, ndx, OT_DNS, alen);
   char* copy = NULL;
   char* data[II_REC_ARR_LEN] = {0};
   size_t lim = (alen < NAMELEN) ? alen : NAMELEN;
@@ -397,6 +580,7 @@ static void save_txt_answer(int at, int ndx, const char *answer, size_t alen) {
   if (copy)
     free(copy);
   adjust_width(II_REC_ARR_LEN, II_REC_ARR(at, ndx));
+  share_prefix(at, ndx);
 }
 #endif
 
@@ -418,81 +602,31 @@ static int trim_n_count_records(uint len, char* record[len]) {
   return count;
 }
 
-static inline int parse_http_content_len(uint lines_no, char* lines[TCP_RESP_LINES],
-	size_t recv_size, uint *cndx) {
-  uint ndx = 0, len = 0; // content index in tcp response and its length
-  uint min = lines_no < TCP_RESP_LINES ? lines_no : TCP_RESP_LINES;
-  const char cntx_len_tag[] = "Content-Length:";
-  for (uint i = 0; i < min; i++) {
-    char* pair[2] = {lines[i], NULL};
-    if (split_with_sep(ARRAY_LEN(pair), pair, ' ', 0) == ARRAY_LEN(pair)
-      && STR_EQ(cntx_len_tag, pair[0], sizeof(cntx_len_tag))
-      && pair[1])
-    {
-        errno = 0;
-        long n = str2l(pair[1]);
-        if (errno)
-          errno = 0;
-        else if ((0 < n) && (n <= INT_MAX))
-          len = n;
-    }
-    if (lines[i][0]) // skip header lines
-      continue;
-    if ((i + 1) < lines_no)
-      ndx = i + 1;
-    break;
-  }
-  if (ndx && (len > 0) && (len < recv_size))
-    *(lines[ndx] + len) = 0;
-  else
-    len = ustrnlen(lines[ndx], NAMELEN);
-  if (cndx) *cndx = ndx;
-  return (len < NETDATA_MAXSIZE) ? len : NETDATA_MAXSIZE;
-}
-
-static void parse_http(atndx_t id, int len, char txt[len]) {
+// body of http response, tokenized in place
+static void parse_http(atndx_t id, int status, size_t len, char body[len]) {
   /*summ*/ ipinfo_replies[0]++; ipinfo_replies[1]++;
+  TRACEPOINT(ipinfo_reply, id.at + 1, id.ndx, OT_HTTP, len);
   char* list[II_REC_ARR_LEN] = {0};
-  const char http1_1[] = "HTTP/1.1";
-  //
   int got = -1;
-  char *ptr =
-#ifdef HAVE_MEMMEM
-    memmem(txt, len, http1_1, sizeof(http1_1) - 1);
-#else
-    strstr(txt, http1_1);
-#endif
-  if (ptr) {
-    ptr += sizeof(http1_1); // i.e. beyond 'HTTP/1.1 '
-    char okay[] = "200 OK";
-    int olen = sizeof(okay) - 1;
-    if (STR_NEQ(ptr, okay, olen)) // HTTP OK, or not
-      LOGMSG("not OK: %.*s", olen, ptr);
-    else {
-      char* lines[TCP_RESP_LINES] = {txt};
-      uint lines_no = split_with_sep(ARRAY_LEN(lines), lines, '\n', 0);
-      if (lines_no < 4) // HEADER + NL + NL + DATA
-        LOGMSG("No data after header (got %d lines only)", lines_no);
-      else {
-        uint cndx = 0, clen = parse_http_content_len(lines_no, lines, len, &cndx);
-        // combine into one line
-        char context[clen + 1];
-        memset(context, 0, sizeof(context));
-        for (uint i = cndx, len = 0; (i < lines_no) && (len < clen); i++) {
-          int inc = snprinte(context + len, clen - len, "%s", lines[i]);
-          if (inc < 0)
-            break;
-          len += inc;
-        }
-        LOGMSG("context(%.*s)", clen, context);
-        //
-        split_record(context, ARRAY_LEN(list), list);
-        got = trim_n_count_records(ARRAY_LEN(list), list);
-        if (got == itemname_max) { // success
-          save_records(id, ARRAY_LEN(list), list, SETFIELDS, 0);
-          return;
-        }
-      }
+  if (status != 200) // HTTP OK, or not
+    LOGMSG("not OK: %d", status);
+  else if (!len)
+    LOGMSG("%s", "No data after header");
+  else {
+    // combine into one line
+    char *dst = body;
+    for (const char *src = body; src < body + len; src++)
+      if ((*src != '\r') && (*src != '\n'))
+        *dst++ = *src;
+    *dst = 0;
+    LOGMSG("context(%s)", body);
+    //
+    split_record(body, ARRAY_LEN(list), list);
+    got = trim_n_count_records(ARRAY_LEN(list), list);
+    if (got == itemname_max) { // success
+      save_records(id, ARRAY_LEN(list), list, SETFIELDS, 0);
+      share_prefix(id.at, id.ndx);
+      return;
     }
   }
   // fail
@@ -571,6 +705,7 @@ static int skip_whois_nodata(uint len, char* lines[len]) {
 
 static void parse_whois(atndx_t id, uint len, char txt[len]) {
   /*summ*/ ipinfo_replies[0]++; ipinfo_replies[2]++;
+  TRACEPOINT(ipinfo_reply, id.at + 1, id.ndx, OT_WHOIS, len);
   char* msrc[II_SRC_ARR_LEN + 1] = {0};
   split_by_empty_lines(len, txt, ARRAY_LEN(msrc) - 1, msrc);
   bool op = SETFIELDS;
@@ -594,9 +729,11 @@ static void parse_whois(atndx_t id, uint len, char txt[len]) {
       }
     }
   }
-  if (op == ADDFIELDS) // i.e. some records are saved
+  if (op == ADDFIELDS) { // i.e. some records are saved
     reset_view();
-  else {      // otherwise save empty data as unknown
+    if (srcno == 1)
+      share_prefix(id.at, id.ndx);
+  } else {      // otherwise save empty data as unknown
     char* record[II_REC_ARR_LEN] = {0};
     save_records(id, ARRAY_LEN(record), record, op, 0);
   }
@@ -613,78 +750,183 @@ static void close_ipitseq(int seq) {
         close(sock);
         /*summ*/ sum_sock[1]++;
       }
-      memset(&ipitseq[seq], -1, sizeof(ipitseq[0]));
     }
+    free(ipitseq[seq].st);
+    ipitseq[seq] = (ipitseq_t){ .sock = -1, .state = -1, .slot = -1 };
   }
 }
 
+static void http_conn_parse(int cno);
+static void bulk_conn_parse(void);
+
 void ipinfo_parse(int sock, int seq) { // except dns, dns.ack in dns.c
-  char data[NETDATA_MAXSIZE + 1] = {0};
   seq %= MAXSEQ;
-  ssize_t received = recv(sock, data, sizeof(data) - 1, 0);
-  if (received > 0) {
-    atndx_t id = { .at = seq / MAXPATH, .ndx = seq % MAXPATH };
-    switch ORIG_TYPE {
-      case OT_HTTP:
-        LOGMSG( "HTTP: got[%zd]: \"%.*s\"", received, (int)received, data);
-        parse_http(id, received, data);
-        return;
-      case OT_WHOIS:
-        LOGMSG("WHOIS: got[%zd]: \"%.*s\"", received, (int)received, data);
-        parse_whois(id, received, data);
-        return;
-      default: break;
+  if (seq >= IPITSEQ_MAX) {
+    if (seq >= BULK_CONN_SEQ)
+      bulk_conn_parse();
+    else
+      http_conn_parse(seq - IPITSEQ_MAX);
+    return;
+  }
+  if (!ipitseq)
+    return;
+  iistream_t *st = ipitseq[seq].st;
+  if (!st) { // buffer is allocated for the time of connection
+    st = ipitseq[seq].st = malloc(sizeof(iistream_t));
+    if (!st) {
+      WARN("seq=%d malloc(%zd)", seq, sizeof(iistream_t));
+      close_ipitseq(seq);
+      return;
     }
+    iis_init(st, IIS_WHOIS);
+  }
+  size_t room = 0;
+  char *data = iis_room(st, &room);
+  ssize_t received = room ? recv(sock, data, room, 0) : -1;
+  if (received > 0) {
+    LOGMSG("WHOIS: got[%zd]: \"%.*s\"", received, (int)received, data);
+    if (iis_feed(st, received) == IIS_MORE)
+      return;
+    LOGMSG("seq=%d: %s", seq, strerror(EMSGSIZE));
   } else if (received < 0)
     WARN("seq=%d recv(sock=%d)", seq, sock);
+  else if (iis_fin(st) == IIS_DONE) // whois answers till the end of connection
+    parse_whois((atndx_t){ .at = seq / MAXPATH, .ndx = seq % MAXPATH }, st->blen, IIS_DATA(st));
   close_ipitseq(seq);
 }
 
+#define ORIG_HOST_AF ((af == AF_INET6) && origins[origin_no].host6 ? origins[origin_no].host6 : ORIG_HOST)
 
-static int create_tcpsock(int seq) {
-  uint16_t port = (ORIG_TYPE == OT_WHOIS) ? WHOIS_PORT : HTTP_PORT;
-  char srv[8] = {0};
-  snprinte(srv, sizeof(srv), "%u", port);
-  LOGMSG("%s:%s", ORIG_HOST, srv);
-  if (!srv[0]) return -1;
-  struct addrinfo *rp = NULL, hints = {
-    .ai_family = af,
-    .ai_socktype = SOCK_STREAM,
-    .ai_protocol = IPPROTO_TCP };
-  int ecode = getaddrinfo(ORIG_HOST, srv, &hints, &rp);
-  if (ecode || !rp)
-    LOGRET_RC(-1, "getaddrinfo(%s): %s", ORIG_HOST, gai_strerror(ecode));
-  int rc = -1;
-  int sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-  if (sock < 0) {
-    LOGMSG("%s: socket: %s", ORIG_HOST, strerror(errno));
-  } else {
-    LOGMSG("socket=%d open", sock);
-    /*summ*/ sum_sock[0]++;
-    if (fcntl(sock, F_SETFL, O_NONBLOCK) < 0) {
-      LOGMSG("%s: fcntl: %s", ORIG_HOST, strerror(errno));
-    } else {
-      int slot = poll_reg_fd(sock, seq + MAXSEQ);
-      if (slot < 0) {
-        LOGMSG("no place in pool for sockets (host=%s)", ORIG_HOST);
-      } else {
-        ipitseq[seq] = (ipitseq_t) { .sock = sock, .slot = slot, .state = TSEQ_CREATED };
-        connect(sock, rp->ai_addr, rp->ai_addrlen); // NOLINT(bugprone-unused-return-value)
-        LOGMSG("send non-blocking connect via sock=%d", sock);
-        rc = 0; // note: non-blocking connect() returns EINPROGRESS
-      }
-    }
-    if (rc) {
-      LOGMSG("socket=%d close", sock);
-      close(sock);
-      /*summ*/ sum_sock[1]++;
+#ifdef ENABLE_DNS
+static void save_origaddr(int family, uint count, const t_ipaddr addr[], uint32_t ttl) {
+  if (!count || !addr || (family != af))
+    LOGRET("%s: no addresses (family=%d)", ORIG_HOST_AF, family);
+  bool first = !origaddr.count;
+  if (count > ARRAY_LEN(origaddr.addr))
+    count = ARRAY_LEN(origaddr.addr);
+  memcpy(origaddr.addr, addr, count * sizeof(origaddr.addr[0]));
+  origaddr.count = count;
+  origaddr.expire = unixtime() + ((ttl < ORIGADDR_MINTTL) ? ORIGADDR_MINTTL : ttl);
+  LOGMSG("%s: %u address%s for %u sec", ORIG_HOST_AF, count, (count == 1) ? "" : "es", ttl);
+  if (first) { // let postponed queries go without waiting for their pause
+    int max = net_max();
+    for (int at = net_min(); at < max; at++)
+      for (int ndx = 0; ndx < PATHS_AT(at); ndx++)
+        if ((!ipitseq || (ipitseq[at * MAXPATH + ndx].state < 0)) && !II_VIEW_AT(at, ndx, 0))
+          QTXT_TS_AT_NDX(at, ndx) = 0;
+  }
+}
+#else
+// without own resolver the origin is resolved with getaddrinfo(), in blocking manner
+static void resolve_origaddr(const char *name) {
+  struct addrinfo *res = NULL, hints = { .ai_family = af, .ai_socktype = SOCK_STREAM, .ai_protocol = IPPROTO_TCP };
+  int ecode = getaddrinfo(name, NULL, &hints, &res);
+  if (ecode || !res)
+    LOGRET("getaddrinfo(%s): %s", name, gai_strerror(ecode));
+  uint count = 0;
+  for (const struct addrinfo *rp = res; rp && (count < ARRAY_LEN(origaddr.addr)); rp = rp->ai_next) {
+    if (rp->ai_family != af)
+      continue;
+#ifdef ENABLE_IPV6
+    if (af == AF_INET6)
+      memcpy(&origaddr.addr[count++].in6, &((struct sockaddr_in6 *)rp->ai_addr)->sin6_addr, sizeof(struct in6_addr));
+    else
+#endif
+      memcpy(&origaddr.addr[count++].in, &((struct sockaddr_in *)rp->ai_addr)->sin_addr, sizeof(struct in_addr));
+  }
+  freeaddrinfo(res);
+  if (count) {
+    origaddr.count = count;
+    origaddr.expire = unixtime() + ORIGADDR_MINTTL;
+    LOGMSG("%s: %u address%s", name, count, (count == 1) ? "" : "es");
+  }
+}
+#endif
+
+// next tcp-origin address in round-robin manner, stale ones are used while re-resolving
+static bool origaddr_next(t_sockaddr *sa) NONNULL(1);
+static bool origaddr_next(t_sockaddr *sa) {
+  const char *name = ORIG_HOST_AF;
+  if (!name)
+    return false;
+  if (origaddr.family != af) { // new family, new addresses
+    memset(&origaddr, 0, sizeof(origaddr));
+    origaddr.family = af;
+    origaddr.fixed = (inet_pton(af, name, &origaddr.addr[0]) > 0);
+    if (origaddr.fixed)
+      origaddr.count = 1;
+  }
+  time_t now = unixtime();
+  if (!origaddr.fixed && (now >= origaddr.expire) && ((now - origaddr.asked) >= ORIGADDR_RETRY)) {
+    origaddr.asked = now;
+#ifdef ENABLE_DNS
+    if (dns_addr_query(name, af) < 0)
+      LOGMSG("%s: failed to send query", name);
+#else
+    resolve_origaddr(name);
+#endif
+  }
+  if (!origaddr.count)
+    return false;
+  const t_ipaddr *addr = &origaddr.addr[origaddr.next++ % origaddr.count];
+  uint16_t port = htons((ORIG_TYPE == OT_WHOIS) ? WHOIS_PORT : HTTP_PORT);
+  memset(sa, 0, sizeof(*sa));
+  sa->SA_AF = af;
+#ifdef ENABLE_IPV6
+  if (af == AF_INET6) {
+    memcpy(&sa->S6ADDR, &addr->in6, sizeof(sa->S6ADDR));
+    sa->S6PORT = port;
+  } else
+#endif
+  { memcpy(&sa->S_ADDR, &addr->in, sizeof(sa->S_ADDR));
+    sa->S_PORT = port; }
+  return true;
+}
+
+// open non-blocking socket to origin, and register it for polling
+static int open_tcpsock(int seq, int *slot) NONNULL(2);
+static int open_tcpsock(int seq, int *slot) {
+  t_sockaddr sa;
+  if (!origaddr_next(&sa))
+    LOGRET_RC(-1, "%s: no address yet", ORIG_HOST_AF);
+  socklen_t salen =
+#ifdef ENABLE_IPV6
+    (af == AF_INET6) ? sizeof(sa.sin6) :
+#endif
+    sizeof(sa.sin);
+  int sock = socket(af, SOCK_STREAM, IPPROTO_TCP);
+  if (sock < 0)
+    LOGRET_RC(-1, "%s: socket: %s", ORIG_HOST, strerror(errno));
+  LOGMSG("socket=%d open", sock);
+  /*summ*/ sum_sock[0]++;
+  if (fcntl(sock, F_SETFL, O_NONBLOCK) < 0)
+    LOGMSG("%s: fcntl: %s", ORIG_HOST, strerror(errno));
+  else {
+    *slot = poll_reg_fd(sock, seq + MAXSEQ);
+    if (*slot < 0)
+      LOGMSG("no place in pool for sockets (host=%s)", ORIG_HOST);
+    else {
+      connect(sock, &sa.sa, salen); // NOLINT(bugprone-unused-return-value)
+      LOGMSG("send non-blocking connect via sock=%d", sock);
+      return sock; // note: non-blocking connect() returns EINPROGRESS
     }
   }
-  freeaddrinfo(rp);
-  return rc;
+  LOGMSG("socket=%d close", sock);
+  close(sock);
+  /*summ*/ sum_sock[1]++;
+  return -1;
+}
+
+static int create_tcpsock(int seq) {
+  int slot = -1;
+  int sock = open_tcpsock(seq, &slot);
+  if (sock < 0)
+    return -1;
+  ipitseq[seq] = (ipitseq_t) { .sock = sock, .slot = slot, .state = TSEQ_CREATED };
+  return 0;
 }
 
-static int send_tcp_query(int sock, const char *q) {
+static int send_tcp_query(int sock, int seq UNUSED, const char *q) {
   char buf[NETDATA_MAXSIZE] = {0};
   if (ORIG_TYPE == OT_WHOIS)
     snprinte(buf, sizeof(buf), "%s\r\n", q);
@@ -698,8 +940,9 @@ static int send_tcp_query(int sock, const char *q) {
   int rc = send(sock, buf, len, 0);
   if (rc >= 0) {
     /*summ*/ ipinfo_queries[0]++; (ORIG_TYPE == OT_HTTP) ? ipinfo_queries[1]++ : ipinfo_queries[2]++;
+    TRACEPOINT(ipinfo_query, seq / MAXPATH + 1, seq % MAXPATH, ORIG_TYPE, q);
   }
-  LOGMSG("[orig=%d sock=%d] q=\"%s\" rc=%d ts=%lld", origin_no, sock, q, rc, (long long)time(NULL));
+  LOGMSG("[orig=%d sock=%d] q=\"%s\" rc=%d ts=%lld", origin_no, sock, q, rc, (long long)unixtime());
   return rc;
 }
 
@@ -715,16 +958,280 @@ static const char* make_tcp_qstr(int at, int ndx, size_t size, char query[size])
   return NULL;
 }
 
+static void close_httpconn(int cno) {
+  httpconn_t *conn = &httpconn[cno];
+  if (conn->sock >= 0) {
+    LOGMSG("conn#%d: close sock=%d, %d request(s) left", cno, conn->sock, conn->queued);
+    if (conn->slot >= 0)
+      poll_dereg_fd(conn->slot);
+    else {
+      close(conn->sock);
+      /*summ*/ sum_sock[1]++;
+    }
+  }
+  memset(conn, 0, sizeof(*conn));
+  conn->sock = conn->state = conn->slot = -1;
+}
+
+static bool http_pending(int seq) {
+  if (!tcpconn_ready)
+    return false;
+  for (int i = 0; i < HTTP_CONN_MAX; i++)
+    for (int j = 0; j < httpconn[i].queued; j++)
+      if (httpconn[i].seq[j] == seq)
+        return true;
+  return false;
+}
+
+static void http_send_queued(int cno) {
+  httpconn_t *conn = &httpconn[cno];
+  time_t now = unixtime();
+  while (conn->sent < conn->queued) {
+    int seq = conn->seq[conn->sent];
+    int at = seq / MAXPATH, ndx = seq % MAXPATH;
+    char query[NAMELEN] = {0};
+    const char *q = make_tcp_qstr(at, ndx, sizeof(query), query);
+    if (!q || (send_tcp_query(conn->sock, seq, q) < 0)) {
+      close_httpconn(cno);
+      return;
+    }
+    QTXT_TS_AT_NDX(at, ndx) = now; // save send-time
+    conn->sent++;
+  }
+  conn->ts = now;
+}
+
+// put request in a persistent connection, open new one if all of them are busy
+static int http_enqueue(int seq) {
+  if (!tcpconn_ready)
+    return -1;
+  int cno = -1;
+  for (int i = 0; i < HTTP_CONN_MAX; i++)
+    if ((httpconn[i].sock >= 0) && (httpconn[i].queued < HTTP_PIPELINE_MAX)) {
+      cno = i;
+      break;
+    }
+  if (cno < 0)
+    for (int i = 0; i < HTTP_CONN_MAX; i++)
+      if (httpconn[i].sock < 0) {
+        int slot = -1;
+        int sock = open_tcpsock(IPITSEQ_MAX + i, &slot);
+        if (sock < 0)
+          return -1;
+        httpconn[i].sock  = sock;
+        httpconn[i].slot  = slot;
+        httpconn[i].state = TSEQ_CREATED;
+        httpconn[i].ts    = unixtime();
+        iis_init(&httpconn[i].st, IIS_HTTP);
+        cno = i;
+        break;
+      }
+  if (cno < 0)
+    return -1; // all connections are full
+  httpconn_t *conn = &httpconn[cno];
+  conn->seq[conn->queued++] = seq;
+  LOGMSG("conn#%d: seq=%d queued=%d sent=%d", cno, seq, conn->queued, conn->sent);
+  if (conn->state == TSEQ_READY)
+    http_send_queued(cno);
+  return 0;
+}
+
+static void http_dequeue(int cno) {
+  httpconn_t *conn = &httpconn[cno];
+  int seq = conn->seq[0];
+  parse_http((atndx_t){ .at = seq / MAXPATH, .ndx = seq % MAXPATH },
+    conn->st.status, conn->st.blen, IIS_DATA(&conn->st));
+  iis_next(&conn->st);
+  conn->queued--;
+  conn->sent--;
+  memmove(conn->seq, conn->seq + 1, conn->queued * sizeof(conn->seq[0]));
+}
+
+static void http_conn_parse(int cno) {
+  if (!tcpconn_ready || (cno < 0) || (cno >= HTTP_CONN_MAX))
+    return;
+  httpconn_t *conn = &httpconn[cno];
+  size_t room = 0;
+  char *data = iis_room(&conn->st, &room);
+  ssize_t received = room ? recv(conn->sock, data, room, 0) : -1;
+  if (received > 0) {
+    LOGMSG("conn#%d: got[%zd]: \"%.*s\"", cno, received, (int)received, data);
+    conn->ts = unixtime();
+    int rc = iis_feed(&conn->st, received);
+    while ((rc == IIS_DONE) && (conn->sent > 0)) { // pipelined responses
+      http_dequeue(cno);
+      rc = iis_feed(&conn->st, 0);
+    }
+    if (rc != IIS_FAIL)
+      return;
+    LOGMSG("conn#%d: %s", cno, "Failed to parse");
+  } else if (received < 0)
+    WARN("conn#%d recv(sock=%d)", cno, conn->sock);
+  else if (conn->sent && (iis_fin(&conn->st) == IIS_DONE)) // delimited by the end of connection
+    http_dequeue(cno);
+  close_httpconn(cno);
+}
+
+static void close_bulkconn(void) {
+  if (bulkconn.sock >= 0) {
+    LOGMSG("close sock=%d, %d address(es) left", bulkconn.sock, bulkconn.count);
+    if (bulkconn.slot >= 0)
+      poll_dereg_fd(bulkconn.slot);
+    else {
+      close(bulkconn.sock);
+      /*summ*/ sum_sock[1]++;
+    }
+  }
+  memset(&bulkconn, 0, sizeof(bulkconn));
+  bulkconn.sock = bulkconn.state = bulkconn.slot = -1;
+}
+
+static bool bulk_pending(int seq) {
+  if (!tcpconn_ready)
+    return false;
+  for (int i = 0; i < bulkconn.count; i++)
+    if (bulkconn.seq[i] == seq)
+      return true;
+  return false;
+}
+
+// open session if the collecting window is over (or there's no more room)
+static void bulk_flush(void) {
+  if ((bulkconn.sock >= 0) || !bulkconn.count)
+    return;
+  if ((bulkconn.count < WHOIS_BULK_MAX) && ((unixtime() - bulkconn.first) < WHOIS_BULK_WINDOW))
+    return;
+  int slot = -1;
+  int sock = open_tcpsock(BULK_CONN_SEQ, &slot);
+  if (sock < 0)
+    return;
+  bulkconn.sock  = sock;
+  bulkconn.slot  = slot;
+  bulkconn.state = TSEQ_CREATED;
+  bulkconn.ts    = unixtime();
+  iis_init(&bulkconn.st, IIS_LINES);
+  LOGMSG("open session for %d address(es)", bulkconn.count);
+}
+
+static int bulk_enqueue(int seq) {
+  if (!tcpconn_ready || (bulkconn.count >= WHOIS_BULK_MAX) || (bulkconn.sock >= 0)) {
+    bulk_flush();
+    return -1; // next time
+  }
+  if (!bulkconn.count)
+    bulkconn.first = unixtime();
+  bulkconn.seq[bulkconn.count++] = seq;
+  LOGMSG("seq=%d collected=%d", seq, bulkconn.count);
+  bulk_flush();
+  return 0;
+}
+
+static void bulk_send(void) {
+  char buf[NETDATA_MAXSIZE] = {0};
+  int len = snprinte(buf, sizeof(buf), "%s", WHOIS_BULK_BEGIN);
+  int count = 0;
+  time_t now = unixtime();
+  for (int i = 0; (i < bulkconn.count) && (len > 0); i++) {
+    int at = bulkconn.seq[i] / MAXPATH, ndx = bulkconn.seq[i] % MAXPATH;
+    char str[MAX_ADDRSTRLEN] = {0};
+    if (!inet_ntop(af, &IP_AT_NDX(at, ndx), str, sizeof(str)))
+      continue;
+    int inc = snprinte(buf + len, sizeof(buf) - len, "%s\n", str);
+    if (inc <= 0)
+      break;
+    len += inc;
+    count++;
+    QTXT_TS_AT_NDX(at, ndx) = now; // save send-time
+  }
+  int inc = (len > 0) ? snprinte(buf + len, sizeof(buf) - len, "%s", WHOIS_BULK_END) : -1;
+  if ((inc <= 0) || (send(bulkconn.sock, buf, len + inc, 0) < 0)) {
+    LOGMSG("failed to send %d address(es)", count);
+    close_bulkconn();
+    return;
+  }
+  /*summ*/ ipinfo_queries[0] += count; ipinfo_queries[2] += count;
+  for (int i = 0; i < bulkconn.count; i++)
+    TRACEPOINT(ipinfo_query, bulkconn.seq[i] / MAXPATH + 1, bulkconn.seq[i] % MAXPATH, ORIG_TYPE, (const char *)buf);
+  bulkconn.ts = now;
+  LOGMSG("sent %d address(es) in %d bytes", count, len + inc);
+}
+
+// one line of answer: "ASN | IP | Route | CC | Registry | Allocated | AS-Name"
+static void bulk_parse_line(char *line) NONNULL(1);
+static void bulk_parse_line(char *line) {
+  char* list[II_REC_ARR_LEN] = {0};
+  split_record(line, ARRAY_LEN(list), list);
+  t_ipaddr addr;
+  if (!list[1] || (inet_pton(af, list[1], &addr) <= 0)) {
+    LOGMSG("skip: %s", line);
+    return;
+  }
+  for (int i = 0; i < bulkconn.count; i++) {
+    int seq = bulkconn.seq[i];
+    atndx_t id = { .at = seq / MAXPATH, .ndx = seq % MAXPATH };
+    if (addr_equal(&addr, &IP_AT_NDX(id.at, id.ndx))) {
+      /*summ*/ ipinfo_replies[0]++; ipinfo_replies[2]++;
+      TRACEPOINT(ipinfo_reply, id.at + 1, id.ndx, OT_WHOIS, 0);
+      save_records(id, ARRAY_LEN(list), list, SETFIELDS, 0);
+      share_prefix(id.at, id.ndx);
+      bulkconn.count--;
+      memmove(&bulkconn.seq[i], &bulkconn.seq[i + 1], (bulkconn.count - i) * sizeof(bulkconn.seq[0]));
+      return;
+    }
+  }
+  LOGMSG("no place for: %s", list[1]);
+}
+
+static void bulk_conn_parse(void) {
+  if (!tcpconn_ready || (bulkconn.sock < 0))
+    return;
+  size_t room = 0;
+  char *data = iis_room(&bulkconn.st, &room);
+  ssize_t received = room ? recv(bulkconn.sock, data, room, 0) : -1;
+  if (received > 0) {
+    LOGMSG("got[%zd]: \"%.*s\"", received, (int)received, data);
+    bulkconn.ts = unixtime();
+    int rc = iis_feed(&bulkconn.st, received);
+    while (rc == IIS_DONE) {
+      bulk_parse_line(IIS_DATA(&bulkconn.st));
+      iis_next(&bulkconn.st);
+      rc = iis_feed(&bulkconn.st, 0);
+    }
+    if (bulkconn.count && (rc != IIS_FAIL))
+      return;
+  } else if (received < 0)
+    WARN("recv(sock=%d)", bulkconn.sock);
+  else if (iis_fin(&bulkconn.st) == IIS_DONE) // the last line without NL
+    bulk_parse_line(IIS_DATA(&bulkconn.st));
+  close_bulkconn(); // the rest of addresses will be collected again
+}
+
 void ipinfo_seq_ready(int seq) {
   seq %= MAXSEQ;
+  if (seq >= BULK_CONN_SEQ) {
+    if (tcpconn_ready && (bulkconn.sock >= 0)) {
+      bulkconn.state = TSEQ_READY;
+      bulk_send();
+    }
+    return;
+  }
+  if (seq >= IPITSEQ_MAX) {
+    int cno = seq - IPITSEQ_MAX;
+    if (tcpconn_ready && (cno >= 0) && (cno < HTTP_CONN_MAX)) {
+      LOGMSG("conn#%d: ready", cno);
+      httpconn[cno].state = TSEQ_READY;
+      http_send_queued(cno);
+    }
+    return;
+  }
   int at = seq / MAXPATH, ndx = seq % MAXPATH;
   LOGMSG("seq=%d at=%d ndx=%d", seq, at, ndx);
   ipitseq[seq].state = TSEQ_READY;
-  QTXT_TS_AT_NDX(at, ndx) = time(NULL); // save send-time
+  QTXT_TS_AT_NDX(at, ndx) = unixtime(); // save send-time
   char query[NAMELEN] = {0};
   const char *q = make_tcp_qstr(at, ndx, sizeof(query), query);
   if (q)
-    send_tcp_query(ipitseq[seq].sock, q);
+    send_tcp_query(ipitseq[seq].sock, seq, q);
 }
 
 static int ipinfo_lookup(int at, int ndx, const char *qstr) {
@@ -737,29 +1244,41 @@ static int ipinfo_lookup(int at, int ndx, const char *qstr) {
 
   // set query string if not yet (setting a new ip, free this query)
   if (!QTXT_AT_NDX(at, ndx)) {
-    QTXT_AT_NDX(at, ndx) = strndup(qstr, NAMELEN);
+    QTXT_AT_NDX(at, ndx) = intern_str(qstr, NAMELEN);
     if (!QTXT_AT_NDX(at, ndx)) {
-      WARN("[%d:%d]: strndup()", at, ndx);
+      WARNX("[%d:%d]: intern_str()", at, ndx);
       return -1;
   }}
 
   int pause = PAUSE_BETWEEN_QUERIES;
   int seq = at * MAXPATH + ndx;
-  if (ORIG_TYPE != OT_DNS) {
+  if (ORIG_TYPE == OT_HTTP) {
+    if (http_pending(seq))
+      return -1; // already in the queue
+  } else if (ORIG_BULK) {
+    if (bulk_pending(seq)) {
+      bulk_flush();
+      return -1; // already collected
+    }
+  } else if (ORIG_TYPE == OT_WHOIS) {
     if (!ipitseq)
       return -1;
     if (ipitseq[seq].state != TSEQ_READY)
       pause = ipinfo_syn_timeout;
   }
 
-  time_t now = time(NULL);
+  time_t now = unixtime();
   time_t dt_txt = now - QTXT_TS_AT_NDX(at, ndx);
   time_t dt_ptr = now - QPTR_TS_AT_NDX(at, ndx);
   if ((dt_txt < pause) || (dt_ptr < TXT_PTR_PAUSE))
     return -1; // too often
   QTXT_TS_AT_NDX(at, ndx) = now; // save time of trying to send something
 
-  if (ORIG_TYPE != OT_DNS) { // tcp
+  if (ORIG_TYPE == OT_HTTP)
+    return http_enqueue(seq);
+  if (ORIG_BULK)
+    return bulk_enqueue(seq);
+  if (ORIG_TYPE == OT_WHOIS) {
     int state = ipitseq[seq].state;
     if (state != TSEQ_READY) {
       if (state != -1)
@@ -772,19 +1291,52 @@ static int ipinfo_lookup(int at, int ndx, const char *qstr) {
 #ifdef ENABLE_DNS
     (ORIG_TYPE == OT_DNS) ? dns_send_query(at, ndx, qstr, ns_t_txt) :
 #endif
-    send_tcp_query(ipitseq[seq].sock, qstr);
+    send_tcp_query(ipitseq[seq].sock, seq, qstr);
+}
+
+// local table is looked up synchronously, unknown addresses are saved as unknown too
+static int file_lookup(int at, int ndx) {
+  char buff[IIDB_LINE_MAX];
+  char* record[II_REC_ARR_LEN] = {0};
+  /*summ*/ ipinfo_queries[0]++;
+  int count = iidb_lookup(af, &IP_AT_NDX(at, ndx), ARRAY_LEN(record), record, sizeof(buff), buff);
+  if (count > 0)
+    /*summ*/ ipinfo_replies[0]++;
+  save_records((atndx_t){.at = at, .ndx = ndx}, ARRAY_LEN(record), record, SETFIELDS, 0);
+  return count;
 }
 
 bool ipinfo_timedout(int seq) {
   seq %= MAXSEQ;
-  if ((time(NULL) - QTXT_TS_AT_NDX(seq / MAXPATH, seq % MAXPATH)) <= IPINFO_TCP_TIMEOUT)
+  if (seq >= BULK_CONN_SEQ) {
+    if (!tcpconn_ready || ((unixtime() - bulkconn.ts) <= IPINFO_TCP_TIMEOUT))
+      return false;
+    LOGMSG("clean bulk session after %d sec", IPINFO_TCP_TIMEOUT);
+    TRACEPOINT(ipinfo_timeout, seq);
+    close_bulkconn();
+    return true;
+  }
+  if (seq >= IPITSEQ_MAX) {
+    int cno = seq - IPITSEQ_MAX;
+    if (!tcpconn_ready || (cno < 0) || (cno >= HTTP_CONN_MAX))
+      return false;
+    time_t idle = unixtime() - httpconn[cno].ts;
+    if (idle <= (httpconn[cno].queued ? IPINFO_TCP_TIMEOUT : HTTP_KEEPALIVE))
+      return false;
+    LOGMSG("clean conn#%d after %lld sec", cno, (long long)idle);
+    TRACEPOINT(ipinfo_timeout, seq);
+    close_httpconn(cno);
+    return true;
+  }
+  if ((unixtime() - QTXT_TS_AT_NDX(seq / MAXPATH, seq % MAXPATH)) <= IPINFO_TCP_TIMEOUT)
     return false;
   LOGMSG("clean tcp seq=%d after %d sec", seq, IPINFO_TCP_TIMEOUT);
+  TRACEPOINT(ipinfo_timeout, seq);
   close_ipitseq(seq);
   return true;
 }
 
-static char *get_ipinfo(int at, int ndx, int item_no) {
+static const char *get_ipinfo(int at, int ndx, int item_no) {
   if (II_VIEW_AT(at, ndx, item_no)) // already known
     return II_VIEW_AT(at, ndx, item_no);
 #ifdef ENABLE_IPV6
@@ -793,6 +1345,8 @@ static char *get_ipinfo(int at, int ndx, int item_no) {
   } else
 #endif
   { if (!ORIG_HOST) return NULL; }
+  if ((ORIG_TYPE != OT_FILE) && shared_lookup(at, ndx)) // no need to query
+    return II_VIEW_AT(at, ndx, item_no);
   t_ipaddr *ipaddr = &IP_AT_NDX(at, ndx);
   char query[NAMELEN] = {0};
   switch (ORIG_TYPE) {
@@ -802,6 +1356,9 @@ static char *get_ipinfo(int at, int ndx, int item_no) {
       if (q)
         ipinfo_lookup(at, ndx, q);
     } break;
+    case OT_FILE:
+      file_lookup(at, ndx);
+      return II_VIEW_AT(at, ndx, item_no);
 #ifdef ENABLE_DNS
     default: // dns
       ip2arpa(sizeof(query), query, ipaddr, ORIG_HOST, origins[origin_no].host6);
@@ -921,7 +1478,8 @@ static bool alloc_ipitseq(void) {
     size_t size = sizeof(ipitseq_t) * MAXHOST * MAXPATH;
     ipitseq = malloc(size);
     if (ipitseq) {
-      memset(ipitseq, -1, size);
+      for (int i = 0; i < MAXHOST * MAXPATH; i++)
+        ipitseq[i] = (ipitseq_t){ .sock = -1, .state = -1, .slot = -1 };
       LOGMSG("allocated %zd bytes for tcp-sockets", size);
     } else
       WARN("tcpseq malloc(%zd)", size);
@@ -929,24 +1487,57 @@ static bool alloc_ipitseq(void) {
   return ipitseq != NULL;
 }
 
+static bool init_tcpconn(void) {
+  if (!tcpconn_ready) {
+    for (int i = 0; i < HTTP_CONN_MAX; i++) {
+      memset(&httpconn[i], 0, sizeof(httpconn[0]));
+      httpconn[i].sock = httpconn[i].state = httpconn[i].slot = -1;
+    }
+    memset(&bulkconn, 0, sizeof(bulkconn));
+    bulkconn.sock = bulkconn.state = bulkconn.slot = -1;
+    tcpconn_ready = true;
+  }
+  return tcpconn_ready;
+}
+
 #ifdef ENABLE_DNS
 #define DNS_OPEN dns_open()
 #else
 #define DNS_OPEN false
 #endif
 
+static bool open_iidb(void) {
+  const char *path = getenv(IP2ASN_ENV);
+  return iidb_open((path && *path) ? path : ORIG_HOST);
+}
+
 static bool ipinfo_open(void) {
   ipinfo_ready = (ORIG_TYPE == OT_DNS) ? DNS_OPEN :
-    (ipitseq ? true : alloc_ipitseq()); // http or whois
+    (ORIG_TYPE == OT_FILE) ? open_iidb() :
+    ((ORIG_TYPE == OT_HTTP) || ORIG_BULK) ? init_tcpconn() :
+    (ipitseq ? true : alloc_ipitseq()); // whois
+  if (ipinfo_ready && (ORIG_TYPE != OT_FILE) && (route_no >= 0) && !shared_trie.node)
+    iitrie_init(&shared_trie, 0); // not fatal if fails
 #ifdef ENABLE_DNS
   if (!dns_txt_handler) // use-note: only in ipinfo so far
     dns_txt_handler = save_txt_answer;
+  if (ipinfo_tcpmode) { // tcp-origin addresses are resolved asynchronously
+    if (!dns_addr_handler)
+      dns_addr_handler = save_origaddr;
+    dns_open();
+  }
 #endif
   LOGMSG("%s", ipinfo_ready ? "ok" : "failed");
   return ipinfo_ready;
 }
 
 void ipinfo_close(void) {
+  if (tcpconn_ready) {
+    for (int i = 0; i < HTTP_CONN_MAX; i++)
+      close_httpconn(i);
+    close_bulkconn();
+    tcpconn_ready = false;
+  }
   if (ipitseq) {
     for (int i = 0; i < MAXHOST * MAXPATH; i++)
       close_ipitseq(i);
@@ -956,6 +1547,10 @@ void ipinfo_close(void) {
   }
   if (ipinfo_ready)
     ipinfo_ready = false;
+  if (ORIG_TYPE == OT_FILE)
+    iidb_close();
+  if (shared_trie.node)
+    free_shared();
 #ifdef ENABLE_DNS
   if (ORIG_TYPE == OT_DNS)
     dns_close();
@@ -990,7 +1585,7 @@ bool ipinfo_init(const char *arg) {
   }
   if ((org > 0) && (org <= omax)) {
     origin_no = org - 1;
-    ipinfo_tcpmode = (ORIG_TYPE != OT_DNS);
+    ipinfo_tcpmode = (ORIG_TYPE == OT_HTTP) || (ORIG_TYPE == OT_WHOIS);
   } else {
     if (errno)
       warn("%s: -L%.*s...", IPINFO_STR, LIM_CHARS, args[0]);
@@ -1003,8 +1598,10 @@ bool ipinfo_init(const char *arg) {
     return false;
   }
   itemname_max = 0;
-  while (ORIG_NAME(itemname_max))
-    itemname_max++;
+  route_no = -1;
+  for (; ORIG_NAME(itemname_max); itemname_max++)
+    if (STR_EQ(ORIG_NAME(itemname_max), _II_ROUTE_STR, NAMELEN))
+      route_no = itemname_max;
   //
   uint j = 0;
   for (uint i = 1; args[i] && (i < ARRAY_LEN(args)) && (j < ARRAY_LEN(args) - 1); i++) {
@@ -1100,11 +1697,9 @@ void query_ipinfo(void) {
     for (int at = net_min(); at < max; at++) {
       if (addr_exist(&CURRENT_IP(at))) {
         query_iiaddr(at, host[at].current);
-        for (int i = 0; i < MAXPATH; i++) {
-          if ((i != host[at].current) // already queried
-              && addr_exist(&IP_AT_NDX(at, i)))
+        for (int i = 0; i < PATHS_AT(at); i++)
+          if (i != host[at].current) // already queried
             query_iiaddr(at, i);
-        }
       }
     }
   }
@@ -44,6 +44,7 @@ void query_ipinfo(void);
 extern bool ipinfo_tcpmode;
 extern uint ipinfo_queries[];
 extern uint ipinfo_replies[];
+extern uint ipinfo_shared[];
 extern bool ipinfo_rewidth;
 extern bool ipinfo_ready;
 
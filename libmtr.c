@@ -0,0 +1,259 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+
+#include "common.h"
+#include "libmtr.h"
+#include "net.h"
+#include "nls.h"
+#include "polling.h"
+#ifdef ENABLE_DNS
+#include "dns.h"
+#endif
+
+//// engine globals
+int mtrtype = IPPROTO_ICMP;   // ICMP as default packet type
+pid_t mypid;
+int sum_sock[2];              // socket summary: open()/close() calls
+display_mode_t display_mode = DisplayAuto;
+
+opt_sum_t opt_sum;  // checksum options' changes
+
+opts_t run_opts;    // runtime options
+opts_t ini_opts = { // initial bool options
+  .interactive = true,
+  .dns      = true,           // dns is on by default
+  .minttl   =  1,             // start at first hop
+  .maxttl   = 30,             // supposedly enough for today's internet
+  .cycles   = REPORT_PINGS,   // note that 0 should be set explicitly
+  .interval =  1,             // in seconds
+  .size     = PAYLOAD_SIZE,   // 64 ip payload - 8 byte header
+  .syn      = MIL,            // in ms (tcp timeout)
+  .cache    = CACHE_TIMEOUT,  // in seconds (cache timeout)
+  .flow     = -1,             // no flow-stable probing
+  .port     = -1,             // port from 'target:port' in tcp/udp mode
+};
+
+t_stat stats[] = {
+  {.name = "",      .min = 1, .key = UNDERSCORE, .hint = _GAP_HINT},
+  {.name = _LOSS_STR,  .min = 6, .key = 'L', .hint = _LOSS_HINT},
+  {.name = _DROP_STR,  .min = 5, .key = 'D', .hint = _DROP_HINT},
+  {.name = _RECV_STR,  .min = 6, .key = 'R', .hint = _RECV_HINT},
+  {.name = _SENT_STR,  .min = 6, .key = 'S', .hint = _SENT_HINT},
+  {.name = _LAST_STR,  .min = 6, .key = 'N', .hint = _LAST_HINT},
+  {.name = _BEST_STR,  .min = 6, .key = 'B', .hint = _BEST_HINT},
+  {.name = _AVRG_STR,  .min = 6, .key = 'A', .hint = _AVRG_HINT},
+  {.name = _WRST_STR,  .min = 6, .key = 'W', .hint = _WRST_HINT},
+  {.name = _STDEV_STR, .min = 6, .key = 'V', .hint = _STDEV_HINT},
+  {.name = _GAVR_STR,  .min = 6, .key = 'G', .hint = _GAVR_HINT},
+  {.name = _JTTR_STR,  .min = 5, .key = 'J', .hint = _JTTR_HINT},
+  {.name = _JAVG_STR,  .min = 5, .key = 'M', .hint = _JAVG_HINT},
+  {.name = _JMAX_STR,  .min = 5, .key = 'X', .hint = _JMAX_HINT},
+  {.name = _JINT_STR,  .min = 5, .key = 'I', .hint = _JINT_HINT},
+};
+const int stat_max = ARRAY_LEN(stats);
+//// end-of-global
+
+struct mtr_ctx {
+  mtr_cb_t cb;
+  bool started;
+};
+
+static mtr_ctx_t *active; // the only one, engine state is process-wide
+
+#define ADDR_AT_NDX(at, ndx, str) addr2str(&IP_AT_NDX((at), (ndx)), sizeof(str), (str))
+
+static void lib_reply(int at, int ndx, int usec) {
+  if (active && active->cb.reply) {
+    char str[MAX_ADDRSTRLEN] = {0};
+    active->cb.reply(active->cb.arg, at, ADDR_AT_NDX(at, ndx, str), usec);
+  }
+}
+
+static void lib_newhop(int at, int ndx) {
+  if (active && active->cb.newhop) {
+    char str[MAX_ADDRSTRLEN] = {0};
+    active->cb.newhop(active->cb.arg, at, ADDR_AT_NDX(at, ndx, str));
+  }
+}
+
+static void lib_resolved(int at, int ndx) {
+  if (active && active->cb.resolved) {
+    char str[MAX_ADDRSTRLEN] = {0};
+    active->cb.resolved(active->cb.arg, at, ADDR_AT_NDX(at, ndx, str), RPTR_AT_NDX(at, ndx));
+  }
+}
+
+static void lib_cycle(long count) {
+  if (active && active->cb.cycle)
+    active->cb.cycle(active->cb.arg, count);
+}
+
+static void lib_hooks(bool set) {
+  net_reply_fn    = set ? lib_reply    : NULL;
+  net_newhop_fn   = set ? lib_newhop   : NULL;
+  net_resolved_fn = set ? lib_resolved : NULL;
+  poll_cycle_fn   = set ? lib_cycle    : NULL;
+#ifdef ENABLE_DNS
+  eachpass_fn     = set ? backresolv_lookups : NULL;
+#endif
+}
+
+mtr_ctx_t *mtr_new(const mtr_cb_t *cb) {
+  if (active) {
+    errno = EBUSY;
+    return NULL;
+  }
+  mtr_ctx_t *ctx = calloc(1, sizeof(*ctx));
+  if (!ctx)
+    return NULL;
+  net_assert();
+  if (!net_open()) {
+    free(ctx);
+    if (!errno)
+      errno = EPERM;
+    return NULL;
+  }
+  mypid = getpid();
+  if (cb)
+    ctx->cb = *cb;
+  active = ctx;
+  lib_hooks(true);
+  return ctx;
+}
+
+// take the first suitable address: ipv4 first unless family is given
+static bool lib_target(const char *target, int family) {
+  struct addrinfo hints = { .ai_family = family, .ai_socktype = SOCK_DGRAM }, *res = NULL;
+  int rc = getaddrinfo(target, NULL, &hints, &res);
+  if (rc) {
+    if (rc != EAI_SYSTEM)
+      errno = EADDRNOTAVAIL;
+    return false;
+  }
+  const struct addrinfo *ai = NULL;
+  for (ai = res; ai; ai = ai->ai_next) if (ai->ai_family == AF_INET) break;
+#ifdef ENABLE_IPV6
+  if (!ai)
+    for (ai = res; ai; ai = ai->ai_next) if (ai->ai_family == AF_INET6) break;
+#endif
+  bool okay = false;
+  if (ai) {
+    if (af != ai->ai_family) {
+      af = ai->ai_family;
+      net_settings((af == AF_INET6) ? IPV6_ENABLED : IPV6_DISABLED);
+    }
+#ifdef ENABLE_IPV6
+    if (af == AF_INET6)
+      net_setsock6();
+#endif
+    const t_ipaddr *addr =
+#ifdef ENABLE_IPV6
+      (af == AF_INET6) ? (t_ipaddr*)&((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr :
+#endif
+      (t_ipaddr*)&((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+    okay = net_set_host(addr);
+  } else
+    errno = EAFNOSUPPORT;
+  freeaddrinfo(res);
+  return okay;
+}
+
+bool mtr_start(mtr_ctx_t *ctx, const char *target, const mtr_params_t *params) {
+  if (!ctx || (ctx != active) || !target) {
+    errno = EINVAL;
+    return false;
+  }
+  mtr_stop(ctx);
+  run_opts = ini_opts;
+  run_opts.interactive = false;
+  int proto = IPPROTO_ICMP, family = AF_UNSPEC;
+  if (params) {
+    if (params->proto)
+      proto = params->proto;
+    family = params->family;
+    if (params->cycles)
+      run_opts.cycles = (params->cycles > 0) ? params->cycles : 0;
+    if (params->interval > 0)
+      run_opts.interval = params->interval;
+    if ((params->maxttl > 0) && (params->maxttl <= MAXHOST))
+      run_opts.maxttl = params->maxttl;
+    if (params->nodns)
+      run_opts.dns = false;
+  }
+  if ((proto != IPPROTO_ICMP) && (proto != IPPROTO_UDP) && (proto != IPPROTO_TCP)) {
+    errno = EPROTONOSUPPORT;
+    return false;
+  }
+  run_opts.udp = (proto == IPPROTO_UDP);
+  run_opts.tcp = (proto == IPPROTO_TCP);
+  net_set_type(proto);
+  if (!lib_target(target, family))
+    return false;
+#ifdef ENABLE_DNS
+  if (run_opts.dns)
+    dns_open();
+#endif
+  ctx->started = poll_start();
+  return ctx->started;
+}
+
+int mtr_fds(mtr_ctx_t *ctx, const struct pollfd **fds) {
+  return (ctx && ctx->started) ? poll_fds(fds) : 0;
+}
+
+int mtr_timeout(mtr_ctx_t *ctx) {
+  return (ctx && ctx->started) ? poll_next() : -1;
+}
+
+bool mtr_poll(mtr_ctx_t *ctx) {
+  return ctx && ctx->started && poll_events(0);
+}
+
+void mtr_stop(mtr_ctx_t *ctx) {
+  if (ctx && ctx->started) {
+    poll_stop();
+    net_end_transit();
+    ctx->started = false;
+  }
+}
+
+void mtr_free(mtr_ctx_t *ctx) {
+  if (!ctx || (ctx != active))
+    return;
+  mtr_stop(ctx);
+  lib_hooks(false);
+#ifdef ENABLE_DNS
+  dns_close();
+#endif
+  net_close();
+  active = NULL;
+  free(ctx);
+}
+
+int mtr_hops(const mtr_ctx_t *ctx) {
+  return (ctx && (ctx == active)) ? net_max() : 0;
+}
+
+const char *mtr_stat(const mtr_ctx_t *ctx, int hop, char key) {
+  return ((hop >= 0) && (hop < mtr_hops(ctx))) ? net_elem(hop, key) : NULL;
+}
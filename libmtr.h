@@ -0,0 +1,69 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef LIBMTR_H
+#define LIBMTR_H
+
+// Tracing engine of mtr for embedding into other programs.
+// Engine state is process-wide: only one context can exist at a time.
+// Static libmtr.a needs the engine's libraries at link time: -lm, -lresolv with DNS,
+// -lcap with CAP (and -lrt for shm_open() on older libc); installed libmtr.pc has them:
+//   cc app.c $(pkg-config --cflags --libs --static libmtr)
+
+#include <poll.h>
+#include <stdbool.h>
+
+typedef struct mtr_ctx mtr_ctx_t;
+
+// event callbacks, any of them can be NULL
+typedef struct mtr_cb {
+  void (*reply)(void *arg, int hop, const char *addr, int usec);   // reply from 'addr' at 'hop'
+  void (*newhop)(void *arg, int hop, const char *addr);            // new address at 'hop'
+  void (*resolved)(void *arg, int hop, const char *addr, const char *name);
+  void (*cycle)(void *arg, long count);                            // probes of a cycle are sent
+  void *arg;
+} mtr_cb_t;
+
+// trace parameters, zero means default
+typedef struct mtr_params {
+  int proto;    // IPPROTO_ICMP (default), IPPROTO_UDP, IPPROTO_TCP
+  int family;   // AF_INET, AF_INET6, or AF_UNSPEC (default: ipv4 first)
+  int cycles;   // number of cycles (default 100), negative for endless
+  int interval; // between cycles, in seconds (default 1)
+  int maxttl;   // hops to probe (default 30)
+  bool nodns;   // don't resolve hop addresses
+} mtr_params_t;
+
+// open sockets (raw ones need privileges), NULL with errno on failure
+mtr_ctx_t *mtr_new(const mtr_cb_t *cb);
+// resolve target and start tracing, 'params' can be NULL
+bool mtr_start(mtr_ctx_t *ctx, const char *target, const mtr_params_t *params);
+// descriptors to watch for POLLIN/POLLOUT (skip negative ones), they change after every call below
+int  mtr_fds(mtr_ctx_t *ctx, const struct pollfd **fds);
+// send due probes, return msec to wait before mtr_poll(), or -1 when the trace is done
+int  mtr_timeout(mtr_ctx_t *ctx);
+// work out ready descriptors, return false on failure
+bool mtr_poll(mtr_ctx_t *ctx);
+void mtr_stop(mtr_ctx_t *ctx);
+void mtr_free(mtr_ctx_t *ctx);
+
+// hops up to the target, and a statistics field of them (keys as in 'mtr -o')
+int  mtr_hops(const mtr_ctx_t *ctx);
+const char *mtr_stat(const mtr_ctx_t *ctx, int hop, char key);
+
+#endif
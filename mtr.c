@@ -101,6 +101,7 @@ enum OPTIONS {
   OPT_IPV6     = '6',
 #endif
   OPT_ADDR     = 'a',
+  OPT_PROTOS   = 'A',
 #ifdef ENABLE_DNS
   OPT_BOTH     = 'b',
 #endif
@@ -109,13 +110,22 @@ enum OPTIONS {
 #ifdef TUIMODE
   OPT_DISPLAY  = 'd',
 #endif
+#ifdef WITH_DGRAM
+  OPT_DGRAM    = 'D',
+#endif
 #ifdef WITH_MPLS
   OPT_MPLS     = 'e',
+#endif
+#ifdef WITH_EVRING
+  OPT_EVENTS   = 'E',
 #endif
   OPT_TTLFIRST = 'f',
   OPT_FIELDS   = 'F',
   OPT_HELP     = 'h',
+  OPT_HISTORY  = 'H',
   OPT_INTERVAL = 'i',
+  OPT_FLOW     = 'k',
+  OPT_MDA      = 'K',
 #ifdef WITH_IPINFO
   OPT_LOOKUP   = 'l',
   OPT_IPINFO   = 'L',
@@ -134,10 +144,14 @@ enum OPTIONS {
 #ifdef SPLITMODE
   OPT_SPLIT    = 'p',
 #endif
+  OPT_REPLAY   = 'P',
 #ifdef IP_TOS
   OPT_QOS      = 'q',
 #endif
   OPT_REPORT   = 'r',
+#ifdef WITH_RING
+  OPT_RING     = 'R',
+#endif
   OPT_SIZE     = 's',
   OPT_SUMMARY  = 'S',
   OPT_TCP      = 't',
@@ -148,6 +162,8 @@ enum OPTIONS {
 #ifdef WITH_IPINFO
   OPT_MULTI_II = 'y',
 #endif
+  OPT_BROKER   = 'z',
+  OPT_SERVE    = 'Z',
 };
 
 enum TTL_OPTS {
@@ -178,6 +194,8 @@ enum OUTPUT_OPTS {
 #endif
 
 #include "aux.h"
+#include "broker.h"
+#include "intern.h"
 #include "net.h"
 #include "display.h"
 
@@ -189,15 +207,19 @@ enum OUTPUT_OPTS {
 #include "ipinfo.h"
 #endif
 
+#ifdef WITH_EVRING
+#include "evring.h"
+#endif
+#include "history.h"
+#include "replay.h"
+
 #ifdef OUTPUT_FORMAT_RAW
 #include "report.h"
 #endif
 
-enum { REPORT_PINGS = 100, CACHE_TIMEOUT = 60, TCPSYN_TOUT_MAX = 60 };
+enum { TCPSYN_TOUT_MAX = 60 };
 
 //// global vars
-int mtrtype = IPPROTO_ICMP;   // ICMP as default packet type
-pid_t mypid;
 char mtr_args[128];           // args to display in curses title
 #if defined(OUTPUT_FORMAT_JSON) || defined(OUTPUT_FORMAT_TOON)
 #define OUTPUT_OPTV
@@ -210,50 +232,13 @@ uint mtr_optc;
 int tuilook = OLDLOOK;
 #endif
 
-opt_sum_t opt_sum;  // checksum options' changes
-
-opts_t run_opts;    // runtime options
-opts_t ini_opts = { // initial bool options
-  .interactive = true,
-  .dns      = true,           // dns is on by default
-  .minttl   =  1,             // start at first hop
-  .maxttl   = 30,             // supposedly enough for today's internet
-  .cycles   = REPORT_PINGS,   // note that 0 should be set explicitly
-  .interval =  1,             // in seconds
-  .size     = PAYLOAD_SIZE,   // 64 ip payload - 8 byte header
-  .syn      = MIL,            // in ms (tcp timeout)
-  .cache    = CACHE_TIMEOUT,  // in seconds (cache timeout)
-  .port     = -1,             // port from 'target:port' in tcp/udp mode
-};
-
 #ifdef ENABLE_IPV6
 static bool af_specified;     // set with -4/-6 options
 #endif
-int sum_sock[2];              // socket summary: open()/close() calls
 
-//
 #ifdef WITH_UNICODE
 bool utf_compat;
 #endif
-//
-t_stat stats[] = {
-  {.name = "",      .min = 1, .key = UNDERSCORE, .hint = _GAP_HINT},
-  {.name = _LOSS_STR,  .min = 6, .key = 'L', .hint = _LOSS_HINT},
-  {.name = _DROP_STR,  .min = 5, .key = 'D', .hint = _DROP_HINT},
-  {.name = _RECV_STR,  .min = 6, .key = 'R', .hint = _RECV_HINT},
-  {.name = _SENT_STR,  .min = 6, .key = 'S', .hint = _SENT_HINT},
-  {.name = _LAST_STR,  .min = 6, .key = 'N', .hint = _LAST_HINT},
-  {.name = _BEST_STR,  .min = 6, .key = 'B', .hint = _BEST_HINT},
-  {.name = _AVRG_STR,  .min = 6, .key = 'A', .hint = _AVRG_HINT},
-  {.name = _WRST_STR,  .min = 6, .key = 'W', .hint = _WRST_HINT},
-  {.name = _STDEV_STR, .min = 6, .key = 'V', .hint = _STDEV_HINT},
-  {.name = _GAVR_STR,  .min = 6, .key = 'G', .hint = _GAVR_HINT},
-  {.name = _JTTR_STR,  .min = 5, .key = 'J', .hint = _JTTR_HINT},
-  {.name = _JAVG_STR,  .min = 5, .key = 'M', .hint = _JAVG_HINT},
-  {.name = _JMAX_STR,  .min = 5, .key = 'X', .hint = _JMAX_HINT},
-  {.name = _JINT_STR,  .min = 5, .key = 'I', .hint = _JINT_HINT},
-};
-const int stat_max = ARRAY_LEN(stats);
 //// end-of-global
 
 static struct option long_options[] = {
@@ -268,6 +253,7 @@ static struct option long_options[] = {
   {"inet6",      0, 0, OPT_IPV6},     // use IPv6
 #endif
   {"address",    1, 0, OPT_ADDR},
+  {"protocols",  1, 0, OPT_PROTOS},   // probe with several protocols at once
 #ifdef ENABLE_DNS
   {"show-both",  0, 0, OPT_BOTH},
 #endif
@@ -276,13 +262,22 @@ static struct option long_options[] = {
 #ifdef TUIMODE
   {"display",    1, 0, OPT_DISPLAY},
 #endif
+#ifdef WITH_DGRAM
+  {"dgram",      0, 0, OPT_DGRAM},    // unprivileged datagram sockets instead of raw ones
+#endif
 #ifdef WITH_MPLS
   {"mpls",       0, 0, OPT_MPLS},
+#endif
+#ifdef WITH_EVRING
+  {"events",     1, 0, OPT_EVENTS},   // publish probe events in shared memory
 #endif
   {"first-ttl",  1, 0, OPT_TTLFIRST}, // borrowed from traceroute
   {"fields",     1, 0, OPT_FIELDS},   // fields to display and their order
   {"help",       0, 0, OPT_HELP},
+  {"history",    1, 0, OPT_HISTORY},  // record per-hop history into file
   {"interval",   1, 0, OPT_INTERVAL},
+  {"flow",       1, 0, OPT_FLOW},     // keep 5-tuple of probes (paris-traceroute)
+  {"mda",        1, 0, OPT_MDA},      // enumerate paths with given confidence
 #ifdef WITH_IPINFO
   {"lookup",     0, 0, OPT_LOOKUP},
   {"ipinfo",     1, 0, OPT_IPINFO},
@@ -301,11 +296,15 @@ static struct option long_options[] = {
 #ifdef SPLITMODE
   {"split",      0, 0, OPT_SPLIT},
 #endif
+  {"replay",     1, 0, OPT_REPLAY},   // replay recorded raw output instead of probing
 #ifdef IP_TOS
   {"tos",        1, 0, OPT_QOS},      // type-of-service (0..255)
                                       // quality-of-service
 #endif
   {"report",     0, 0, OPT_REPORT},
+#ifdef WITH_RING
+  {"ring",       0, 0, OPT_RING},     // read replies from AF_PACKET mmap ring
+#endif
   {"psize",      1, 0, OPT_SIZE},     // payload size
   {"summary",    0, 0, OPT_SUMMARY},  // print send/recv summary at exit
   {"tcp",        0, 0, OPT_TCP},      // TCP (note: default is ICMP)
@@ -318,16 +317,20 @@ static struct option long_options[] = {
   {"multi",      0, 0, OPT_MULTI_II}, // show ipinfo-records for all sources
                                       // otherwise it's marked with '*' character
 #endif
+  {"broker",     1, 0, OPT_BROKER},   // send probes via broker's unix socket
+  {"serve",      1, 0, OPT_SERVE},    // be a broker for unprivileged clients
   { 0, 0, 0, 0 }
 };
 static char *short_options;
 
 char srchost[NAMELEN];
 const char *dsthost;
-display_mode_t display_mode = DisplayAuto;
 //
 
 static const char *iface_addr;
+static const char *serve_path; // -Z
+static const char *hist_arg;   // -H
+static const char *replay_arg; // -P
 //
 
 // If the file stream is associated with a regular file, lock/unlock the file
@@ -386,16 +389,26 @@ static const char *get_opt_desc(char opt) {
 #ifdef IP_TOS
     case OPT_QOS:
 #endif
-    case OPT_BITS:    return STR_NUMBER;
+    case OPT_BITS:
+    case OPT_FLOW:    return STR_NUMBER;
+    case OPT_MDA:     return STR_PERCENT;
     case OPT_INTERVAL:
     case OPT_CACHE:
     case OPT_TIMEOUT: return STR_IN_SECONDS;
     case OPT_ADDR:    return STR_IP_ADDRESS;
+    case OPT_PROTOS:  return STR_PROTOS;
     case OPT_COUNT:   return STR_COUNT;
 #ifdef TUIMODE
     case OPT_DISPLAY: return STR_MODE;
 #endif
     case OPT_SIZE:    return STR_IN_BYTES;
+    case OPT_BROKER:
+    case OPT_SERVE:   return STR_SOCKET;
+#ifdef WITH_EVRING
+    case OPT_EVENTS:  return STR_NAME;
+#endif
+    case OPT_HISTORY:
+    case OPT_REPLAY:  return STR_FILE;
     case OPT_FIELDS:  return STR_FIELDS;
 #ifdef WITH_IPINFO
     case OPT_IPINFO:  return STR_IP_INFO;
@@ -543,11 +556,11 @@ static inline void option_fields(char opt) {
   if (strnlen(optarg, MAXFLD + 1) > MAXFLD)
     errx(EINVAL, "-%c: %s (%s=%d): %s", opt, OVERFLD_ERR, MAX_STR, MAXFLD, optarg);
   for (char *c = optarg; c && *c; c++) {
-    uint cnt = 0;
-    for (; cnt < ARRAY_LEN(stats); cnt++)
+    int cnt = 0;
+    for (; cnt < stat_max; cnt++)
       if (*c == stats[cnt].key)
         break;
-    if (cnt >= ARRAY_LEN(stats))
+    if (cnt >= stat_max)
       errx(EINVAL, "-%c: %s: %c", opt, UNKNFLD_ERR, *c);
   }
   set_fld_active(optarg);
@@ -657,6 +670,29 @@ static void set_optv(int argc, char **argv) {
 }
 #endif
 
+static int protos[MAXLANE], nproto; // -A list
+
+static void set_protos(char opt, const char *arg) {
+  nproto = 0;
+  for (const char *str = arg; *str;) {
+    size_t len = strcspn(str, ",");
+    int proto = ((len == 4) && !strncasecmp(str, "icmp", len)) ? IPPROTO_ICMP :
+                ((len == 3) && !strncasecmp(str, "udp",  len)) ? IPPROTO_UDP  :
+                ((len == 3) && !strncasecmp(str, "tcp",  len)) ? IPPROTO_TCP  : -1;
+    for (int i = 0; (proto >= 0) && (i < nproto); i++)
+      if (protos[i] == proto)
+        proto = -1; // twice
+    if ((proto < 0) || (nproto >= MAXLANE))
+      errx(EINVAL, "-%c: %s: %.*s: %s", opt, PROTOS_STR, (int)len, str, strerror(EINVAL));
+    protos[nproto++] = proto;
+    str += len;
+    if (*str)
+      str++;
+  }
+  if (!nproto)
+    errx(EINVAL, "-%c: %s: %s", opt, PROTOS_STR, strerror(EINVAL));
+}
+
 static void short_set(char opt, const char *progname) {
   switch (opt) {
 #ifdef TUIMODE
@@ -679,6 +715,10 @@ static void short_set(char opt, const char *progname) {
       if (optarg)
         iface_addr = optarg;
       break;
+    case OPT_PROTOS:
+      if (optarg)
+        set_protos(opt, optarg);
+      break;
 #ifdef ENABLE_DNS
     case OPT_BOTH:
       ini_opts.both = true;
@@ -698,6 +738,12 @@ static void short_set(char opt, const char *progname) {
         option_display(opt, optarg);
       break;
 #endif
+#ifdef WITH_DGRAM
+    case OPT_DGRAM:
+      if (!net_dgram && !net_open_dgram())
+        errx(EXIT_FAILURE, "%s", NODGRAM_ERR);
+      break;
+#endif
 #ifdef WITH_MPLS
     case OPT_MPLS:
       ini_opts.mpls = true;
@@ -717,6 +763,14 @@ static void short_set(char opt, const char *progname) {
       if (optarg)
         ini_opts.interval = arg2int(opt, optarg, 1, INT_MAX, INTERVAL_STR, NULL, 0);
       break;
+    case OPT_FLOW:
+      if (optarg)
+        ini_opts.flow = arg2int(opt, optarg, 0, MAXFLOW - 1, FLOWID_STR, NULL, 0);
+      break;
+    case OPT_MDA:
+      if (optarg)
+        ini_opts.mda = arg2int(opt, optarg, MDA_MINCONF, MDA_MAXCONF, MDACONF_STR, NULL, 0);
+      break;
     case OPT_TTLMAX:
       if (optarg)
         ini_opts.maxttl = arg2int(opt, optarg, ini_opts.minttl, MAXHOST - 1, MAXTTL_STR, NULL, 0);
@@ -758,6 +812,19 @@ static void short_set(char opt, const char *progname) {
       if (ini_opts.cycles <= 0)
         ini_opts.cycles = REPORT_PINGS;
       break;
+#ifdef WITH_RING
+    case OPT_RING:
+      if (!net_ring && !net_open_ring())
+        err(EXIT_FAILURE, "%s", NORING_ERR);
+      break;
+#endif
+#ifdef WITH_EVRING
+    case OPT_EVENTS:
+      evring_close(); // the last one is used
+      if (!evring_open(optarg))
+        errx(EXIT_FAILURE, "%s: %s", EVRING_ERR, optarg);
+      break;
+#endif
     case OPT_SIZE: if (optarg) {
       int max = MAXPACKET - MINPACKET;
       ini_opts.size = arg2int(opt, optarg, -max, max, PSIZE_STR, NULL, 0);
@@ -804,6 +871,19 @@ static void short_set(char opt, const char *progname) {
       ini_opts.multi = true;
       break;
 #endif
+    case OPT_BROKER:
+      if (optarg && !net_open_broker(optarg))
+        err(EXIT_FAILURE, "%s: %s", BROKER_ERR, optarg);
+      break;
+    case OPT_SERVE:
+      serve_path = optarg;
+      break;
+    case OPT_HISTORY:
+      hist_arg = optarg;
+      break;
+    case OPT_REPLAY:
+      replay_arg = optarg;
+      break;
     default:
       usage(progname);
       exit((opt == OPT_HELP) ? EXIT_SUCCESS : EXIT_FAILURE);
@@ -843,6 +923,24 @@ static void parse_options(int argc, char **argv) {
     ini_opts.mouse = false;
   }
 #endif
+  if (nproto) {
+    if (ini_opts.udp || ini_opts.tcp)
+      errx(EINVAL, "%s: -%c -%c", MUTEXCL_ERR, OPT_PROTOS, ini_opts.udp ? OPT_UDP : OPT_TCP);
+    if (replay_arg)
+      errx(EINVAL, "%s: -%c -%c", MUTEXCL_ERR, OPT_PROTOS, OPT_REPLAY);
+    if (!net_set_lanes(nproto, protos))
+      err(EXIT_FAILURE, "-%c", OPT_PROTOS);
+    ini_opts.udp = (protos[0] == IPPROTO_UDP);
+    ini_opts.tcp = (protos[0] == IPPROTO_TCP);
+  }
+  if (((ini_opts.flow >= 0) || ini_opts.mda) && net_proto_on(IPPROTO_TCP))
+    warnx("%s", TCPFLOW_WARN);
+  if (replay_arg) switch (display_mode) { // replay is not interactive
+    case DisplayAuto:
+    case DisplayTUI:
+    case DisplaySplit: display_mode = DisplayReport; break;
+    default: break;
+  }
   run_opts = ini_opts; // to reflect possible interactive changes
   for (int i = 1, len = 0; (i < optind) && (i < argc) && argv[i] && ((uint)len < sizeof(mtr_args)); i++) {
     int inc = snprinte(mtr_args + len, sizeof(mtr_args) - len, (i > 1) ? " %s" : "%s", argv[i]);
@@ -1041,6 +1139,19 @@ static void resolv_with_port(t_res_rc *rr) {
     warnx("%s: %s", PARSE_ERR, buff);
 }
 
+// usec with fraction
+#define LAT_USEC(nsec) ((nsec) / (double)MIL)
+
+static void stat_lat(void) {
+  for (int i = 0; i < LAT_MAX; i++) {
+    const lathist_t *lat = &loop_lat[i];
+    if (lat->count)
+      printf("LOOP: %s %lu, avg %.1fus, p50 %.1fus, p99 %.1fus, max %.1fus\n", lat_name[i],
+        (unsigned long)lat->count, LAT_USEC((double)lat->sum / lat->count),
+        LAT_USEC(lat_pct(lat, 50)), LAT_USEC(lat_pct(lat, 99)), LAT_USEC(lat->max));
+  }
+}
+
 static inline void stat_fin(void) {
   printf("SOCKET: %u %s, %u %s\n", sum_sock[0], OPENED_STR, sum_sock[1], CLOSED_STR);
   printf("NET: %lu %s (%lu icmp, %lu udp, %lu tcp), %lu %s (%lu icmp, %lu udp, %lu tcp)\n",
@@ -1051,11 +1162,27 @@ static inline void stat_fin(void) {
     dns_queries[0], QUERIES_STR, dns_queries[1], dns_queries[2],
     dns_replies[0], REPLIES_STR, dns_replies[1], dns_replies[2]);
 #endif
+#ifdef WITH_RING
+  if (net_ring_stat[0])
+    printf("RING: %lu %s, %lu %s\n", net_ring_stat[0], RPACKETS_STR, net_ring_stat[1], DROPS_STR);
+#endif
+#ifdef WITH_EVRING
+  if (evring_count())
+    printf("EVENTS: %llu %s\n", (unsigned long long)evring_count(), PUBLISHED_STR);
+#endif
+  printf("STRINGS: %zu %s (%zu %s), %zu %s\n", intern_count[0], INTERNED_STR, intern_count[1], LOOKUPS_STR,
+    intern_bytes, BYTES_STR);
 #ifdef WITH_IPINFO
   printf("IPINFO: %u %s (%u http, %u whois), %u %s (%u http, %u whois)\n",
     ipinfo_queries[0], QUERIES_STR, ipinfo_queries[1], ipinfo_queries[2],
     ipinfo_replies[0], REPLIES_STR, ipinfo_replies[1], ipinfo_replies[2]);
+  if (ipinfo_shared[1]) {
+    uint lookups = ipinfo_shared[0] + ipinfo_replies[0];
+    printf("IPINFO: %u %s by %u %s (%u%% hits)\n", ipinfo_shared[0], SHARED_STR, ipinfo_shared[1], PREFIXES_STR,
+      lookups ? (ipinfo_shared[0] * 100 / lookups) : 0);
+  }
 #endif
+  stat_lat();
 }
 
 static inline void main_prep(int argc, char **argv) {
@@ -1064,15 +1191,23 @@ static inline void main_prep(int argc, char **argv) {
 #ifndef HAVE_ARC4RANDOM_UNIFORM
   srand(mypid); // reset random seed
 #endif
-  for (uint i = 0; i < ARRAY_LEN(stats); i++)
+  for (int i = 0; i < stat_max; i++)
     fld_index[(uint8_t)stats[i].key] = i;
   set_fld_active(NULL);
   parse_options(argc, argv);
-  if (optind >= argc) {
+  if (serve_path) // broker without targets
+    exit(broker_serve(serve_path) ? EXIT_SUCCESS : EXIT_FAILURE);
+  if ((optind >= argc) && hist_arg && !replay_arg) // dump history without targets
+    exit(hist_dump(hist_arg) ? EXIT_SUCCESS : EXIT_FAILURE);
+  if (replay_arg && !replay_open(replay_arg))
+    errx(EXIT_FAILURE, "%s: %s", REPLAY_ERR, replay_arg);
+  if ((optind >= argc) && !replay_arg) {
     // TODO: set target at runtime
     usage(argv[0]);
     exit(EXIT_SUCCESS);
   }
+  if (hist_arg && !replay_arg && !hist_open(hist_arg))
+    errx(EXIT_FAILURE, "%s: %s", HISTORY_ERR, hist_arg);
 #ifdef WITH_SYSLOG
   openlog(PACKAGE_NAME, LOG_PID, LOG_USER);
 #endif
@@ -1080,7 +1215,7 @@ static inline void main_prep(int argc, char **argv) {
   net_setsock6();
 #endif
 #ifdef ENABLE_DNS
-  if (run_opts.dns)
+  if (run_opts.dns && !replay_arg) // names are recorded
     dns_open();
 #endif
   if (gethostname(srchost, sizeof(srchost)))
@@ -1097,11 +1232,13 @@ static inline int main_loop(struct addrinfo *ai, bool fin) {
     if (!rc) {
       TOS4TOS(dsthost, run_opts.qos);
       locker(stdout, F_WRLCK);
+      hist_target();
       if (display_open())
         display_loop();
       else
         warnx("%s", OPENDISP_ERR);
       net_end_transit();
+      hist_flush();
       if (fin)
         display_confirm_fin();
       display_close(next_target);
@@ -1129,11 +1266,32 @@ static inline void main_fin(void) {
 #endif
   if (run_opts.stat)
     stat_fin();
+#ifdef WITH_EVRING
+  evring_close();
+#endif
+  hist_close();
   if (strerr_txt[0] && (display_mode == DisplayTUI))
     warnx("%s", strerr_txt); // duplicate an error cleaned by ncurses
   UNICODE_FREE;
 }
 
+// report of every target in recorded stream, return: failed or not
+static int main_replay(void) {
+  static char target[MAX_ADDRSTRLEN];
+  bool next = false;
+  int rc;
+  locker(stdout, F_WRLCK);
+  while ((rc = replay_next(sizeof(target), target)) > 0) {
+    dsthost = target;
+    net_end_transit();
+    display_close(next);
+    next = true;
+  }
+  locker(stdout, F_UNLCK);
+  replay_close();
+  return (rc < 0) ? 1 : 0;
+}
+
 // return: failed or not
 static int resolv_n_ping(int port, bool fin) {
   tgterr_txt[0] = 0;    // clear per target error message
@@ -1163,7 +1321,7 @@ static int resolv_n_ping(int port, bool fin) {
 }
 
 int main(int argc, char **argv) {
-  // get raw sockets
+  // get raw sockets (or datagram ones if raw are not permitted)
   if (!net_open())
     errx(EXIT_FAILURE, "%s", RAWSOCK_ERR);
   // drop permissions if that's set
@@ -1177,7 +1335,7 @@ int main(int argc, char **argv) {
     errx(EXIT_FAILURE, "%s", DROPCAP_ERR);
 #endif
   UNICODE_INIT;
-  for (uint i = 0; i < ARRAY_LEN(stats); i++) {
+  for (int i = 0; i < stat_max; i++) {
     if (stats[i].name && stats[i].name[0]) {
       stats[i].name  = _(stats[i].name);
       stats[i].len   = ustrnlen(stats[i].name, NAMELEN);
@@ -1191,8 +1349,8 @@ int main(int argc, char **argv) {
   main_prep(argc, argv);
   //
   int port = ini_opts.port;
-  int ec = 0;
-  for (int ndx = optind; (ndx < argc) && argv[ndx];) {
+  int ec = replay_arg ? main_replay() : 0;
+  for (int ndx = optind; !replay_arg && (ndx < argc) && argv[ndx];) {
     dsthost = argv[ndx++]; // there's ++
     int rc = resolv_n_ping(port, ndx == argc);
     if (rc && !ec)
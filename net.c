@@ -46,18 +46,34 @@
 #include <netdb.h>
 #endif
 
+#ifdef HAVE_LINUX_FILTER_H
+#include <linux/filter.h>
+#endif
+
+#ifdef HAVE_LINUX_ERRQUEUE_H
+#include <time.h>
+#include <linux/errqueue.h>
+#endif
+
+#if defined(HAVE_LINUX_IF_PACKET_H) && defined(HAVE_LINUX_FILTER_H)
+#include <sys/mman.h>
+#include <netinet/icmp6.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#endif
+
 #include "net.h"
 #include "aux.h"
+#include "intern.h"
 #include "nls.h"
 #include "polling.h"
-#include "display.h"
+#include "broker.h"
 
 #ifdef ENABLE_DNS
 #include "dns.h"
 #endif
-
-#ifdef OUTPUT_FORMAT_RAW
-#include "report.h"
+#ifdef WITH_EVRING
+#include "evring.h"
 #endif
 
 #ifdef HAVE_ARC4RANDOM_UNIFORM
@@ -149,6 +165,12 @@ struct PACKIT icmpext_object { // RFC4884
 
 #define SET_UDP_UH_PORTS(uh, s, d) { (uh)->uh_sport = htons(s); (uh)->uh_dport = htons(d); }
 
+// Flow-stable probes keep fields that routers hash on: ports of udp probes, and
+// checksum of icmp ones. Udp sequence is then carried in checksum (nonzero).
+#define FLOWED (run_opts.mda || (run_opts.flow >= 0))
+#define SEQ2UDPSUM(seq) htons((seq) + 1)
+#define UDPSUM2SEQ(sum) (ntohs(sum) - 1)
+
 // NOTE: don't forget to include sys/param.h
 #if   defined(__FreeBSD_version)
   #if __FreeBSD_version >= 1100000
@@ -190,6 +212,8 @@ struct PACKIT icmpext_object { // RFC4884
 
 struct sequence {
   int at;
+  uint16_t id;  // prober's id
+  uint8_t flow; // in flow-stable modes
   bool transit;
   struct timespec time;
 #ifdef TUIMODE
@@ -207,7 +231,8 @@ bool  (*addr_exist)(const void *a) NONNULL(1) = addr4exist; // true unless 0
 bool  (*addr_equal)(const void *a, const void *b) NONNULL(1, 2) = addr4equal;
 void* (*addr_copy)(void *dst, const void *src) NONNULL(1, 2) = addr4copy;
 //
-nethost_t host[MAXHOST];
+static nethost_t host0[MAXHOST];
+nethost_t *host = host0;            // hop table of the current lane
 char localaddr[MAX_ADDRSTRLEN];
 //
        char strerr_txt[NAMELEN];     // any target
@@ -229,7 +254,8 @@ static uint16_t payloadsize = PAYLOAD_SIZE;
 bool reset_pattern = true;
 bool reset_pldsize = true;
 
-static struct sequence seqlist[MAXSEQ];
+static struct sequence seqlist0[MAXSEQ];
+static struct sequence *seqlist = seqlist0;
 
 static int sendsock4 = -1;
 static int recvsock4 = -1;
@@ -241,6 +267,26 @@ static int recvsock6 = -1;
 #endif
 static int sendsock = -1;
 static int recvsock = -1;
+#ifdef WITH_DGRAM
+bool net_dgram;                    // datagram sockets instead of raw ones
+static int sendsock4_icmp = -1;    // ping socket
+static int sendsock4_udp = -1;
+#endif
+bool net_broker;                   // probes are sent and received via broker
+// event hooks
+void (*net_reply_fn)(int at, int ndx, int usec);
+void (*net_newhop_fn)(int at, int ndx);
+void (*net_resolved_fn)(int at, int ndx);
+void (*net_sent_fn)(int at, int seq);
+bool (*net_xmit_fn)(int at, int seq);
+static int brokersock = -1;
+#ifdef WITH_RING
+enum { RING_BLOCK_SIZE = 1 << 17, RING_BLOCK_NR = 16, RING_FRAME_SIZE = 1 << 11, RING_BLOCK_TOV = 2 /*msec*/ };
+bool net_ring;                     // replies are read from AF_PACKET ring
+ulong net_ring_stat[2];            // packets and drops seen by ring
+static struct { uint8_t *map; uint blk; } ring;
+#endif
+static int ringsock = -1;          // opened with raw ones, it gets nothing till it's bound
 
 static t_sockaddr lsa, rsa; // losal and remote sockaddr
 static t_ipaddr *remote_ipaddr = (t_ipaddr*)&rsa.sin.sin_addr; // ip4 by default
@@ -254,12 +300,53 @@ static size_t iphdr_sz;
 static size_t sa_addr_offset;
 static socklen_t sa_len;
 
+static t_ipaddr flow_src;    // source of probes to the target, for udp checksums
+
 static int batch_at;
 static int numhosts = 10;
-static int portpid;
 static int stopper = MAXHOST;
+
+// Logical prober (target, protocol, source address) with its own
+// icmp id or udp source port, and its own window of sequences
+typedef struct prober {
+  t_ipaddr target, source;
+  int family, proto;
+  uint16_t id, port;
+  int next_seq;
+} prober_t;
+#define MAXPROBER 16
+enum { PROBER_ID_STRIDE = 0x9e37 }; // odd, so ids of process go through all 64k before repeat
+static prober_t probers[MAXPROBER];
+static uint nprober;
+static prober_t *prober = probers;          // current one
+static uint8_t id2prober[UINT16_MAX + 1];   // id -> prober index + 1 (0 if free)
+
+// Prober of reply by its icmp id or udp source port, NULL if it's none of ours
+static inline const prober_t *id_prober(uint16_t id) { return id2prober[id] ? &probers[id2prober[id] - 1] : NULL; }
+static const prober_t *port_prober(uint16_t port) {
+  for (uint i = 0; i < nprober; i++)
+    if (probers[i].port == port)
+      return &probers[i];
+  return NULL;
+}
 enum { RE_PONG, RE_EXCEED, RE_UNREACH }; // reason of a pong response
 
+// Protocols probing the target at once: every one has its own lane with hop table,
+// sequences, prober and batch state, and they share sockets and the event loop.
+// Outside of net.c the first (primary) lane is seen unless net_lane_view() is called.
+typedef struct lane {
+  int proto;
+  nethost_t *host;
+  struct sequence *seqlist;
+  prober_t *prober;
+  int batch_at, numhosts, stopper;
+  bool done; // batch cycle is over, others are not yet
+} lane_t;
+static lane_t lanes[MAXLANE];
+static int nlane;            // 0 with one protocol
+static lane_t *lane = lanes; // current one
+#define PRIMARY_LANE (!nlane || (lane == lanes))
+
 bool addr4exist(const void *a) { return memcmp(a, &unspec_addr, sizeof(struct in_addr)) ? true : false; }
 bool addr4equal(const void *a, const void *b) { return memcmp(a, b, sizeof(struct in_addr)) ? false : true; }
 void* addr4copy(void *dst, const void *src) { return memcpy(dst, src, sizeof(struct in_addr)); }
@@ -269,10 +356,69 @@ bool addr6equal(const void *a, const void *b) { return memcmp(a, b, sizeof(struc
 void* addr6copy(void *dst, const void *src) { return memcpy(dst, src, sizeof(struct in6_addr)); }
 #endif
 
+static void set_hdr_sizes(void) {
+  hdr_minsz = iphdr_sz;
+  switch (mtrtype) {
+    case IPPROTO_ICMP: hdr_minsz += sizeof(struct _icmphdr); break;
+    case IPPROTO_UDP:  hdr_minsz += sizeof(struct udphdr);   break;
+    case IPPROTO_TCP:  hdr_minsz += sizeof(struct tcphdr);   break;
+    default: warnx("%d: %s", mtrtype, strerror(EPROTONOSUPPORT));
+  }
+  minfailsz = hdr_minsz + iphdr_sz + sizeof(struct _icmphdr);
+}
+
+static void lane_switch(int i) {
+  if (!nlane || (lane == &lanes[i]))
+    return;
+  lane->batch_at = batch_at;
+  lane->numhosts = numhosts;
+  lane->stopper  = stopper;
+  lane->prober   = prober;
+  lane = &lanes[i];
+  host     = lane->host;
+  seqlist  = lane->seqlist;
+  prober   = lane->prober;
+  batch_at = lane->batch_at;
+  numhosts = lane->numhosts;
+  stopper  = lane->stopper;
+  mtrtype  = lane->proto;
+  set_hdr_sizes();
+#ifdef ENABLE_IPV6
+  if (af == AF_INET6)
+    net_setsock6();
+#endif
+}
+
+// switch to the lane of 'proto', false if there's none
+static bool lane_proto(int proto) {
+  for (int i = 0; i < nlane; i++)
+    if (lanes[i].proto == proto) {
+      lane_switch(i);
+      return true;
+    }
+  return false;
+}
+
+// run 'fn' in every lane, or once if there's only one
+static void each_lane(void (*fn)(void)) {
+  if (!nlane) {
+    fn();
+    return;
+  }
+  for (int i = 0; i < nlane; i++) {
+    lane_switch(i);
+    fn();
+  }
+  lane_switch(0);
+}
+
 // return in 'tv' waittime before sending the next ping
 void waitspec(struct timespec *tv) {
   double wait = run_opts.interval;
   int num = numhosts;
+  for (int i = 1; i < nlane; i++) // lanes' batches go together
+    if (lanes[i].numhosts > num)
+      num = lanes[i].numhosts;
   int first = run_opts.minttl - 1;
   if ((first > 0) && (num > first))
     num -= first;
@@ -309,6 +455,47 @@ static uint16_t udpsum16(struct _iphdr *ip, void *udata, int udata_len, int dsiz
   return sum1616((uint16_t*)csumpacket, tsize / 2, (tsize % 2) ? bitpattern : 0);
 }
 
+// One's complement sum of 'len' bytes added to 'sum', not folded
+static uint32_t sum16(const void *data, size_t len, uint32_t sum) {
+  const uint8_t *p = data;
+  uint16_t word;
+  for (; len > 1; len -= 2, p += 2) {
+    memcpy(&word, p, sizeof(word));
+    sum += word;
+  }
+  if (len) {
+    word = 0;
+    memcpy(&word, p, 1);
+    sum += word;
+  }
+  return sum;
+}
+
+static inline uint16_t fold16(uint32_t sum) {
+  while (sum >> 16)
+    sum = (sum >> 16) + (sum & 0xffff);
+  return sum;
+}
+
+// Word at 'fix' that makes checksum over 'sum' (with it zeroed) equal to 'want'
+static inline void fix16(void *fix, uint32_t sum, uint16_t want) {
+  uint16_t word = fold16((uint16_t)~want + (uint16_t)~fold16(sum));
+  memcpy(fix, &word, sizeof(word));
+}
+
+// Flow-stable udp probe: sequence in checksum, payload's first word keeps it valid
+static void flow_udpsum(struct udphdr *udp, uint16_t size, int seq) {
+  size_t alen = (af == AF_INET) ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+  uint8_t *fix = (uint8_t *)(udp + 1);
+  memset(fix, 0, sizeof(uint16_t));
+  udp->uh_sum = 0;
+  uint32_t sum = sum16(&flow_src, alen, 0); // pseudo header
+  sum = sum16(remote_ipaddr, alen, sum);
+  sum += htons(IPPROTO_UDP) + htons(size);
+  fix16(fix, sum16(udp, size, sum), SEQ2UDPSUM(seq));
+  udp->uh_sum = SEQ2UDPSUM(seq);
+}
+
 const char* rstrerror(int rc) {
   snprinte(strerr_txt, sizeof(strerr_txt), "%s", strerror(rc));
   snprinte(tgterr_txt, sizeof(tgterr_txt), "%s", strerror(rc));
@@ -327,18 +514,78 @@ void keep_error(int rc, const char *prefix) {
   net_warn(prefix);
 }
 
+// slot of 'addr' in hop's address hash
+static uint path_hash(const t_ipaddr *addr) NONNULL(1);
+static uint path_hash(const t_ipaddr *addr) {
+  const uint8_t *a = (const uint8_t *)addr;
+  size_t alen = (af == AF_INET) ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+  uint32_t hash = 2166136261U; // FNV-1a
+  for (size_t i = 0; i < alen; i++)
+    hash = (hash ^ a[i]) * 16777619U;
+  return hash & (PATHHASH - 1);
+}
+
+// return index of 'addr' at 'hop', otherwise -1
+static int addr2ndx(int hop, const t_ipaddr *addr) NONNULL(2);
+static int addr2ndx(int hop, const t_ipaddr *addr) {
+  const uint8_t *pathndx = host[hop].pathndx;
+  for (uint h = path_hash(addr); pathndx[h]; h = (h + 1) & (PATHHASH - 1))
+    if (addr_equal(&IP_AT_NDX(hop, pathndx[h] - 1), addr))
+      return pathndx[h] - 1;
+  return -1;
+}
+
+static void path_hashin(int hop, int ndx) {
+  uint8_t *pathndx = host[hop].pathndx;
+  uint h = path_hash(&IP_AT_NDX(hop, ndx));
+  while (pathndx[h])
+    h = (h + 1) & (PATHHASH - 1);
+  pathndx[h] = ndx + 1;
+}
+
+static void path_rehash(int hop) {
+  memset(host[hop].pathndx, 0, sizeof(host[hop].pathndx));
+  for (int i = 0; i < PATHS_AT(hop); i++)
+    path_hashin(hop, i);
+}
+
+// return new slot at 'hop' growing storage if needed, otherwise -1
+static int at2next(int hop) {
+  nethost_t *h = &host[hop];
+  if (h->paths >= MAXPATH)
+    return -1;
+  if ((h->paths - PATHINLINE) >= h->nmore) {
+    int n = h->nmore ? (h->nmore * 2) : PATHINLINE;
+    if (n > (MAXPATH - PATHINLINE))
+      n = MAXPATH - PATHINLINE;
+    eaddr_t *more = realloc(h->more, n * sizeof(eaddr_t));
+    if (!more) {
+      WARN("%s=%d realloc(%zd)", HOP_STR, hop, n * sizeof(eaddr_t));
+      return -1;
+    }
+    memset(more + h->nmore, 0, (n - h->nmore) * sizeof(eaddr_t));
+    h->more = more;
+    h->nmore = n;
+  }
+  return h->paths++;
+}
+
 static inline bool save_send_ts(int seq) {
-  int rc = clock_gettime(CLOCK_MONOTONIC, &seqlist[seq].time);
+  int rc = MONOTIME(&seqlist[seq].time);
   if (rc) keep_error(errno, __func__);
   return (rc == 0);
 }
 
 static void save_sequence(int seq, int at) {
-  LOGMSG("seq=%d at=%d", seq, at);
+  LOGMSG("seq=%d at=%d id=%u", seq, at, prober->id);
   seqlist[seq].at = at;
+  seqlist[seq].id = prober->id;
+  seqlist[seq].flow = 0;
   seqlist[seq].transit = true;
-  if (host[at].transit)
+  if (host[at].transit) {
     host[at].up = false; // if previous packet is in transit too, then assume it's down
+    TRACEPOINT(lost, seq, at + 1);
+  }
   host[at].transit = true;
   host[at].sent++;
 #ifdef TUIMODE
@@ -354,12 +601,40 @@ static void save_sequence(int seq, int at) {
 #endif
 }
 
+// Probes to confirm that all next-hops are found when 'k' are seen, with
+// failure probability under '1 - confidence' (Veitch et al, MDA)
+static int mda_need(int k) {
+  static uint8_t conf;
+  static int need[MAXPATH];
+  if (conf != run_opts.mda) {
+    conf = run_opts.mda;
+    double alpha = (100 - conf) / 100.;
+    for (int i = 1; i < MAXPATH; i++) {
+      int n = ceil(log(alpha / (i + 1)) / log(i / (i + 1.)));
+      need[i] = (n < MAXFLOW) ? n : MAXFLOW;
+    }
+    need[0] = need[1];
+  }
+  return need[(k < MAXPATH) ? k : (MAXPATH - 1)];
+}
+
+// flow of the next probe to 'at': fixed one, or in MDA mode the next one of
+// as many flows as needed for the next-hops seen so far
+static int next_flow(int at) {
+  if (!run_opts.mda)
+    return run_opts.flow;
+  return host[at].sent % mda_need(PATHS_AT(at));
+}
+
 static int new_sequence(int at) {
-  static int next_seq;
-  int seq = next_seq++;
-  if (next_seq >= ((mtrtype == IPPROTO_UDP) ? UDPPORTS : MAXSEQ))
-    next_seq = 0;
+  int seq = prober->next_seq++;
+  if (prober->next_seq >= (((mtrtype == IPPROTO_UDP) && !FLOWED) ? UDPPORTS : MAXSEQ))
+    prober->next_seq = 0;
+  int flow = FLOWED ? next_flow(at) : 0;
   save_sequence(seq, at);
+  seqlist[seq].flow = flow;
+  if (net_sent_fn && PRIMARY_LANE)
+    net_sent_fn(at, seq);
   return seq;
 }
 
@@ -395,6 +670,29 @@ static bool settosttl6(int sock, int ttl) {
 #undef NET_SETTOS
 #undef NET_SETTTL
 
+#ifdef WITH_DGRAM
+// icmp errors about tcp probes: no raw socket, or it's not read in time (ring's blocks)
+#define TCP_ERRQUEUE (net_dgram || net_broker || net_ring)
+
+// icmp errors are queued in socket's error queue, with kernel timestamps
+static bool dgram_sockopt(int sock, int domain) {
+  int on = 1;
+  if (setsockopt(sock, (domain == AF_INET) ? IPPROTO_IP : IPPROTO_IPV6,
+      (domain == AF_INET) ? IP_RECVERR : IPV6_RECVERR, &on, sizeof(on)) < 0)
+    return false;
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+    LOGMSG("setsockopt(sock=%d, SO_TIMESTAMPNS): %s", sock, strerror(errno));
+  return true;
+}
+#endif
+
+// Probe via broker: it prepends IP header (without source address), sets ttl and tos
+static int net_broker_send(int ttl, const uint8_t *data, uint16_t size) {
+  broker_req_t req = { .ver = BROKER_VER, .family = af, .proto = mtrtype, .ttl = ttl, .tos = run_opts.qos };
+  addr_copy(req.dst, remote_ipaddr);
+  return broker_send(sendsock, &req, data, size) ? 0 : -1;
+}
+
 // Create TCP socket for hop 'at', and try to connect (poll results later)
 static bool net_send_tcp(int at) {
 #define SET_ADDR_PORT(src_addr, ssa_addr, dst_addr, dst_port) { \
@@ -406,6 +704,10 @@ static bool net_send_tcp(int at) {
   if (sock < 0)
     FAIL_WITH_WARN(sock, "socket[at=%d]", at);
   /*summ*/ sum_sock[0]++;
+#ifdef WITH_DGRAM
+  if (TCP_ERRQUEUE && !dgram_sockopt(sock, af)) // no raw socket to get icmp errors
+    FAIL_WITH_WARN(sock, "%s[at=%d]", "IP_RECVERR", at);
+#endif
 
   t_sockaddr local = {0}, remote = {0};
   local.SA_AF = remote.SA_AF = af;
@@ -454,9 +756,10 @@ static bool net_send_tcp(int at) {
   save_sequence(seq, at);
   if (!save_send_ts(seq)) return false;
   connect(sock, &remote.sa, addrlen); // NOLINT(bugprone-unused-return-value)
+  TRACEPOINT(send, seq, ttl, mtrtype, af, remote_ipaddr, TS2NSEC(seqlist[seq].time));
 #ifdef LOGMOD
   { struct timespec now;
-    int rc = clock_gettime(CLOCK_MONOTONIC, &now); // LOGMOD for debug only
+    int rc = MONOTIME(&now); // LOGMOD for debug only
     LOGMSG("at=%d seq=%d sock=%d: ttl=%d (ts=%lld.%09ld)",
       at, seq, sock, ttl, rc ? 0 : (long long)now.tv_sec, rc ? 0 : now.tv_nsec);
   }
@@ -466,13 +769,33 @@ static bool net_send_tcp(int at) {
 #undef SET_ADDR_PORT
 }
 
+#ifdef IP_HDRINCL
+static inline void net_fill_ip_hdr(struct _iphdr *ip, uint16_t size, int ttl, int tos, int proto,
+    const void *saddr, const void *daddr) {
+  ip->ver   = 4;
+  ip->ihl   = 5;
+  ip->tos   = tos;
+  ip->len   = IPLEN_RAW(size);
+  ip->id    = 0;
+  ip->frag  = 0;
+  ip->ttl   = ttl;
+  ip->proto = proto;
+  ip->sum   = 0;
+  // BSD needs the source IPv4 address here
+  memcpy(&ip->saddr, saddr, sizeof(ip->saddr));
+  memcpy(&ip->daddr, daddr, sizeof(ip->daddr));
+}
+#endif
+
 static inline void net_fill_icmp_hdr(uint16_t seq, uint8_t type, uint8_t *data, uint16_t size) {
   struct _icmphdr *icmp = (struct _icmphdr *)data;
   icmp->type = type;
   icmp->code = 0;
   icmp->sum  = 0;
-  icmp->id   = mypid;
+  icmp->id   = prober->id;
   icmp->seq  = seq;
+  if (FLOWED) // seq and payload's first word sum up to the flow: checksum is the same whatever id is
+    fix16(icmp + 1, seq, ~seqlist[seq].flow);
   icmp->sum  = sum1616((uint16_t*)data, size / 2, (size % 2) ? bitpattern : 0);
   LOGMSG("icmp: seq=%d id=%u", icmp->seq, icmp->id);
 }
@@ -485,15 +808,18 @@ static inline bool net_fill_udp_hdr(uint16_t seq, uint8_t *data, uint16_t size
   struct udphdr *udp = (struct udphdr *)data;
   udp->uh_sum  = 0;
   udp->uh_ulen = htons(size);
+  int port = FLOWED ? seqlist[seq].flow : seq;
   if (run_opts.port < 0)
-    SET_UDP_UH_PORTS(udp, portpid, LO_UDPPORT + seq)
+    SET_UDP_UH_PORTS(udp, prober->port, LO_UDPPORT + port)
   else
-    SET_UDP_UH_PORTS(udp, LO_UDPPORT + seq, run_opts.port);
+    SET_UDP_UH_PORTS(udp, LO_UDPPORT + port, run_opts.port);
+  if (FLOWED)
+    flow_udpsum(udp, size, seq);
   LOGMSG("udp: seq=%d port=%u", seq, ntohs(udp->uh_dport));
   switch (af) {
     case AF_INET:
 #ifdef IP_HDRINCL
-      if (ip->saddr) { // checksum is not mandatory, calculate if source address is known
+      if (!FLOWED && ip && ip->saddr) { // checksum is not mandatory, calculate if source address is known
         uint16_t sum = udpsum16(ip, udp, udp->uh_ulen, size);
         udp->uh_sum = sum ? sum : 0xffff;
       }
@@ -502,7 +828,7 @@ static inline bool net_fill_udp_hdr(uint16_t seq, uint8_t *data, uint16_t size
 #ifdef ENABLE_IPV6
     case AF_INET6: { // checksumming by kernel
       int opt = 6;
-      if (setsockopt(sendsock, IPPROTO_IPV6, IPV6_CHECKSUM, &opt, sizeof(opt)))
+      if (!net_broker && setsockopt(sendsock, IPPROTO_IPV6, IPV6_CHECKSUM, &opt, sizeof(opt)))
         FAIL_WITH_WARN(sendsock, "setsockopt6(sock=%d, IPV6_CHECKSUM)", sendsock);
     } return true;
     default: break;
@@ -525,31 +851,20 @@ static bool net_send_icmp_udp(int at) {
   switch (af) {
     case AF_INET: {
 #ifdef IP_HDRINCL
-      // prepend data with IP header
-      struct _iphdr *ip = (struct _iphdr *)packet;
-      data    += sizeof(*ip);
-      pktsize += sizeof(*ip);
-      ip->ver   = 4;
-      ip->ihl   = 5;
-      ip->tos   = run_opts.qos;
-      ip->len   = IPLEN_RAW(pktsize);
-      ip->id    = 0;
-      ip->frag  = 0;
-      ip->ttl   = ttl;
-      ip->proto = mtrtype;
-      ip->sum   = 0;
-      // BSD needs the source IPv4 address here
-      addr_copy(&ip->saddr, &lsa.S_ADDR);
-      addr_copy(&ip->daddr, &rsa.S_ADDR);
-#else
-      if (!settosttl(sendsock, ttl)) return false;
+      if (!net_dgram && !net_broker) { // prepend data with IP header
+        struct _iphdr *ip = (struct _iphdr *)packet;
+        data    += sizeof(*ip);
+        pktsize += sizeof(*ip);
+        net_fill_ip_hdr(ip, pktsize, ttl, run_opts.qos, mtrtype, &lsa.S_ADDR, &rsa.S_ADDR);
+      } else
 #endif
+      if (!net_broker && !settosttl(sendsock, ttl)) return false; // broker sets ttl itself
       echotype = ICMP_ECHO;
       salen = sizeof(struct sockaddr_in);
     } break;
 #ifdef ENABLE_IPV6
     case AF_INET6:
-      if (!settosttl6(sendsock, ttl)) return false;
+      if (!net_broker && !settosttl6(sendsock, ttl)) return false;
       echotype = ICMP6_ECHO_REQUEST;
       salen = sizeof(struct sockaddr_in6);
       break;
@@ -559,14 +874,25 @@ static bool net_send_icmp_udp(int at) {
   }
 
   int seq = new_sequence(at);
+  t_sockaddr dst = rsa;
   switch (mtrtype) {
     case IPPROTO_ICMP:
       net_fill_icmp_hdr(seq, echotype, data, datasize);
       break;
     case IPPROTO_UDP:
-      if (!net_fill_udp_hdr(seq, data, datasize
+      if (net_dgram) { // udp header is set by kernel, sequence is kept at payload start
+        pktsize = (payloadsize < sizeof(uint16_t)) ? sizeof(uint16_t) : payloadsize;
+        uint16_t nseq = htons(seq);
+        memcpy(data, &nseq, sizeof(nseq));
+        uint16_t port = htons((run_opts.port < 0) ? (LO_UDPPORT + (FLOWED ? seqlist[seq].flow : seq)) : run_opts.port);
+#ifdef ENABLE_IPV6
+        if (af == AF_INET6) dst.S6PORT = port; else
+#endif
+        dst.S_PORT = port;
+        LOGMSG("udp: seq=%d port=%u", seq, ntohs(port));
+      } else if (!net_fill_udp_hdr(seq, data, datasize
 #ifdef IP_HDRINCL
-         , (struct _iphdr *)packet
+         , (data != packet) ? (struct _iphdr *)packet : NULL
 #endif
       )) return false;
       break;
@@ -576,13 +902,14 @@ static bool net_send_icmp_udp(int at) {
 
   bool okay = save_send_ts(seq);
   if (okay) {
-    if (sendto(sendsock, packet, pktsize, 0, &rsa.sa, salen) < 0) {
+    if ((net_broker ? net_broker_send(ttl, packet, pktsize) : sendto(sendsock, packet, pktsize, 0, &dst.sa, salen)) < 0) {
       int rc = errno;
       char str[MAX_ADDRSTRLEN] = {0};
       const char *dst = inet_ntop(af, remote_ipaddr, str, sizeof(str));
       errno = rc;
       FAIL_WITH_WARN(sendsock, "sendto(%s)", dst ? dst : "");
     }
+    TRACEPOINT(send, seq, ttl, mtrtype, af, remote_ipaddr, TS2NSEC(seqlist[seq].time));
     /*summ*/ net_queries[QR_SUM]++; if (mtrtype == IPPROTO_ICMP) net_queries[QR_ICMP]++; else net_queries[QR_UDP]++;
   }
   return okay;
@@ -626,54 +953,22 @@ static void hop_stats(int at, timemsec_t curr) {
   host[at].up = true;
   host[at].transit = false;
   if (run_opts.oncache)
-    host[at].seen = time(NULL);
-}
-
-// return index of 'addr' at 'hop', otherwise -1
-static int addr2ndx(int hop, const t_ipaddr *addr) NONNULL(2);
-static int addr2ndx(int hop, const t_ipaddr *addr) {
-  for (int i = 0; i < MAXPATH; i++)
-    if (addr_equal(&IP_AT_NDX(hop, i), addr))
-      return i;
-  return -1;
-}
-
-// return first free slot at 'hop', otherwise -1
-static int at2next(int hop) {
-  for (int i = 0; i < MAXPATH; i++)
-    if (!addr_exist(&IP_AT_NDX(hop, i)))
-      return i;
-  return -1;
+    host[at].seen = unixtime();
 }
 
 // set new ip-addr and clear associated data
 static void set_new_addr(int at, int ndx, const t_ipaddr *ipaddr) NONNULL(3);
 static void set_new_addr(int at, int ndx, const t_ipaddr *ipaddr) {
   addr_copy(&IP_AT_NDX(at, ndx), ipaddr);
-  if (QPTR_AT_NDX(at, ndx)) {
-    free(QPTR_AT_NDX(at, ndx));
-    QPTR_AT_NDX(at, ndx) = NULL;
-  }
-  if (RPTR_AT_NDX(at, ndx)) {
-    free(RPTR_AT_NDX(at, ndx));
-    RPTR_AT_NDX(at, ndx) = NULL;
-  }
+  PATH_AT_NDX(at, ndx).recv = 0;
+  PATH_AT_NDX(at, ndx).avg = 0;
+  PATH_AT_NDX(at, ndx).flows = 0;
+  QPTR_AT_NDX(at, ndx) = RPTR_AT_NDX(at, ndx) = NULL; // interned
 #ifdef WITH_IPINFO
-  if (QTXT_AT_NDX(at, ndx)) {
-    free(QTXT_AT_NDX(at, ndx));
-    QTXT_AT_NDX(at, ndx) = NULL;
-  }
-  for (uint i = 0; i < II_REC_ARR_LEN; i++) {
-    if (II_VIEW_AT(at, ndx, i)) {
-      free(II_VIEW_AT(at, ndx, i));
-      II_VIEW_AT(at, ndx, i) = NULL;
-    }
-    for (uint j = 0; j < II_SRC_ARR_LEN; j++) {
-      if (II_SRC_AT(at, ndx, i, j)) {
-        free(II_SRC_AT(at, ndx, i, j));
-        II_SRC_AT(at, ndx, i, j) = NULL;
-      }
-    }
+  QTXT_AT_NDX(at, ndx) = NULL;
+  if (II_REC_ARR(at, ndx)) {
+    free(II_REC_ARR(at, ndx));
+    II_REC_ARR(at, ndx) = NULL;
   }
 #endif
 }
@@ -697,6 +992,23 @@ static inline void set_new_mpls(int at, int ndx, const mpls_data_t *mpls) {
 #endif
 
 
+#ifdef WITH_EVRING
+static void net_event(int at, int ndx, int reason, const struct timespec *recv_at, int usec) {
+  uint32_t labels[MAX_MPLS_LABEL] = {0};
+  int n = 0;
+#ifdef WITH_MPLS
+  const mpls_data_t *mpls = &MPLS_AT_NDX(at, ndx);
+  for (; (n < mpls->n) && (n < MAX_MPLS_LABEL); n++) {
+    const mpls_label_t *l = &mpls->label[n];
+    labels[n] = ((uint32_t)l->u.lab << 12) | (l->u.exp << 9) | (l->u.bos << 8) | l->u.ttl;
+  }
+#endif
+  int type = (reason == RE_PONG) ? EVR_PONG : (reason == RE_EXCEED) ? EVR_EXCEED :
+    (reason == RE_UNREACH) ? EVR_UNREACH : EVR_REPLY;
+  evring_put(af, mtrtype, remote_ipaddr, &IP_AT_NDX(at, ndx), at + 1, type, recv_at, usec, labels, n);
+}
+#endif
+
 // Got a return
 static int net_stat(uint port, const void *addr, struct timespec *recv_at, int reason
 #ifdef WITH_MPLS
@@ -709,7 +1021,7 @@ static int net_stat(uint port, const void *addr, struct timespec *recv_at, int r
 #endif
 ) {
   uint seq = port % MAXSEQ;
-  if (!seqlist[seq].transit)
+  if (!seqlist[seq].transit || (seqlist[seq].id != prober->id))
     return true;
 
   seqlist[seq].transit = false;
@@ -733,20 +1045,22 @@ static int net_stat(uint port, const void *addr, struct timespec *recv_at, int r
   int ndx = addr2ndx(at, addr);
   if (ndx < 0) {       // new one
     ndx = at2next(at);
-    if (ndx < 0) {
+    if (ndx >= 0) {
+      SET_NEW_ADDR(addr, mpls);
+      path_hashin(at, ndx);
+    } else {
       // no free slots? - warn once, and change the last one
       static bool warn_exceed_once;
       if (!warn_exceed_once) {
         warnx("%s=%d (MAXPATH=%d): %s", HOP_STR, at, MAXPATH, strerror(EOVERFLOW));
         warn_exceed_once = true;
       }
-      ndx = MAXPATH - 1;
+      ndx = PATHS_AT(at) - 1;
+      SET_NEW_ADDR(addr, mpls);
+      path_rehash(at);
     }
-    SET_NEW_ADDR(addr, mpls);
-#ifdef OUTPUT_FORMAT_RAW
-    if (run_opts.rawrep)
-      raw_rawhost(at, ndx);
-#endif
+    if (net_newhop_fn && PRIMARY_LANE)
+      net_newhop_fn(at, ndx);
   }
 #ifdef WITH_MPLS
   else if (mpls && memcmp(&MPLS_AT_NDX(at, ndx), mpls, sizeof(mpls_data_t))) {
@@ -757,18 +1071,25 @@ static int net_stat(uint port, const void *addr, struct timespec *recv_at, int r
 
   struct timespec tv;
   timespecsub(recv_at, &seqlist[seq].time, &tv);
+  TRACEPOINT(reply, seq, at + 1, reason, af, addr, TS2NSEC(seqlist[seq].time), TS2NSEC(*recv_at));
   timemsec_t curr = {.ms = time2msec(tv), .frac = time2mfrac(tv)};
   hop_stats(at, curr);
+  { eaddr_t *path = &PATH_AT_NDX(at, ndx);
+    path->recv++;
+    path->avg += (msec2float(curr) - path->avg) / path->recv;
+    if (FLOWED && (seqlist[seq].flow < MAXFLOW))
+      path->flows |= 1ULL << seqlist[seq].flow; }
 
 #ifdef TUIMODE
   int n = seqlist[seq].saved_seq - host[at].saved_seq_offset;
   if ((n >= 0) && (n <= SAVED_PINGS))
     host[at].saved[n] = time2usec(tv);
 #endif
-#ifdef OUTPUT_FORMAT_RAW
-  if (run_opts.rawrep)
-    raw_rawping(at, time2usec(tv));
+#ifdef WITH_EVRING
+  net_event(at, ndx, reason, recv_at, time2usec(tv));
 #endif
+  if (net_reply_fn && PRIMARY_LANE)
+    net_reply_fn(at, ndx, time2usec(tv));
   return true;
 }
 
@@ -828,14 +1149,17 @@ static mpls_data_t *decodempls(const uint8_t *data, int size) {
 static int got_icmp_udp(const struct udphdr *uh) { // NONNULL(1)
   int seq = -1;
   if (run_opts.port < 0) {
-    if (ntohs(uh->uh_sport) == portpid)
+    const prober_t *owner = port_prober(ntohs(uh->uh_sport));
+    if (owner == prober)
       seq = ntohs(uh->uh_dport);
+    else
+      LOGMSG("udp(myport=%u): got %s port=%u", prober->port, owner ? "stale" : "unknown", ntohs(uh->uh_sport));
   } else {
     if (ntohs(uh->uh_dport) == run_opts.port)
       seq = ntohs(uh->uh_sport);
   }
   if (seq >= 0) {
-    seq -= LO_UDPPORT;
+    seq = FLOWED ? UDPSUM2SEQ(uh->uh_sum) : (seq - LO_UDPPORT);
     /*summ*/ net_replies[QR_UDP]++;
   }
   return seq;
@@ -843,25 +1167,167 @@ static int got_icmp_udp(const struct udphdr *uh) { // NONNULL(1)
 
 #ifdef WITH_MPLS
 #define LOGMSG_ICMP LOGMSG("icmp seq=%d type=%d mpls=%d", seq, icmp->type, mplson)
-#define LOGMSG_UDP  LOGMSG("udp seq=%d id=%d mpls=%d", seq, portpid, mplson)
+#define LOGMSG_UDP  LOGMSG("udp seq=%d id=%d mpls=%d", seq, prober->port, mplson)
 #define LOGMSG_TCP  LOGMSG("tcp seq=%d mpls=%d", seq, mplson);
 #define MPLS_LIKE_TEST do { mplson = mplslike(size, data - packet); } while (0)
 #else
 #define LOGMSG_ICMP LOGMSG("icmp seq=%d type=%d", seq, icmp->type)
-#define LOGMSG_UDP  LOGMSG("udp seq=%d id=%d", seq, portpid)
+#define LOGMSG_UDP  LOGMSG("udp seq=%d id=%d", seq, prober->port)
 #define LOGMSG_TCP  LOGMSG("tcp seq=%d", seq);
 #define MPLS_LIKE_TEST NOOP
 #endif
 
-void net_icmp_parse(struct timespec *recv_at) { // NONNULL(1)
-#define LOGRET_UNKN_ID do { if (icmp->id != (uint16_t)mypid)  \
-  LOGRET("icmp(myid=%u): got unknown id=%u (type=%u seq=%u)", \
-         mypid, icmp->id, icmp->type, seq);                   \
-} while (0)
+// Kernel timestamp is realtime, sequences are timed with monotonic clock
+static void ts2mono(const struct timespec *kts, const struct timespec *real,
+    const struct timespec *mono, struct timespec *recv_at) {
+  struct timespec queued;
+  timespecsub(real, kts, &queued); // time spent in socket queues
+  if ((queued.tv_sec == 0) && (queued.tv_nsec >= 0)) { // unless clock is stepped
+    timespecsub(mono, &queued, recv_at);
+    lat_add(LAT_QUEUED, queued.tv_nsec);
+  }
+}
+
+static void kts2mono(const struct timespec *kts, struct timespec *recv_at) {
+  struct timespec real, mono;
+  if (!mtr_clock.gettime(CLOCK_REALTIME, &real) && !MONOTIME(&mono))
+    ts2mono(kts, &real, &mono, recv_at);
+}
+
+// Reply forwarded by broker: packet as it's read from raw socket, with sender and timestamp
+static ssize_t net_broker_recv(uint8_t *packet, size_t size, struct sockaddr_storage *from, struct timespec *recv_at) {
+  broker_rep_t rep;
+  ssize_t len = broker_recv(recvsock, &rep, packet, size);
+  if (len < 0) {
+    keep_error(errno, "broker");
+    if (errno == ECONNRESET) { // sending fails next time
+      CLOSE(brokersock);
+      sendsock = recvsock = -1;
+    }
+    return len;
+  }
+  if (rep.error) {
+    keep_error(rep.error, "broker");
+    return -1;
+  }
+  if (rep.family != af) // stale one
+    return 0;
+  memset(from, 0, sizeof(*from));
+  from->ss_family = rep.family;
+  memcpy(((uint8_t*)from) + sa_addr_offset, rep.from, (af == AF_INET) ? sizeof(struct in_addr) : sizeof(rep.from));
+  if (rep.kts.tv_sec)
+    kts2mono(&rep.kts, recv_at);
+  return len;
+}
+
+#ifdef WITH_DGRAM
+static void dgram_recv_ts(struct msghdr *msg, struct timespec *recv_at) {
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+    if ((cm->cmsg_level == SOL_SOCKET) && (cm->cmsg_type == SCM_TIMESTAMPNS)) {
+      struct timespec kts;
+      memcpy(&kts, CMSG_DATA(cm), sizeof(kts));
+      kts2mono(&kts, recv_at);
+      return;
+    }
+}
+
+static const struct sock_extended_err *dgram_icmp_err(struct msghdr *msg) {
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+    if (((cm->cmsg_level == IPPROTO_IP)   && (cm->cmsg_type == IP_RECVERR))
+     || ((cm->cmsg_level == IPPROTO_IPV6) && (cm->cmsg_type == IPV6_RECVERR))) {
+      const struct sock_extended_err *ee = (const struct sock_extended_err *)CMSG_DATA(cm);
+      if ((ee->ee_origin == SO_EE_ORIGIN_ICMP) || (ee->ee_origin == SO_EE_ORIGIN_ICMP6))
+        return ee;
+    }
+  return NULL;
+}
+
+// Read one message: queued icmp error (with 'ee' set) or data unless 'errq' only
+static ssize_t dgram_recv(int sock, bool errq, uint8_t *buf, size_t size,
+    struct sockaddr_storage *from, const struct sock_extended_err **ee, struct timespec *recv_at) {
+  static union { struct cmsghdr hdr; uint8_t buf[256]; } control;
+  struct iovec iov = { .iov_base = buf, .iov_len = size };
+  struct msghdr msg = { .msg_name = from, .msg_namelen = sizeof(*from), .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+  *ee = NULL;
+  ssize_t len = recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+  if (len >= 0)
+    *ee = dgram_icmp_err(&msg);
+  else if (!errq) {
+    msg.msg_namelen = sizeof(*from);
+    msg.msg_controllen = sizeof(control.buf);
+    len = recvmsg(sock, &msg, MSG_DONTWAIT);
+  }
+  if (len >= 0)
+    dgram_recv_ts(&msg, recv_at);
+  return len;
+}
+
+// Ping socket gets echo replies without IP header, errors come with the original
+// icmp header or udp payload, and offender address. The kernel does demultiplexing.
+static void net_dgram_parse(const struct timespec *polled_at) {
   uint8_t packet[MAXPACKET];
+  const size_t off = (mtrtype == IPPROTO_UDP) ? sizeof(struct udphdr) : 0; // keep udp offsets as raw ones
   struct sockaddr_storage sa_in;
-  //
-  ssize_t size = recvfrom(recvsock, packet, MAXPACKET, 0, (struct sockaddr *)&sa_in, &sa_len);
+  const struct sock_extended_err *ee = NULL;
+  struct timespec recv_at = *polled_at;
+  ssize_t size = dgram_recv(recvsock, false, packet + off, sizeof(packet) - off, &sa_in, &ee, &recv_at);
+  LOGMSG("got %zd bytes%s", size, ee ? " from error queue" : "");
+  if (size < (ssize_t)sizeof(uint16_t))
+    LOGRET("incorrect packet size %zd [af=%d proto=%d]", size, af, mtrtype);
+  const uint8_t *addr = ((uint8_t*)&sa_in) + sa_addr_offset;
+  if (ee) {
+    const struct sockaddr *offender = (const struct sockaddr *)(ee + 1);
+    if (offender->sa_family != af)
+      LOGRET("icmp error type=%u without offender", ee->ee_type);
+    if ((ee->ee_type != time_exceed) && (ee->ee_type != dst_unreach))
+      LOGRET("unexpected icmp error type=%u", ee->ee_type);
+    addr = ((const uint8_t*)offender) + sa_addr_offset;
+  }
+#ifdef WITH_MPLS
+  bool mplson = ee && mplslike(size + off, 0);
+#endif
+  int seq = -1, reason = -1;
+  switch (mtrtype) {
+    case IPPROTO_ICMP: {
+      if (size < (ssize_t)sizeof(struct _icmphdr))
+        LOGRET("incorrect packet size %zd [af=%d proto=%d minsize=%zd]", size, af, mtrtype, sizeof(struct _icmphdr));
+      struct _icmphdr *icmp = (struct _icmphdr *)packet;
+      if (!ee) {
+        if (icmp->type != echo_reply)
+          return;
+        reason = RE_PONG;
+      } else
+        reason = (ee->ee_type == time_exceed) ? RE_EXCEED : RE_UNREACH;
+      seq = icmp->seq;
+      LOGMSG_ICMP;
+      /*summ*/ net_replies[QR_ICMP]++;
+    } break;
+    case IPPROTO_UDP: {
+      if (!ee)
+        return;
+      uint16_t nseq;
+      memcpy(&nseq, packet + off, sizeof(nseq));
+      seq = ntohs(nseq);
+      LOGMSG_UDP;
+      /*summ*/ net_replies[QR_UDP]++;
+    } break;
+    default: LOGRET("Unsupported proto %d", mtrtype);
+  }
+  /*summ*/ net_replies[QR_SUM]++;
+  NET_STAT(seq, addr, &recv_at, reason, mplson ? decodempls(packet, size + off) : NULL);
+}
+#endif
+
+#define LOGRET_UNKN_ID do { const prober_t *owner = id_prober(icmp->id); \
+  if (owner != prober)                                        \
+    LOGRET("icmp(myid=%u): got %s id=%u (type=%u seq=%u)",    \
+           prober->id, owner ? "stale" : "unknown",           \
+           icmp->id, icmp->type, seq);                        \
+} while (0)
+
+// Packet as raw socket gives it: with IPv4 header, but without IPv6 one
+static void packet_parse(uint8_t *packet, ssize_t size, const void *from, struct timespec *recv_at) {
   LOGMSG("got %zd bytes", size);
   if (size < (ssize_t)hdr_minsz)
     LOGRET("incorrect packet size %zd [af=%d proto=%d minsize=%zd]", size, af, mtrtype, hdr_minsz);
@@ -909,8 +1375,148 @@ void net_icmp_parse(struct timespec *recv_at) { // NONNULL(1)
   }
   /*summ*/ net_replies[QR_SUM]++;
   if (seq >= 0)
-    NET_STAT(seq, ((uint8_t*)&sa_in) + sa_addr_offset, recv_at, reason,
-             mplson ? decodempls(data, size - (data - packet)) : NULL);
+    NET_STAT(seq, from, recv_at, reason, mplson ? decodempls(data, size - (data - packet)) : NULL);
+}
+
+static inline const prober_t *lane_prober(int i) { return (lane == &lanes[i]) ? prober : lanes[i].prober; }
+
+// Lane of reply: the one of prober with reply's icmp id or udp source port (echo replies
+// are icmp ones, errors are about the quoted probe), or of reply's protocol otherwise
+static int packet_lane(const uint8_t *packet, ssize_t size) {
+  if (size < (ssize_t)(iphdr_sz + sizeof(struct _icmphdr)))
+    return -1;
+  const struct _icmphdr *icmp = (const struct _icmphdr *)(packet + iphdr_sz);
+  const uint8_t *probe = (const uint8_t *)icmp;
+  int proto = IPPROTO_ICMP;
+  if (icmp->type != echo_reply) {
+    if (((icmp->type != time_exceed) && (icmp->type != dst_unreach)) || (size < (ssize_t)(iphdr_sz + ipicmphdr_sz + 8)))
+      return -1;
+    const uint8_t *orig = (const uint8_t *)(icmp + 1);
+#ifdef ENABLE_IPV6
+    if (af == AF_INET6)
+      proto = ((const struct ip6_hdr *)orig)->ip6_nxt;
+    else
+#endif
+      proto = ((const struct _iphdr *)orig)->proto;
+    if (proto == IPPROTO_ICMPV6)
+      proto = IPPROTO_ICMP;
+    probe = ((const uint8_t *)icmp) + ipicmphdr_sz;
+  }
+  const prober_t *owner = NULL;
+  if (proto == IPPROTO_ICMP)
+    owner = id_prober(((const struct _icmphdr *)probe)->id);
+  else if ((proto == IPPROTO_UDP) && (run_opts.port < 0))
+    owner = port_prober(ntohs(((const struct udphdr *)probe)->uh_sport));
+  for (int i = 0; i < nlane; i++)
+    if (owner ? (lane_prober(i) == owner) : (lanes[i].proto == proto))
+      return i;
+  return -1;
+}
+
+static void net_packet_parse(uint8_t *packet, ssize_t size, const void *from, struct timespec *recv_at) {
+  if (!nlane) {
+    packet_parse(packet, size, from, recv_at);
+    return;
+  }
+  int i = packet_lane(packet, size);
+  if (i < 0)
+    LOGRET("got %zd bytes of no lane", size);
+  lane_switch(i);
+  packet_parse(packet, size, from, recv_at);
+  lane_switch(0);
+}
+
+#ifdef WITH_RING
+static void ring_stats(void) { // kernel resets counters at reading
+  struct tpacket_stats_v3 st;
+  socklen_t len = sizeof(st);
+  if (getsockopt(ringsock, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0)
+    LOGMSG("getsockopt(sock=%d, PACKET_STATISTICS): %s", ringsock, strerror(errno));
+  else {
+    /*summ*/ net_ring_stat[0] += st.tp_packets; net_ring_stat[1] += st.tp_drops;
+  }
+}
+
+// Cooked frame starts with IP header, IPv6 one is skipped to parse it as raw socket's packet
+static void ring_frame(const struct tpacket3_hdr *fh, const struct timespec *real,
+    const struct timespec *mono, const struct timespec *polled_at) {
+  uint8_t *packet = ((uint8_t*)fh) + fh->tp_net;
+  ssize_t size = fh->tp_snaplen;
+  const uint8_t *from = packet + 12; // IPv4 source address
+  if ((size < 1) || ((packet[0] >> 4) != ((af == AF_INET) ? 4 : 6)))
+    return;
+  if (af != AF_INET) {
+    if (size < 40) return;
+    from = packet + 8; // IPv6 source address
+    packet += 40;
+    size -= 40;
+  }
+  struct timespec at = *polled_at, kts = { .tv_sec = fh->tp_sec, .tv_nsec = fh->tp_nsec };
+  ts2mono(&kts, real, mono, &at);
+  net_packet_parse(packet, size, from, &at);
+}
+
+// Parse frames of block in place and give it back, false if kernel has not retired it yet
+static bool ring_block(struct tpacket_block_desc *bd, const struct timespec *real,
+    const struct timespec *mono, const struct timespec *polled_at, bool *losing) {
+  uint32_t status = __atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+  if (!(status & TP_STATUS_USER))
+    return false;
+  if (status & TP_STATUS_LOSING)
+    *losing = true;
+  const uint8_t *fh = ((uint8_t*)bd) + bd->hdr.bh1.offset_to_first_pkt;
+  for (uint i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+    ring_frame((const struct tpacket3_hdr *)fh, real, mono, polled_at);
+    fh += ((const struct tpacket3_hdr *)fh)->tp_next_offset;
+  }
+  __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Walk through blocks retired by kernel
+static void ring_parse(const struct timespec *polled_at) {
+  struct timespec real, mono;
+  if (mtr_clock.gettime(CLOCK_REALTIME, &real) || MONOTIME(&mono))
+    real.tv_sec = mono.tv_sec = 0;
+  bool losing = false;
+  for (uint n = 0; n < RING_BLOCK_NR; n++) {
+    if (!ring_block((struct tpacket_block_desc *)(ring.map + (size_t)ring.blk * RING_BLOCK_SIZE),
+         &real, &mono, polled_at, &losing))
+      break;
+    ring.blk = (ring.blk + 1) % RING_BLOCK_NR;
+  }
+  if (losing)
+    ring_stats();
+}
+#endif
+
+void net_icmp_parse(struct timespec *recv_at) { // NONNULL(1)
+#ifdef WITH_DGRAM
+  if (net_dgram) {
+    net_dgram_parse(recv_at);
+    return;
+  }
+#endif
+#ifdef WITH_RING
+  if (net_ring) {
+    ring_parse(recv_at);
+    return;
+  }
+#endif
+  uint8_t packet[MAXPACKET];
+  struct sockaddr_storage sa_in;
+  struct timespec at = *recv_at;
+  //
+  ssize_t size = net_broker ? net_broker_recv(packet, sizeof(packet), &sa_in, &at) :
+    recvfrom(recvsock, packet, MAXPACKET, 0, (struct sockaddr *)&sa_in, &sa_len);
+  net_packet_parse(packet, size, ((uint8_t*)&sa_in) + sa_addr_offset, &at);
+  // lanes reply in bursts, and icmp errors have to be seen before TCP sockets are checked
+  for (int i = 0; nlane && !net_broker && (size >= 0) && (i < MAXLANE * 8); i++) {
+    at = *recv_at;
+    size = recvfrom(recvsock, packet, MAXPACKET, MSG_DONTWAIT, (struct sockaddr *)&sa_in, &sa_len);
+    if (size >= 0)
+      net_packet_parse(packet, size, ((uint8_t*)&sa_in) + sa_addr_offset, &at);
+  }
 }
 
 const char *net_elem(int at, char key) {
@@ -994,7 +1600,8 @@ inline int net_min(void) {
   return (run_opts.minttl > 0) ? (run_opts.minttl - 1) : 0;
 }
 
-inline void net_end_transit(void) { for (int at = 0; at < MAXHOST; at++) host[at].transit = false; }
+static void end_transit(void) { for (int at = 0; at < MAXHOST; at++) host[at].transit = false; }
+void net_end_transit(void) { each_lane(end_transit); }
 
 static inline void set_bit_pattern(void) {
   if (run_opts.pattern < 0)
@@ -1014,21 +1621,41 @@ static inline void set_payload_size(void) {
     reset_pldsize = false;
   }
   if (payloadsize > (MAXPACKET - MINPACKET)) payloadsize = MAXPACKET - MINPACKET;
+  if (FLOWED && (payloadsize < sizeof(uint16_t))) payloadsize = sizeof(uint16_t); // room for checksum fix
   LOGMSG("%u", payloadsize);
 }
 
-int net_send_batch(void) {
-  if (reset_pattern)
-    set_bit_pattern();
-  if (reset_pldsize)
-    set_payload_size();
-  //
+// Probe goes to 'net_xmit_fn' instead of sockets (simulation)
+static bool net_send_xmit(int at) {
+  int seq = new_sequence(at);
+  if (!save_send_ts(seq))
+    return false;
+  TRACEPOINT(send, seq, at + 1, mtrtype, af, remote_ipaddr, TS2NSEC(seqlist[seq].time));
+  /*summ*/ net_queries[QR_SUM]++;
+  /*summ*/ net_queries[(mtrtype == IPPROTO_TCP) ? QR_TCP : ((mtrtype == IPPROTO_UDP) ? QR_UDP : QR_ICMP)]++;
+  return net_xmit_fn(at, seq);
+}
+
+// Reply to a probe given to 'net_xmit_fn': from the target it's
+// what the protocol gets there, from other hops it's time exceeded
+void net_xmit_reply(int seq, const t_ipaddr *addr, struct timespec *recv_at) { // NONNULL(2, 3)
+  if ((seq < 0) || (seq >= MAXSEQ))
+    return;
+  int reason = RE_EXCEED;
+  if (addr_equal(addr, remote_ipaddr))
+    reason = (mtrtype == IPPROTO_UDP) ? RE_UNREACH : RE_PONG;
+  /*summ*/ net_replies[QR_SUM]++;
+  /*summ*/ net_replies[(mtrtype == IPPROTO_TCP) ? QR_TCP : ((mtrtype == IPPROTO_UDP) ? QR_UDP : QR_ICMP)]++;
+  NET_STAT(seq, addr, recv_at, reason, NULL);
+}
+
+static int lane_batch(void) {
   // Send packet if needed
   { bool ping = true;
     if (run_opts.oncache && host[batch_at].up && (host[batch_at].seen > 0)
-      && ((time(NULL) - host[batch_at].seen) <= run_opts.cache))
+      && ((unixtime() - host[batch_at].seen) <= run_opts.cache))
         ping = false;
-    if (ping && !( (mtrtype == IPPROTO_TCP) ?
+    if (ping && !( net_xmit_fn ? net_send_xmit(batch_at) : (mtrtype == IPPROTO_TCP) ?
         net_send_tcp(batch_at) : net_send_icmp_udp(batch_at) ))
       LOGRET_RC(-1, "%s", "failed");
   }
@@ -1055,14 +1682,58 @@ int net_send_batch(void) {
   return 0;
 }
 
+// with several lanes every one sends its probe, the cycle is over when all of them are done
+int net_send_batch(void) {
+  if (reset_pattern)
+    set_bit_pattern();
+  if (reset_pldsize)
+    set_payload_size();
+  if (!nlane)
+    return lane_batch();
+  int rc = 1;
+  for (int i = 0; (i < nlane) && (rc >= 0); i++) {
+    lane_switch(i);
+    if (!lane->done) {
+      int re = lane_batch();
+      if (re < 0)
+        rc = -1;
+      else if (re > 0)
+        lane->done = true;
+      else
+        rc = 0;
+    }
+  }
+  lane_switch(0);
+  if (rc > 0)
+    for (int i = 0; i < nlane; i++)
+      lanes[i].done = false;
+  return rc;
+}
+
 static void net_sock_close(void) {
   CLOSE(sendsock4);
   CLOSE(recvsock4);
+#ifdef WITH_DGRAM
+  CLOSE(sendsock4_icmp);
+  CLOSE(sendsock4_udp);
+#endif
 #ifdef ENABLE_IPV6
   CLOSE(sendsock6_icmp);
   CLOSE(sendsock6_udp);
   CLOSE(recvsock6);
 #endif
+  CLOSE(brokersock);
+  net_broker = false;
+#ifdef WITH_RING
+  if (ring.map) {
+    ring_stats();
+    munmap(ring.map, (size_t)RING_BLOCK_SIZE * RING_BLOCK_NR);
+    ring.map = NULL;
+  }
+  CLOSE(ringsock);
+  net_ring = false;
+#endif
+  sendsock = recvsock = -1;
 }
 
 #ifdef LIBCAP
@@ -1089,11 +1760,15 @@ static void set_rawcap_flag(cap_flag_value_t onoff) {
 #define RAWCAP_OFF
 #endif
 
-static int net_socket(int domain, int type, int proto, const char *what) {
+static int net_socket(int domain, int type, int proto, const char *what UNUSED) {
   RAWCAP_ON;
   int sock = socket(domain, type, proto);
   if (sock < 0)
+#ifdef WITH_DGRAM
+    LOGMSG("%s: %s", what, strerror(errno)); // datagram sockets are the backup
+#else
     warn("%s", what);
+#endif
   else
     /*summ*/ sum_sock[0]++;
   RAWCAP_OFF;
@@ -1102,7 +1777,7 @@ static int net_socket(int domain, int type, int proto, const char *what) {
   return sock;
 }
 
-bool net_open(void) {
+static bool net_open_raw(void) {
   // mandatory ipv4
   RAWCAP_ON;
   sendsock4 = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
@@ -1130,6 +1805,14 @@ bool net_open(void) {
     sum_sock[0]++; /*summ*/
   RAWCAP_OFF;
 #endif
+#ifdef WITH_RING
+  // optional ring: without protocol it gets nothing till net_open_ring()
+  RAWCAP_ON;
+  ringsock = socket(AF_PACKET, SOCK_DGRAM, 0);
+  if (ringsock >= 0)
+    sum_sock[0]++; /*summ*/
+  RAWCAP_OFF;
+#endif
 #ifdef IP_HDRINCL
   int trueopt = 1; // tell that we provide IP header
   if (setsockopt(sendsock4, 0, IP_HDRINCL, &trueopt, sizeof(trueopt)) < 0) {
@@ -1141,6 +1824,293 @@ bool net_open(void) {
   return true;
 }
 
+#ifdef WITH_DGRAM
+static int dgram_socket(int domain, int proto, const char *what) {
+  int sock = socket(domain, SOCK_DGRAM, proto);
+  if (sock < 0) {
+    LOGMSG("%s: %s", what, strerror(errno));
+    return sock;
+  }
+  /*summ*/ sum_sock[0]++;
+  if (!dgram_sockopt(sock, domain)) {
+    warn("%s: setsockopt(sock=%d, IP_RECVERR)", what, sock);
+    CLOSE(sock);
+  }
+  return sock;
+}
+
+// Ping sockets for ICMP (allowed by net.ipv4.ping_group_range sysctl),
+// and udp sockets. Ipv6 ones are kept in the same variables as raw ones.
+bool net_open_dgram(void) {
+  net_sock_close();
+  sendsock4_icmp = dgram_socket(AF_INET, IPPROTO_ICMP, "icmp-dgram-sock");
+  sendsock4_udp  = dgram_socket(AF_INET, IPPROTO_UDP,  "udp-dgram-sock");
+#ifdef ENABLE_IPV6
+  sendsock6_icmp = dgram_socket(AF_INET6, IPPROTO_ICMPV6, "icmp6-dgram-sock");
+  sendsock6_udp  = dgram_socket(AF_INET6, IPPROTO_UDP,    "udp6-dgram-sock");
+#endif
+  net_dgram = (sendsock4_icmp >= 0) || (sendsock4_udp >= 0);
+  if (!net_dgram)
+    net_sock_close();
+  LOGMSG("icmp=%d udp=%d", sendsock4_icmp, sendsock4_udp);
+  return net_dgram;
+}
+#endif
+
+// Unprivileged client of broker that owns raw sockets
+bool net_open_broker(const char *path) { // NONNULL(1)
+  int sock = broker_connect(path);
+  if (sock < 0)
+    return false;
+  /*summ*/ sum_sock[0]++;
+  net_sock_close();
+#ifdef WITH_DGRAM
+  net_dgram = false;
+#endif
+  net_broker = true;
+  brokersock = sendsock = recvsock = sock;
+  LOGMSG("sock=%d: %s", sock, path);
+  return true;
+}
+
+int net_raw_recvsock(int family) {
+  if (net_dgram || net_broker)
+    return -1;
+#ifdef ENABLE_IPV6
+  if (family == AF_INET6)
+    return recvsock6;
+#endif
+  return (family == AF_INET) ? recvsock4 : -1;
+}
+
+// Send probe prepared by client, with IP header made here to not let clients spoof source
+bool net_raw_send(int family, int proto, int ttl, int tos, const void *dst,
+    const uint8_t *data, uint16_t size) { // NONNULL(5, 6)
+  uint8_t packet[MAXPACKET];
+  t_sockaddr to = {0};
+  socklen_t len = 0;
+  int sock = -1;
+  uint16_t pktsize = size;
+  const uint8_t *buff = data;
+  run_opts.qos = tos; // broker's own options are not in use
+  switch (family) {
+    case AF_INET:
+      to.SA_AF = AF_INET;
+      memcpy(&to.S_ADDR, dst, sizeof(to.S_ADDR));
+      len = sizeof(to.sin);
+      sock = sendsock4;
+#ifdef IP_HDRINCL
+      pktsize += sizeof(struct _iphdr);
+      if (pktsize > sizeof(packet)) {
+        errno = EMSGSIZE;
+        return false;
+      }
+      net_fill_ip_hdr((struct _iphdr *)packet, pktsize, ttl, tos, proto, &unspec_addr, dst);
+      memcpy(packet + sizeof(struct _iphdr), data, size);
+      buff = packet;
+#else
+      if (!settosttl(sock, ttl)) return false;
+#endif
+      break;
+#ifdef ENABLE_IPV6
+    case AF_INET6: {
+      to.SA_AF = AF_INET6;
+      memcpy(&to.S6ADDR, dst, sizeof(to.S6ADDR));
+      len = sizeof(to.sin6);
+      sock = (proto == IPPROTO_ICMP) ? sendsock6_icmp : sendsock6_udp;
+      if ((sock < 0) || !settosttl6(sock, ttl)) return false;
+      int opt = 6; // udp checksum offset
+      if ((proto == IPPROTO_UDP) && setsockopt(sock, IPPROTO_IPV6, IPV6_CHECKSUM, &opt, sizeof(opt)))
+        return false;
+    } break;
+#endif
+    default:
+      errno = EAFNOSUPPORT;
+      return false;
+  }
+  /*summ*/ net_queries[QR_SUM]++; if (proto == IPPROTO_ICMP) net_queries[QR_ICMP]++; else net_queries[QR_UDP]++;
+  return sendto(sock, buff, pktsize, 0, &to.sa, len) >= 0;
+}
+
+#ifdef WITH_RING
+// Incoming ICMP echo replies and errors (cooked frames start with IP header)
+static bool ring_filter(int sock) {
+  enum { ACCEPT = 18, DROP = 19 };
+#define RJ(to, at) ((to) - (at) - 1)
+  struct sock_filter code[] = {
+    /*  0 */ BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+    /*  1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, RJ(DROP, 1), 0),
+    /*  2 */ BPF_STMT(BPF_LD  | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+    /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, RJ(11, 3)),
+    /*  4 */ BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, offsetof(struct _iphdr, proto)),
+    /*  5 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, 0, RJ(DROP, 5)),
+    /*  6 */ BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    /*  7 */ BPF_STMT(BPF_LD  | BPF_B | BPF_IND, offsetof(struct _icmphdr, type)),
+    /*  8 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, RJ(ACCEPT, 8), 0),
+    /*  9 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_UNREACH, RJ(ACCEPT, 9), 0),
+    /* 10 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIME_EXCEEDED, RJ(ACCEPT, 10), RJ(DROP, 10)),
+    /* 11 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 0, RJ(DROP, 11)),
+    /* 12 */ BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 6),  // next header
+    /* 13 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMPV6, 0, RJ(DROP, 13)),
+    /* 14 */ BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 40), // icmp6 type
+    /* 15 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_ECHO_REPLY, RJ(ACCEPT, 15), 0),
+    /* 16 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_DST_UNREACH, RJ(ACCEPT, 16), 0),
+    /* 17 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP6_TIME_EXCEEDED, RJ(ACCEPT, 17), RJ(DROP, 17)),
+    /* 18 */ BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+    /* 19 */ BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+#undef RJ
+  SASSERT(ARRAY_LEN(code) == DROP + 1, "ring filter labels");
+  struct sock_fprog prog = { .len = ARRAY_LEN(code), .filter = code };
+  return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == 0;
+}
+
+// Replace raw recv-sockets with TPACKET_V3 ring: frames of a block are parsed at once
+bool net_open_ring(void) {
+  if (ringsock < 0) {
+    errno = EBADF;
+    return false;
+  }
+  int ver = TPACKET_V3;
+  struct tpacket_req3 req = {
+    .tp_block_size = RING_BLOCK_SIZE, .tp_block_nr = RING_BLOCK_NR,
+    .tp_frame_size = RING_FRAME_SIZE, .tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NR,
+    .tp_retire_blk_tov = RING_BLOCK_TOV,
+  };
+  struct sockaddr_ll sll = { .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL) };
+  if (!ring_filter(ringsock)
+   || (setsockopt(ringsock, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0)
+   || (setsockopt(ringsock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0))
+    return false;
+  void *map = mmap(NULL, (size_t)RING_BLOCK_SIZE * RING_BLOCK_NR, PROT_READ | PROT_WRITE, MAP_SHARED, ringsock, 0);
+  if (map == MAP_FAILED)
+    return false;
+  ring.map = map;
+  ring.blk = 0;
+  if (bind(ringsock, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+    return false;
+  CLOSE(recvsock4);
+#ifdef ENABLE_IPV6
+  CLOSE(recvsock6);
+#endif
+  net_ring = true;
+  recvsock = ringsock;
+  LOGMSG("sock=%d: %d blocks by %d bytes", ringsock, RING_BLOCK_NR, RING_BLOCK_SIZE);
+  return true;
+}
+#endif
+
+bool net_open(void) {
+  if (net_open_raw())
+    return true;
+#ifdef WITH_DGRAM
+  return net_open_dgram();
+#else
+  return false;
+#endif
+}
+
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_FILTER)
+// In-kernel filter on recv-socket, it's the same test as in net_icmp_parse():
+// echo replies with our id, and errors about our probes to the current target
+// (with several lanes the quoted protocol picks up the lane whose id or port is tested)
+static void net_filter(void) {
+  if ((recvsock < 0) || net_dgram || net_broker || net_ring)
+    return;
+  enum { L_NEXT, L_ECHO, L_ERR, L_ACCEPT, L_DROP, L_LANE, L_MAX = L_LANE + MAXLANE };
+  struct sock_filter code[32];
+  uint8_t jt[ARRAY_LEN(code)], jf[ARRAY_LEN(code)];
+  uint label[L_MAX] = {0};
+  uint n = 0;
+#define FLT_OP(op, val) do { code[n] = (struct sock_filter)BPF_STMT((op), (val)); \
+  jt[n] = jf[n] = L_NEXT; n++; } while (0)
+#define FLT_EQ(val, ok, fail) do { code[n] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (val), 0, 0); \
+  jt[n] = (ok); jf[n] = (fail); n++; } while (0)
+#define FLT_LDH(off) FLT_OP(BPF_LD | BPF_H | BPF_ABS, (off))
+  const uint icmp = iphdr_sz;                // icmp header
+  const uint orig = iphdr_sz + ipicmphdr_sz; // header of original udp, tcp, icmp
+  const uint dst = icmp + sizeof(struct _icmphdr) + (
+#ifdef ENABLE_IPV6
+    (af == AF_INET6) ? offsetof(struct ip6_hdr, ip6_dst) :
+#endif
+    offsetof(struct _iphdr, daddr));
+  const uint proto = icmp + sizeof(struct _icmphdr) + (
+#ifdef ENABLE_IPV6
+    (af == AF_INET6) ? offsetof(struct ip6_hdr, ip6_nxt) :
+#endif
+    offsetof(struct _iphdr, proto));
+  int nl = nlane ? nlane : 1, echo_lane = -1;
+  for (int i = 0; i < nl; i++)
+    if ((nlane ? lanes[i].proto : mtrtype) == IPPROTO_ICMP)
+      echo_lane = i;
+  //
+  FLT_OP(BPF_LD | BPF_B | BPF_ABS, icmp + offsetof(struct _icmphdr, type));
+  if (echo_lane >= 0)
+    FLT_EQ(echo_reply, L_ECHO, L_NEXT);
+  FLT_EQ(time_exceed, L_ERR, L_NEXT);
+  FLT_EQ(dst_unreach, L_ERR, L_DROP);
+  if (echo_lane >= 0) {
+    label[L_ECHO] = n;
+    FLT_LDH(icmp + offsetof(struct _icmphdr, id));
+    FLT_EQ(ntohs((nlane ? lane_prober(echo_lane) : prober)->id), L_ACCEPT, L_DROP); // id is in host byte order
+  }
+  label[L_ERR] = n;
+  const uint32_t *target = (const uint32_t *)remote_ipaddr;
+  for (uint i = 0; i < ((af == AF_INET) ? 1 : 4); i++) {
+    FLT_OP(BPF_LD | BPF_W | BPF_ABS, dst + i * sizeof(uint32_t));
+    FLT_EQ(ntohl(target[i]), L_NEXT, L_DROP);
+  }
+  for (int i = 0; i < nl; i++) {
+    int type = nlane ? lanes[i].proto : mtrtype;
+    const prober_t *p = nlane ? lane_prober(i) : prober;
+    uint fail = ((i + 1) < nl) ? (L_LANE + i + 1) : L_DROP;
+    label[L_LANE + i] = n;
+    if (nlane) {
+      FLT_OP(BPF_LD | BPF_B | BPF_ABS, proto);
+      FLT_EQ(((type == IPPROTO_ICMP) && (af != AF_INET)) ? IPPROTO_ICMPV6 : type, L_NEXT, fail);
+    }
+    switch (type) {
+      case IPPROTO_ICMP:
+        FLT_LDH(orig + offsetof(struct _icmphdr, id));
+        FLT_EQ(ntohs(p->id), L_ACCEPT, fail);
+        break;
+      case IPPROTO_UDP:
+        if (run_opts.port < 0) {
+          FLT_LDH(orig + offsetof(struct udphdr, uh_sport));
+          FLT_EQ(p->port, L_ACCEPT, fail);
+        } else {
+          FLT_LDH(orig + offsetof(struct udphdr, uh_dport));
+          FLT_EQ(run_opts.port, L_ACCEPT, fail);
+        }
+        break;
+      case IPPROTO_TCP:
+        FLT_LDH(orig + offsetof(struct tcphdr, th_dport));
+        FLT_EQ((run_opts.port > 0) ? run_opts.port : TCP_DEFAULT_PORT, L_ACCEPT, fail);
+        break;
+      default: break;
+    }
+  }
+  label[L_ACCEPT] = n;
+  FLT_OP(BPF_RET | BPF_K, UINT32_MAX);
+  label[L_DROP] = n;
+  FLT_OP(BPF_RET | BPF_K, 0);
+#undef FLT_LDH
+#undef FLT_EQ
+#undef FLT_OP
+  for (uint i = 0; i < n; i++) { // resolve labels
+    code[i].jt = jt[i] ? label[jt[i]] - i - 1 : 0;
+    code[i].jf = jf[i] ? label[jf[i]] - i - 1 : 0;
+  }
+  struct sock_fprog prog = { .len = n, .filter = code };
+  if (setsockopt(recvsock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+    LOGMSG("setsockopt(sock=%d, SO_ATTACH_FILTER): %s", recvsock, strerror(errno));
+  else
+    LOGMSG("sock=%d: %u instructions for proto=%d id=%u", recvsock, n, mtrtype, prober->id);
+}
+#else
+#define net_filter() NOOP
+#endif
+
 #ifdef ENABLE_IPV6
 static inline int net_getsock6(void) {
   switch (mtrtype) {
@@ -1150,26 +2120,129 @@ static inline int net_getsock6(void) {
   }
   return -1;
 }
-void net_setsock6(void) { sendsock = sendsock6 = net_getsock6(); }
+void net_setsock6(void) {
+  if (net_broker) return;
+  sendsock = sendsock6 = net_getsock6();
+  if (net_dgram) recvsock = sendsock;
+}
+#endif
+
+// Set sockets for the current address family and protocol
+static void net_setsock(void) {
+  if (net_broker) { // the same for all
+    sendsock = recvsock = brokersock;
+    return;
+  }
+  switch (af) {
+    case AF_INET:
+#ifdef WITH_DGRAM
+      if (net_dgram) {
+        sendsock = recvsock = (mtrtype == IPPROTO_ICMP) ? sendsock4_icmp :
+          ((mtrtype == IPPROTO_UDP) ? sendsock4_udp : -1);
+        break;
+      }
+#endif
+      sendsock = sendsock4;
+      recvsock = net_ring ? ringsock : recvsock4;
+      break;
+#ifdef ENABLE_IPV6
+    case AF_INET6:
+      net_setsock6();
+      if (!net_dgram)
+        recvsock = net_ring ? ringsock : recvsock6;
+      break;
+#endif
+    default: break;
+  }
+}
+
+// Select prober for the current target, protocol and source address,
+// allocate a new id for it if it's a new one (the oldest is recycled if no free slots)
+static void net_prober(void) {
+  const t_ipaddr *source = (const t_ipaddr *)(((uint8_t*)&lsa) + sa_addr_offset);
+  for (uint i = 0; i < nprober; i++) {
+    prober_t *p = &probers[i];
+    if ((p->family == af) && (p->proto == mtrtype)
+     && addr_equal(&p->target, remote_ipaddr) && addr_equal(&p->source, source)) {
+      prober = p;
+      return;
+    }
+  }
+  static uint oldest;
+  uint n = (nprober < MAXPROBER) ? nprober++ : (oldest++ % MAXPROBER);
+  prober_t *p = &probers[n];
+  if (id2prober[p->id] == (n + 1))
+    id2prober[p->id] = 0;
+  memset(p, 0, sizeof(*p));
+  p->family = af;
+  p->proto  = mtrtype;
+  addr_copy(&p->target, remote_ipaddr);
+  addr_copy(&p->source, source);
+  // ids go from a random base of process by odd stride, not up from pid: next pids are
+  // other mtr processes' ones, and ids of two bases meet as rarely as random ones
+  static uint16_t next_id;
+  static bool id_based;
+  if (!id_based) {
+    next_id = (uint16_t)(RANDUNIFORM(UINT16_MAX + 1) ^ mypid); // pid is mixed in if rand() is not seeded
+    id_based = true;
+  }
+  uint16_t id, port;
+  do { // the same id or port (they are 1:1 except wrapped ones) has to be free
+    id = next_id;
+    next_id += PROBER_ID_STRIDE;
+    port = IPPORT_RESERVED + id % (USHRT_MAX - IPPORT_RESERVED);
+  } while (id2prober[id] || port_prober(port));
+  id2prober[id] = n + 1;
+  p->id   = id;
+  p->port = port;
+  prober = p;
+  LOGMSG("prober#%u: id=%u port=%u proto=%d", n, id, p->port, mtrtype);
+}
+
+// Source address that kernel chooses for the target unless it's bound
+static void flow_source(void) {
+  const t_ipaddr *bound = (const t_ipaddr *)(((uint8_t*)&lsa) + sa_addr_offset);
+  if (addr_exist(bound)) {
+    addr_copy(&flow_src, bound);
+    return;
+  }
+  memset(&flow_src, 0, sizeof(flow_src));
+  int sock = socket(af, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    WARN("socket(af=%d)", af);
+    return;
+  }
+  /*summ*/ sum_sock[0]++;
+  t_sockaddr to = rsa, from = {0};
+  socklen_t len = sizeof(to.sin);
+#ifdef ENABLE_IPV6
+  if (af == AF_INET6) {
+    to.S6PORT = htons(LO_UDPPORT);
+    len = sizeof(to.sin6);
+  } else
 #endif
+  to.S_PORT = htons(LO_UDPPORT);
+  if (connect(sock, &to.sa, len) || getsockname(sock, &from.sa, &len))
+    WARN("source of flow (sock=%d)", sock);
+  else
+    addr_copy(&flow_src, ((uint8_t*)&from) + sa_addr_offset);
+  CLOSE(sock);
+}
 
 bool net_set_host(const t_ipaddr *addr) { // NONNULL(1)
   rsa.SA_AF = af;
+  net_setsock();
   switch (af) {
     case AF_INET:
-      sendsock = sendsock4;
-      recvsock = recvsock4;
       addr_copy(&rsa.S_ADDR, addr);
       remote_ipaddr = (t_ipaddr*)&rsa.S_ADDR;
     break;
 #ifdef ENABLE_IPV6
     case AF_INET6:
-      if ((recvsock6 < 0) || ((mtrtype != IPPROTO_TCP) && (sendsock6 < 0))) {
+      if (!net_broker && ((!net_dgram && !net_ring && (recvsock6 < 0)) || ((mtrtype != IPPROTO_TCP) && (sendsock6 < 0)))) {
         warnx("%s", NOSOCK6_ERR);
         return false;
       }
-      sendsock = sendsock6;
-      recvsock = recvsock6;
       addr_copy(&rsa.S6ADDR, addr);
       remote_ipaddr = (t_ipaddr*)&rsa.S6ADDR;
     break;
@@ -1182,9 +2255,14 @@ bool net_set_host(const t_ipaddr *addr) { // NONNULL(1)
     warnx("%s: %s", TARGET_STR, strerror(EINVAL));
     return false;
   }
+  if (net_dgram && (mtrtype != IPPROTO_TCP) && (sendsock < 0)) {
+    warnx("%s: %s", (mtrtype == IPPROTO_ICMP) ? "ICMP" : "UDP", NODGRAM_ERR);
+    return false;
+  }
 
   net_reset();
-  { struct sockaddr_storage ss = {0};
+  if ((recvsock >= 0) && !net_broker && !net_ring) {
+    struct sockaddr_storage ss = {0};
     socklen_t len = sizeof(ss);
     if (getsockname(recvsock, (struct sockaddr *)&ss, &len) < 0)
       warn("getsockname()");
@@ -1205,17 +2283,29 @@ bool net_set_host(const t_ipaddr *addr) { // NONNULL(1)
       }
     }
   }
-  portpid = IPPORT_RESERVED + mypid % (USHRT_MAX - IPPORT_RESERVED);
+  if (FLOWED)
+    flow_source();
+  each_lane(net_prober);
+  net_filter();
   return true;
 }
 
-void net_reset(void) {
-  // clear all query-response cache
-  for (int at = 0; at < MAXHOST; at++)
-    for (int ndx = 0; ndx < MAXPATH; ndx++)
+const t_ipaddr *net_target(void) { return remote_ipaddr; }
+
+// clear query-response cache of all addresses, and free their storage
+static void free_paths(void) {
+  for (int at = 0; at < MAXHOST; at++) {
+    for (int ndx = 0; ndx < PATHS_AT(at); ndx++)
       SET_NEW_ADDR(&unspec_addr, NULL);
-  //
-  memset(host, 0, sizeof(host));
+    free(host[at].more);
+    host[at].more = NULL;
+    host[at].paths = host[at].nmore = 0;
+    memset(host[at].pathndx, 0, sizeof(host[at].pathndx));
+  }
+}
+
+static void reset_lane(void) {
+  memset(host, 0, MAXHOST * sizeof(nethost_t));
 #ifdef TUIMODE
   for (int at = 0; at < MAXHOST; at++) {
     for (int i = 0; i < SAVED_PINGS; i++)
@@ -1223,12 +2313,19 @@ void net_reset(void) {
     host[at].saved_seq_offset = -SAVED_PINGS + 2;
   }
 #endif
-  poll_close_tcpfds();
   for (int i = 0; i < MAXSEQ; i++)
     seqlist[i].transit = false;
   batch_at = net_min();
   stopper  = MAXHOST;
   numhosts = 10;
+  lane->done = false;
+}
+
+void net_reset(void) {
+  each_lane(free_paths);
+  intern_reset();
+  each_lane(reset_lane);
+  poll_close_tcpfds();
 }
 
 
@@ -1256,19 +2353,43 @@ bool net_set_ifaddr(const char *ifaddr) { // NONNULL(1)
 #endif
     default: break;
   }
-  if (bind(sendsock, &lsa.sa, len) < 0) {
-    warn("bind(%d)", sendsock);
+  if (net_broker) { // broker's sockets are shared
+    warnx("%s: %s", ifaddr, strerror(EOPNOTSUPP));
     return false;
   }
+  int socks[] = { sendsock, -1 };
+#ifdef WITH_DGRAM
+  if (net_dgram) { // bind sockets of both protocols
+#ifdef ENABLE_IPV6
+    if (af == AF_INET6) {
+      socks[0] = sendsock6_icmp;
+      socks[1] = sendsock6_udp;
+    } else
+#endif
+    { socks[0] = sendsock4_icmp;
+      socks[1] = sendsock4_udp; }
+  }
+#endif
+  for (uint i = 0; i < ARRAY_LEN(socks); i++)
+    if ((socks[i] >= 0) && (bind(socks[i], &lsa.sa, len) < 0)) {
+      warn("bind(%d)", socks[i]);
+      return false;
+    }
+  each_lane(net_prober); // source address is a part of prober's key
+  net_filter();
   return true;
 }
 
 void net_close(void) {
   net_sock_close();
-  // clear memory allocated for query-response cache
-  for (int at = 0; at < MAXHOST; at++)
-    for (int ndx = 0; ndx < MAXPATH; ndx++)
-      SET_NEW_ADDR(&unspec_addr, NULL);
+  each_lane(free_paths);
+  for (int i = 1; i < nlane; i++) {
+    free(lanes[i].host);
+    free(lanes[i].seqlist);
+  }
+  nlane = 0;
+  host = host0;
+  seqlist = seqlist0;
 }
 
 int net_wait(void) { return recvsock; }
@@ -1285,7 +2406,25 @@ static int err_slippage(int sock) {
 }
 
 // Check connection state with error-slippage
-void net_tcp_parse(int sock, int seq, int noerr, struct timespec *recv_at) { // NONNULL(4)
+static void tcp_parse(int sock, int seq, int noerr, struct timespec *recv_at) NONNULL(4);
+static void tcp_parse(int sock, int seq, int noerr, struct timespec *recv_at) {
+#ifdef WITH_DGRAM
+  if (TCP_ERRQUEUE) { // intermediate hops are taken from the error queue
+    uint8_t data[MINPACKET * 4];
+    struct sockaddr_storage sa;
+    const struct sock_extended_err *ee = NULL;
+    struct timespec at = *recv_at;
+    if ((dgram_recv(sock, true, data, sizeof(data), &sa, &ee, &at) >= 0) && ee && (ee->ee_type == time_exceed)) {
+      const struct sockaddr *offender = (const struct sockaddr *)(ee + 1);
+      LOGMSG("icmp error type=%u for sock=%d", ee->ee_type, sock);
+      if (offender->sa_family == af)
+        NET_STAT(seq, ((const uint8_t*)offender) + sa_addr_offset, &at, -1, NULL);
+      seqlist[seq].transit = false;
+      /*summ*/ net_replies[QR_SUM]++; net_replies[QR_TCP]++;
+      return;
+    }
+  }
+#endif
   int reason = -1, e = err_slippage(sock);
   LOGMSG("recv <e=%d> sock=%d ts=%lld.%09ld", e, sock, (long long)recv_at->tv_sec, recv_at->tv_nsec);
   // if no errors, or connection refused, or host down, the target is probably reached
@@ -1309,10 +2448,17 @@ void net_tcp_parse(int sock, int seq, int noerr, struct timespec *recv_at) { //
   if (noerr) { /*summ*/ net_replies[QR_SUM]++; net_replies[QR_TCP]++; }
 }
 
+void net_tcp_parse(int sock, int seq, int noerr, struct timespec *recv_at) { // NONNULL(4)
+  if (nlane && !lane_proto(IPPROTO_TCP))
+    return;
+  tcp_parse(sock, seq, noerr, recv_at);
+  lane_switch(0);
+}
+
 // Clean timed out TCP connection
-bool net_timedout(int seq) {
+static bool tcp_timedout(int seq) {
   struct timespec now, dt;
-  if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+  if (MONOTIME(&now) < 0) {
     keep_error(errno, __func__);
     return false;
   }
@@ -1320,10 +2466,19 @@ bool net_timedout(int seq) {
   if (time2msec(dt) <= run_opts.syn)
     return false;
   LOGMSG("clean tcp seq=%d after %d sec", seq, run_opts.syn / MIL);
+  TRACEPOINT(timeout, seq, seqlist[seq].at + 1, TS2NSEC(seqlist[seq].time), TS2NSEC(now));
   seqlist[seq].transit = false;
   return true;
 }
 
+bool net_timedout(int seq) {
+  if (nlane && !lane_proto(IPPROTO_TCP))
+    return true;
+  bool rc = tcp_timedout(seq);
+  lane_switch(0);
+  return rc;
+}
+
 #ifdef ENABLE_DNS
 static void save_ptr_answer(int at, int ndx, const char* answer, size_t alen) {
   if (RPTR_AT_NDX(at, ndx)) {
@@ -1332,18 +2487,98 @@ static void save_ptr_answer(int at, int ndx, const char* answer, size_t alen) {
     LOGMSG("resolv update at=%d ndx=%d for %s", at, ndx,
       addr2str(&IP_AT_NDX(at, ndx), sizeof(str), str));
 #endif
-    free(RPTR_AT_NDX(at, ndx));
     RPTR_AT_NDX(at, ndx) = NULL;
   }
   size_t lim = (alen < NAMELEN) ? alen : NAMELEN;
   if (strnlen(answer, lim))
-    RPTR_AT_NDX(at, ndx) = strndup(answer, lim);
+    RPTR_AT_NDX(at, ndx) = intern_str(answer, lim);
   else { // if no answer, save ip-address in text representation
     char str[MAX_ADDRSTRLEN] = {0};
-    RPTR_AT_NDX(at, ndx) = strndup(addr2str(&IP_AT_NDX(at, ndx), sizeof(str), str), NAMELEN);
+    RPTR_AT_NDX(at, ndx) = intern_str(addr2str(&IP_AT_NDX(at, ndx), sizeof(str), str), NAMELEN);
   }
   if (!RPTR_AT_NDX(at, ndx))
-    WARN("[%d:%d] strndup()", at, ndx);
+    WARNX("[%d:%d] intern_str()", at, ndx);
+  else if (net_resolved_fn)
+    net_resolved_fn(at, ndx);
+}
+#endif
+
+
+//// offline replay: probes and replies of a recorded stream go through net_stat()
+
+static int replay_seq[MAXHOST]; // probe in transit at hop, +1
+
+bool net_replay_start(int family) {
+#ifdef ENABLE_IPV6
+  net_settings((family == AF_INET6) ? IPV6_ENABLED : IPV6_DISABLED);
+#else
+  if (family != AF_INET)
+    return false;
+  net_settings(IPV6_DISABLED);
+#endif
+  rsa.SA_AF = af;
+  remote_ipaddr =
+#ifdef ENABLE_IPV6
+    (af == AF_INET6) ? (t_ipaddr*)&rsa.S6ADDR :
+#endif
+    (t_ipaddr*)&rsa.S_ADDR;
+  addr_copy(remote_ipaddr, &unspec_addr);
+  net_reset();
+  memset(replay_seq, 0, sizeof(replay_seq));
+  return true;
+}
+
+void net_replay_target(const t_ipaddr *addr) { addr_copy(remote_ipaddr, addr); }
+
+int net_replay_sent(int at, const struct timespec *sent_at) {
+  if ((at < 0) || (at >= MAXHOST))
+    return -1;
+  int seq = new_sequence(at);
+  seqlist[seq].time = *sent_at;
+  replay_seq[at] = seq + 1;
+  return seq;
+}
+
+// a reply without recorded probe counts the probe too
+bool net_replay_reply(int at, const t_ipaddr *addr, int usec, const struct timespec *recv_at) {
+  if ((at < 0) || (at >= MAXHOST) || (usec < 0))
+    return false;
+  int seq = replay_seq[at] - 1;
+  if ((seq < 0) || !seqlist[seq].transit || (seqlist[seq].at != at))
+    seq = new_sequence(at);
+  replay_seq[at] = 0;
+  struct timespec rtt = { .tv_sec = usec / MICRO, .tv_nsec = (usec % MICRO) * MIL };
+  timespecsub(recv_at, &rtt, &seqlist[seq].time);
+  return NET_STAT(seq, addr, (struct timespec *)recv_at, -1, NULL);
+}
+
+// packet as raw socket gives it (captures, benchmarks)
+void net_replay_packet(uint8_t *packet, ssize_t size, const void *from, struct timespec *recv_at) {
+  net_packet_parse(packet, size, from, recv_at);
+}
+
+#ifdef WITH_RING
+// TPACKET_V3 block as kernel retires it to ring (benchmarks), false if it's not retired
+bool net_replay_block(void *block, const struct timespec *polled_at) {
+  struct timespec real, mono;
+  if (mtr_clock.gettime(CLOCK_REALTIME, &real) || MONOTIME(&mono))
+    real.tv_sec = mono.tv_sec = 0;
+  bool losing = false;
+  return ring_block(block, &real, &mono, polled_at, &losing);
+}
+#endif
+
+// what probes of the current prober carry: icmp id and udp source port
+void net_replay_ids(uint16_t *id, uint16_t *port) {
+  *id = prober->id;
+  *port = prober->port;
+}
+
+#ifdef ENABLE_DNS
+void net_replay_name(int at, const t_ipaddr *addr, const char *name) {
+  int ndx = ((at >= 0) && (at < MAXHOST)) ? addr2ndx(at, addr) : -1;
+  if (ndx >= 0)
+    save_ptr_answer(at, ndx, name, strlen(name) + 1);
 }
 #endif
 
@@ -1362,14 +2597,58 @@ void net_assert(void) { // to be sure
 void net_set_type(int type) {
   LOGMSG("proto type: %d", type);
   mtrtype = type;
-  hdr_minsz = iphdr_sz;
-  switch (type) {
-    case IPPROTO_ICMP: hdr_minsz += sizeof(struct _icmphdr); break;
-    case IPPROTO_UDP:  hdr_minsz += sizeof(struct udphdr);   break;
-    case IPPROTO_TCP:  hdr_minsz += sizeof(struct tcphdr);   break;
-    default: warnx("%d: %s", type, strerror(EPROTONOSUPPORT));
+  set_hdr_sizes();
+  if (net_dgram)
+    net_setsock(); // sockets are per protocol
+  if (addr_exist(remote_ipaddr))
+    net_prober(); // if target is already set
+  net_filter(); // if recv-socket is already set
+}
+
+// Probe with 'n' protocols at once, the first one is primary
+bool net_set_lanes(int n, const int proto[n]) { // NONNULL(2)
+  if ((n < 1) || (n > MAXLANE) || nlane) {
+    errno = EINVAL;
+    return false;
   }
-  minfailsz = hdr_minsz + iphdr_sz + sizeof(struct _icmphdr);
+  net_set_type(proto[0]);
+  if (n < 2)
+    return true;
+  if (net_dgram) { // sockets are per protocol
+    errno = EOPNOTSUPP;
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    lanes[i] = (lane_t){ .proto = proto[i], .host = host0, .seqlist = seqlist0, .prober = prober,
+      .numhosts = 10, .stopper = MAXHOST };
+    if (i) {
+      lanes[i].host = calloc(MAXHOST, sizeof(nethost_t));
+      lanes[i].seqlist = calloc(MAXSEQ, sizeof(struct sequence));
+      if (!lanes[i].host || !lanes[i].seqlist) {
+        WARN("lane#%d calloc()", i);
+        for (int j = 1; j <= i; j++) {
+          free(lanes[j].host);
+          free(lanes[j].seqlist);
+        }
+        return false;
+      }
+    }
+  }
+  nlane = n;
+  lane = lanes;
+  LOGMSG("%d lanes", n);
+  return true;
+}
+
+inline int net_lanes(void) { return nlane; }
+int net_lane_proto(int i) { return ((i >= 0) && (i < nlane)) ? lanes[i].proto : mtrtype; }
+void net_lane_view(int i) { if ((i >= 0) && (i < nlane)) lane_switch(i); }
+
+bool net_proto_on(int proto) {
+  for (int i = 0; i < nlane; i++)
+    if (lanes[i].proto == proto)
+      return true;
+  return mtrtype == proto;
 }
 
 #define NET46SETS(n_sz, n_er, n_te, n_un) { \
@@ -1419,17 +2698,3 @@ const char *mpls2str(const mpls_label_t *label, size_t size, char buff[size], ui
   return buff;
 }
 #endif
-
-// type must correspond 'id' in 'ns_msg' (uint16_t)
-// it's used as a hint for fast search, 16bits as [hash:7 at:6 ndx:3]
-uint16_t str2hint(const char* str, uint16_t at, uint16_t ndx) {
-  uint16_t hint = 0;
-  uint8_t ch = 0;
-  while ((ch = *str++))
-    hint = ((hint << 5) + hint) ^ ch; // h * 33 ^ ch
-  hint &= IDMASK;
-  hint |= AT2ID(at);
-  hint |= ID2NDX(ndx);
-  return hint;
-}
-
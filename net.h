@@ -30,15 +30,15 @@
 #include "common.h"
 
 #define PAYLOAD_SIZE 56     // default ICMP,UDP payload size (64 byte IP payload - 8 byte header)
-#define MAXHOST 64          // if you choose 256, then adjust IDMASK ID2AT AT2ID ID2NDX
-#define MAXPATH 8           // if you change it, then adjust macros
+#define MAXHOST 64          // maximum hops
+#define MAXPATH 64          // maximum paths at hop, the first PATHINLINE are kept in place
+#define PATHINLINE 8        // paths in place, the rest are allocated as they come
+#define PATHHASH 128        // address-to-index hash at hop, power of 2 and over MAXPATH
 #define MAXSEQ 16384        // maximum pings in processing
 #define MAX_MPLS_LABEL 8    // maximum mpls labels
-// 16bits as [hash:7 at:6 ndx:3]
-#define IDMASK    (0xFE00)
-#define AT2ID(n)  (((n) & 0x003F) << 3)
-#define ID2AT(n)  (((n) >> 3) & 0x003F)
-#define ID2NDX(n) ((n) & 0x7)
+#define MAXLANE 3           // protocols probing at once
+#define MAXFLOW 64          // flows of flow-stable probes, one bit each in eaddr_t 'flows'
+enum { MDA_MINCONF = 50, MDA_MAXCONF = 99 }; // confidence of multipath detection [%]
 
 #define MAXPACKET 1500 // limit it to default MTU
 #define MINPACKET 28   // 20 bytes IP and 8 bytes ICMP or UDP
@@ -101,18 +101,19 @@ typedef struct mpls_data {
 
 #ifdef WITH_IPINFO
 typedef struct ii_record_view {
-  char *view;
-  char *src[MAX_WHOIS_SOURCES]; // records from all sources
+  const char *view;
+  const char *src[MAX_WHOIS_SOURCES]; // records from all sources
 } ii_record_view_t;
 #endif
 
 // Address(es) plus associated data
 typedef struct eaddr {
   t_ipaddr ipaddr;
-  char *q_ptr, *r_ptr;                // query, reply
+  // strings are interned, they're freed all at once in net_reset()
+  const char *q_ptr, *r_ptr;          // query, reply
 #ifdef WITH_IPINFO
-  char *q_txt;                        // query
-  ii_record_view_t rec[MAX_II_ITEMS]; // parsed reply
+  const char *q_txt;                  // query
+  ii_record_view_t *rec;              // parsed reply: MAX_II_ITEMS records if there's data
 #endif
   time_t q_ptr_ts; // timestamp when 'q_ptr' is sent
 #ifdef WITH_IPINFO
@@ -121,12 +122,19 @@ typedef struct eaddr {
 #ifdef WITH_MPLS
   mpls_data_t mpls;
 #endif
+  // per-path statistics
+  int recv;        // replies
+  double avg;      // mean rtt [msec]
+  uint64_t flows;  // flows that took this path (flow-stable modes)
 } eaddr_t;
 
 // Hop description
 typedef struct nethost {
   // addresses with all associated data (dns names, mpls labels, extended ip info)
-  eaddr_t eaddr[MAXPATH];
+  eaddr_t eaddr[PATHINLINE]; // in place
+  eaddr_t *more;          // and the rest, 'nmore' allocated
+  int paths, nmore;       // addresses known, allocated beyond the inline ones
+  uint8_t pathndx[PATHHASH]; // address hash: index + 1, 0 if unused
   int current;            // index of the last received address
   // a lot of statistics
   int sent, recv;         // %d
@@ -141,40 +149,89 @@ typedef struct nethost {
 #endif
   time_t seen;            // timestamp for caching, last seen
 } nethost_t;
-extern nethost_t host[];
+extern nethost_t *host; // hop table of the lane in view
 
 typedef struct atndx { int at, ndx, type; } atndx_t;
 
 extern char localaddr[];
 
 // helpful macros
-#define CURRENT_IP(at)   (host[at].eaddr[host[at].current].ipaddr)
-#define IP_AT_NDX(at, ndx)   (host[at].eaddr[ndx].ipaddr)
+#define PATH_AT_NDX(at, ndx) (*(((ndx) < PATHINLINE) ? &host[at].eaddr[ndx] : &host[at].more[(ndx) - PATHINLINE]))
+#define PATHS_AT(at)     (host[at].paths)
+#define CURRENT_IP(at)   (PATH_AT_NDX(at, host[at].current).ipaddr)
+#define IP_AT_NDX(at, ndx)   (PATH_AT_NDX(at, ndx).ipaddr)
 #ifdef WITH_MPLS
-#define CURRENT_MPLS(at) (host[at].eaddr[host[at].current].mpls)
-#define MPLS_AT_NDX(at, ndx) (host[at].eaddr[ndx].mpls)
+#define CURRENT_MPLS(at) (PATH_AT_NDX(at, host[at].current).mpls)
+#define MPLS_AT_NDX(at, ndx) (PATH_AT_NDX(at, ndx).mpls)
 #endif
-#define QPTR_TS_AT_NDX(at, ndx) (host[at].eaddr[ndx].q_ptr_ts)
-#define QPTR_AT_NDX(at, ndx) (host[at].eaddr[ndx].q_ptr)
-#define RPTR_AT_NDX(at, ndx) (host[at].eaddr[ndx].r_ptr)
+#define QPTR_TS_AT_NDX(at, ndx) (PATH_AT_NDX(at, ndx).q_ptr_ts)
+#define QPTR_AT_NDX(at, ndx) (PATH_AT_NDX(at, ndx).q_ptr)
+#define RPTR_AT_NDX(at, ndx) (PATH_AT_NDX(at, ndx).r_ptr)
 #ifdef WITH_IPINFO
-#define QTXT_TS_AT_NDX(at, ndx) (host[at].eaddr[ndx].q_txt_ts)
-#define QTXT_AT_NDX(at, ndx) (host[at].eaddr[ndx].q_txt)
-#define II_VIEW_AT(at, ndx, num) (host[at].eaddr[ndx].rec[num].view)
-#define II_SRC_AT(at, ndx, num, sndx) (host[at].eaddr[ndx].rec[num].src[sndx])
-#define II_REC_ARR(at, ndx) (host[at].eaddr[ndx].rec)
-#define II_REC_ARR_LEN ARRAY_LEN(II_REC_ARR(0, 0))
-#define II_SRC_ARR(at, ndx, num) (host[at].eaddr[ndx].rec[num].src)
-#define II_SRC_ARR_LEN ARRAY_LEN(II_SRC_ARR(0, 0, 0))
+#define QTXT_TS_AT_NDX(at, ndx) (PATH_AT_NDX(at, ndx).q_txt_ts)
+#define QTXT_AT_NDX(at, ndx) (PATH_AT_NDX(at, ndx).q_txt)
+#define II_REC_ARR(at, ndx) (PATH_AT_NDX(at, ndx).rec)
+#define II_REC_ARR_LEN MAX_II_ITEMS
+#define II_SRC_ARR_LEN MAX_WHOIS_SOURCES
+// read-only, records are set in ipinfo.c
+#define II_VIEW_AT(at, ndx, num) (II_REC_ARR(at, ndx) ? II_REC_ARR(at, ndx)[num].view : NULL)
+#define II_SRC_AT(at, ndx, num, sndx) (II_REC_ARR(at, ndx) ? II_REC_ARR(at, ndx)[num].src[sndx] : NULL)
 #endif
 
 enum IPV6_ENDIS { IPV6_UNDEF = -1, IPV6_DISABLED = 0, IPV6_ENABLED = 1 };
 
+#ifdef WITH_DGRAM
+extern bool net_dgram;
+bool net_open_dgram(void);
+#else
+#define net_dgram false
+#endif
+#ifdef WITH_RING
+extern bool net_ring;
+extern ulong net_ring_stat[]; // packets and drops
+bool net_open_ring(void);
+#else
+#define net_ring false
+#endif
+extern bool net_broker;
+// hooks: reply at hop, new address at hop, hostname of address at hop is resolved, probe is sent
+extern void (*net_reply_fn)(int at, int ndx, int usec);
+extern void (*net_newhop_fn)(int at, int ndx);
+extern void (*net_resolved_fn)(int at, int ndx);
+extern void (*net_sent_fn)(int at, int seq);
+extern bool (*net_xmit_fn)(int at, int seq); // instead of sockets if set
+bool net_open_broker(const char *path) NONNULL(1);
+// broker side: send probes of clients with own raw sockets
+bool net_raw_send(int family, int proto, int ttl, int tos, const void *dst,
+  const uint8_t *data, uint16_t size) NONNULL(5, 6);
+int net_raw_recvsock(int family);
+
 void net_settings(enum IPV6_ENDIS ipv6_enabled);
 bool net_open(void);
 void net_assert(void);
 void net_set_type(int type);
+bool net_set_lanes(int n, const int proto[n]) NONNULL(2);
+int net_lanes(void);           // protocols probing at once, 0 if just one
+int net_lane_proto(int i);
+void net_lane_view(int i);     // hop table of lane 'i' is seen till the next call
+bool net_proto_on(int proto);  // probing with 'proto'
 bool net_set_host(const t_ipaddr *ipaddr) NONNULL(1);
+const t_ipaddr *net_target(void);
+// offline replay
+bool net_replay_start(int family);
+void net_replay_target(const t_ipaddr *addr) NONNULL(1);
+int net_replay_sent(int at, const struct timespec *sent_at) NONNULL(2); // sequence or -1
+bool net_replay_reply(int at, const t_ipaddr *addr, int usec, const struct timespec *recv_at) NONNULL(2, 4);
+void net_replay_packet(uint8_t *packet, ssize_t size, const void *from, struct timespec *recv_at) NONNULL(1, 3, 4);
+void net_replay_ids(uint16_t *id, uint16_t *port) NONNULL(1, 2);
+#ifdef WITH_RING
+bool net_replay_block(void *block, const struct timespec *polled_at) NONNULL(1, 2);
+#endif
+#ifdef ENABLE_DNS
+void net_replay_name(int at, const t_ipaddr *addr, const char *name) NONNULL(2, 3);
+#endif
+// replies to probes of 'net_xmit_fn'
+void net_xmit_reply(int seq, const t_ipaddr *addr, struct timespec *recv_at) NONNULL(2, 3);
 bool net_set_ifaddr(const char *ifaddr) NONNULL(1);
 void net_reset(void);
 void net_close(void);
@@ -207,7 +264,6 @@ void  net_setsock6(void);
 const char *mpls2str(const mpls_label_t *label,
   size_t size, char buff[size], uint indent) NONNULL(1, 3);
 #endif
-uint16_t str2hint(const char* str, uint16_t at, uint16_t ndx);
 void waitspec(struct timespec *tv);
 void keep_error(int rc, const char *prefix);
 const char* rstrerror(int rc);
@@ -112,6 +112,9 @@
 #define _JMAX_HINT  "Worst Jitter"
 #define _JINT_STR   "Jint"
 #define _JINT_HINT  "Interarrival Jitter"
+// path fields
+#define _REPLIES_STR "Replies"
+#define _FLOWS_STR   "Flows"
 
 // cmd help
 #define COMMANDS_STR _("Commands")
@@ -155,6 +158,11 @@
 #define STR_IN_SECONDS _("SECONDS")
 #define STR_IP_INFO    _("SERVER,FIELDS")
 #define STR_IN_BYTES   _("BYTES")
+#define STR_SOCKET     _("SOCKET")
+#define STR_NAME       _("NAME")
+#define STR_FILE       _("FILE")
+#define STR_PERCENT    _("PERCENT")
+#define STR_PROTOS     _("PROTO,PROTO")
 
 // option hints
 #define BITPATT_STR    _("Bit pattern")
@@ -168,12 +176,16 @@
 #define MUTEXCL_ERR    _("Mutually exclusive options")
 #define TCP_TOUT_STR   _("TCP timeout")
 #define CACHE_TOUT_STR _("Cache timeout")
+#define FLOWID_STR     _("Flow ID")
+#define MDACONF_STR    _("MDA confidence")
+#define PROTOS_STR     _("Protocols")
 
 // misc
 #define SOURCE_STR   _("Source")
 #define TARGET_STR   _("Target")
 #define TARGETS_STR  _("Targets")
 #define ARGS_STR     _("Args")
+#define LOOP_STR     _("Loop")
 #define HOP_STR      _("Hop")
 #define DATA_STR     _("Data")
 #define ACTIVE_STR   _("Active")
@@ -190,7 +202,18 @@
 #define CLOSED_STR   _("closed")
 #define QUERIES_STR  _("queries")
 #define REPLIES_STR  _("replies")
+#define SHARED_STR   _("shared")
+#define PREFIXES_STR _("prefixes")
+#define INTERNED_STR _("interned")
+#define LOOKUPS_STR  _("lookups")
+#define BYTES_STR    _("bytes")
+#define RPACKETS_STR _("packets")
+#define DROPS_STR    _("drops")
+#define PUBLISHED_STR _("published")
 #define PORTNUM_STR  _("port number")
+#define FLOWS_STR    _("flows")
+#define PATHS_STR    _("Paths")
+#define LANES_STR    _("Lanes")
 
 // at start before locale init
 #define RAWSOCK_ERR  "Unable to get raw sockets"
@@ -218,7 +241,14 @@
 //
 #define NOPOOLMEM_ERR _("No place in pool for sockets")
 #define NOSOCK6_ERR   _("No IPv6 sockets")
+#define NODGRAM_ERR   _("No datagram socket (check net.ipv4.ping_group_range)")
+#define BROKER_ERR    _("Unable to connect to probe broker")
+#define NORING_ERR    _("Unable to set up packet ring")
+#define REPLAY_ERR    _("Unable to open recorded stream")
+#define HISTORY_ERR   _("Unable to open history file")
+#define EVRING_ERR    _("Unable to set up shared memory for events")
 #define NODNS_ERR     _("No nameservers")
+#define TCPFLOW_WARN  _("TCP probes are not flow-stable")
 
 
 #endif
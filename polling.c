@@ -31,7 +31,6 @@
 
 #include "polling.h"
 #include "net.h"
-#include "display.h"
 #ifdef ENABLE_DNS
 #include "dns.h"
 #endif
@@ -54,6 +53,11 @@ enum { FD_STDIN, FD_NET,
 #endif
 FD_MAX };
 
+void (*eachpass_fn)(void);
+void (*dispclear_fn)(void);
+key_action_t (*keyaction_fn)(void);
+void (*poll_cycle_fn)(long cycle);
+
 static long numpings;
 
 enum { NO_GRACE, GRACE_START, GRACE_FINISH }; // state of grace period
@@ -70,6 +74,7 @@ static bool need_dns;
 
 #define SET_POLLFD(ndx, sock) { allfds[ndx].fd = sock; allfds[ndx].revents = 0; }
 #define IN_ISSET(ndx) ((allfds[ndx].fd >= 0) && ((allfds[ndx].revents & POLLIN) == POLLIN))
+#define ERR_ISSET(ndx) ((allfds[ndx].fd >= 0) && ((allfds[ndx].revents & POLLERR) == POLLERR))
 #define CLOSE_FD(ndx) { if (tcpseq) tcpseq[ndx] = -1; \
   if (allfds) { close(allfds[ndx].fd); allfds[ndx].fd = -1; allfds[ndx].revents = 0; /*summ*/ sum_sock[1]++;} \
 }
@@ -89,7 +94,7 @@ static void set_fds(void) {
 #endif
 #endif
   // clean rest triggers
-  if ((mtrtype == IPPROTO_TCP) && (maxfd > FD_MAX))
+  if (net_proto_on(IPPROTO_TCP) && (maxfd > FD_MAX))
     for (int i = FD_MAX; i < maxfd; i++)
       if (allfds[i].revents)
         allfds[i].revents = 0;
@@ -214,7 +219,7 @@ static void proceed_tcp(struct timespec *tm) {
   }
 }
 
-#define PL_GETTIME(tspec) { if (clock_gettime(CLOCK_MONOTONIC, (tspec)) < 0) { \
+#define PL_GETTIME(tspec) { if (MONOTIME(tspec) < 0) { \
   keep_error(errno, __func__); return false; }}
 
 static bool svc(struct timespec *last, const struct timespec *interval, int *timeout) NONNULL(1, 2, 3);
@@ -232,10 +237,14 @@ static bool svc(struct timespec *last, const struct timespec *interval, int *tim
         grace_started = now;
       }
       if (!grace) { // send batch unless grace period
+        timespecsub(&now, &tv, &tv);
+        lat_add(LAT_SLIP, TS2NSEC(tv)); // behind schedule
         int rc = net_send_batch();
         if (rc > 0) {
           numpings++;
           LOGMSG("cycle=%ld", numpings);
+          if (poll_cycle_fn)
+            poll_cycle_fn(numpings);
         } else if (rc < 0) // fail
           return false;
       }
@@ -341,6 +350,10 @@ static key_action_t keyboard_events(key_action_t action) {
     case ActionUDP:
     case ActionTCP:
     case ActionProto:
+      if (net_lanes()) { // all of them are already in use
+        LOGMSG("%d protocols at once", net_lanes());
+        break;
+      }
       LOGMSG("< switch proto: %s", USED_PROTO);
       if (action == ActionProto)
         toggle_proto();        // icmp->udp->tcp->icmp->...
@@ -389,7 +402,7 @@ static void proceed_ipinfo(void) {
 
 static inline bool tcpish(void) {
   return ((maxfd > FD_MAX) && (
-    (mtrtype == IPPROTO_TCP)
+    net_proto_on(IPPROTO_TCP)
 #ifdef WITH_IPINFO
     || ipinfo_tcpmode
 #endif
@@ -411,20 +424,20 @@ static key_action_t conclude(struct timespec *polled_at) {
         rc = act;
     }
   }
-  if (IN_ISSET(FD_NET)) { // net packet
+  if (IN_ISSET(FD_NET) || (net_dgram && ERR_ISSET(FD_NET))) { // net packet or queued icmp error
     LOGMSG("got %s", "icmp or udp response");
-    net_icmp_parse(polled_at);
+    LAT_TIMED(LAT_NETPARSE, net_icmp_parse(polled_at));
   }
 #ifdef ENABLE_DNS
   if (need_dns) { // dns lookup
     if (IN_ISSET(FD_DNS)) {
       LOGMSG("got %s", "dns response");
-      dns_parse(allfds[FD_DNS].fd, AF_INET);
+      LAT_TIMED(LAT_DNSPARSE, dns_parse(allfds[FD_DNS].fd, AF_INET));
     }
 #ifdef ENABLE_IPV6
     if (IN_ISSET(FD_DNS6)) {
       LOGMSG("got %s", "dns6 response");
-      dns_parse(allfds[FD_DNS6].fd, AF_INET6);
+      LAT_TIMED(LAT_DNSPARSE, dns_parse(allfds[FD_DNS6].fd, AF_INET6));
     }
 #endif
   }
@@ -468,75 +481,100 @@ static void seqfd_free(void) {
   maxfd = 0;
 }
 
-// main loop
-bool poll_loop(void) {
+// loop steps, external event loops can run them instead of poll_loop()
+static bool paused;
+static struct timespec lasttime;
+
+bool poll_start(void) {
   LOGMSG("%s", "start");
   if (!seqfd_init())
     return false;
-  key_action_t action = ActionNone;
-  bool paused = false;
+  paused = false;
   numpings = 0;
   grace = NO_GRACE;
   memset(&grace_started, 0, sizeof(grace_started));
-  //
-  struct timespec lasttime;
   PL_GETTIME(&lasttime);
-  //
-  while (1) {
-    set_fds();
-    //
-    struct timespec interval;
-    waitspec(&interval);
-    int timeout = 0, rv = 0;
-    do {
-      if ((action != ActionNone) || paused) {
-        timeout = paused ? PAUSE_MSEC : 0;
-        if (paused && run_opts.interactive && eachpass_fn)
-          eachpass_fn();
-      } else {
-        if (eachpass_fn)
-          eachpass_fn();
+  return true;
+}
+
+// send probes if it's time, return timeout till the next call [msec], or -1 when done
+int poll_next(void) {
+  set_fds();
+  if (paused) {
+    if (run_opts.interactive && eachpass_fn)
+      LAT_TIMED(LAT_REDRAW, eachpass_fn());
+    return PAUSE_MSEC;
+  }
+  if (eachpass_fn)
+    LAT_TIMED(LAT_REDRAW, eachpass_fn());
 #ifdef WITH_IPINFO
-        if (IPINFOED)
-          proceed_ipinfo();
+  if (IPINFOED)
+    proceed_ipinfo();
 #endif
-        if (!svc(&lasttime, &interval, &timeout)) {
-          seqfd_free();
-          LOGMSG("%s", "done all pings");
-          return true;
-        }
-      }
-      if (!timeout)
-        usleep(MINSLEEP_USEC);
-      rv = poll(allfds, maxfd, timeout);
-    } while ((rv < 0) && (errno == EINTR));
-    //
-    static struct timespec polled_now = {0};
-    PL_GETTIME(&polled_now);
-    //
-    if (rv < 0) {
-      int e = errno;
-      display_close(true);
-      const char* str = rstrerror(e);
-      WARN("%s", str);
-      LOGMSG("%s", str);
-      break;
-    }
-    if (rv) {
-      action = conclude(&polled_now);
-      if (action == ActionQuit)
-        break;
-      if (action == ActionPauseResume) {
-        paused = !paused;
-        if (!paused)
-          action = ActionNone;
-      }
-    } else if (tcpish())
-      tcp_timedout(); // not waiting for TCP ETIMEDOUT
+  struct timespec interval;
+  waitspec(&interval);
+  int timeout = 0;
+  if (!svc(&lasttime, &interval, &timeout)) {
+    LOGMSG("%s", "done all pings");
+    return -1;
   }
-  //
+  return (timeout > 0) ? timeout : 0;
+}
+
+// descriptors to watch, slots with negative fd are unused
+int poll_fds(const struct pollfd **fds) {
+  if (fds)
+    *fds = allfds;
+  return maxfd;
+}
+
+// wait for events up to 'timeout' msec and work them out, return false to stop
+bool poll_events(int timeout) {
+  struct timespec called;
+  bool timed = (timeout > 0) && lat_start(&called);
+  int rv = mtr_clock.poll(allfds, maxfd, timeout);
+  if (rv < 0) {
+    int e = errno;
+    if (e == EINTR)
+      return true;
+    const char* str = rstrerror(e);
+    WARN("%s", str);
+    LOGMSG("%s", str);
+    return false;
+  }
+  static struct timespec polled_now;
+  PL_GETTIME(&polled_now);
+  if (timed && !rv) { // woken up later than asked
+    struct timespec slept;
+    timespecsub(&polled_now, &called, &slept);
+    lat_add(LAT_WAKEUP, TS2NSEC(slept) - (int64_t)timeout * MICRO);
+  }
+  if (rv) {
+    key_action_t action = conclude(&polled_now);
+    if (action == ActionQuit)
+      return false;
+    if (action == ActionPauseResume)
+      paused = !paused;
+  } else if (tcpish())
+    tcp_timedout(); // not waiting for TCP ETIMEDOUT
+  return true;
+}
+
+void poll_stop(void) {
   seqfd_free();
   LOGMSG("%s", "finish");
-  return true;
 }
 
+// main loop
+bool poll_loop(void) {
+  if (!poll_start())
+    return false;
+  for (int timeout; (timeout = poll_next()) >= 0;) {
+    if (!timeout)
+      mtr_clock.usleep(MINSLEEP_USEC);
+    if (!poll_events(timeout))
+      break;
+  }
+  poll_stop();
+  return true;
+}
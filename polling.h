@@ -21,10 +21,22 @@
 
 #include <poll.h>
 #include <stdbool.h>
+#include "common.h"
 
 bool poll_loop(void);
+// poll_loop() steps
+bool poll_start(void);
+int  poll_next(void);
+int  poll_fds(const struct pollfd **fds);
+bool poll_events(int timeout);
+void poll_stop(void);
 int  poll_reg_fd(int sock, int seq);
 void poll_dereg_fd(int slot);
 void poll_close_tcpfds(void);
 
+extern void (*eachpass_fn)(void);
+extern void (*dispclear_fn)(void);
+extern key_action_t (*keyaction_fn)(void);
+extern void (*poll_cycle_fn)(long cycle);
+
 #endif
@@ -0,0 +1,197 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "replay.h"
+#include "net.h"
+#include "aux.h"
+
+static FILE *rin;
+static time_t r_from, r_to;     // time range, 0 if not set
+static char r_line[NAMELEN + 16];
+static bool r_held;             // 'r_line' is target line of the next stream
+static ulong r_lineno;
+
+static t_ipaddr r_addr[MAXHOST]; // last address at hop
+static bool r_known[MAXHOST];
+#ifdef ENABLE_DNS
+static t_ipaddr r_name_addr[MAXHOST];
+static char r_name[MAXHOST][NAMELEN]; // name to set after reply
+#endif
+
+static int str2addr(const char *str, t_ipaddr *addr) {
+  if (inet_pton(AF_INET, str, addr) == 1)
+    return AF_INET;
+#ifdef ENABLE_IPV6
+  if (inet_pton(AF_INET6, str, addr) == 1)
+    return AF_INET6;
+#endif
+  return 0;
+}
+
+static inline bool in_range(const struct timespec *clk) {
+  return (!r_from || (clk->tv_sec >= r_from)) && (!r_to || (clk->tv_sec < r_to));
+}
+
+static inline void tick(struct timespec *clk) { // keep event order
+  clk->tv_nsec += MIL;
+  if (clk->tv_nsec >= NANO) {
+    clk->tv_sec++;
+    clk->tv_nsec -= NANO;
+  }
+}
+
+bool replay_open(const char *arg) {
+  char path[NAMELEN];
+  if (snprinte(path, sizeof(path), "%s", arg) < 0)
+    return false;
+  char *range = strchr(path, ',');
+  if (range) {
+    *range++ = 0;
+    r_from = strtoll(range, &range, 10);
+    if (*range == ',')
+      r_to = strtoll(range + 1, NULL, 10);
+  }
+  replay_close();
+  rin = strcmp(path, "-") ? fopen(path, "r") : stdin;
+  if (!rin) {
+    WARN("fopen(%s)", path);
+    return false;
+  }
+  return true;
+}
+
+int replay_next(size_t size, char target[size]) {
+  if (!rin)
+    return -1;
+  int family = 0, deepest = -1;
+  bool data = false, has_target = false;
+  t_ipaddr tgt = {0}, last = {0};
+  struct timespec clk = {0};
+  memset(r_known, 0, sizeof(r_known));
+#ifdef ENABLE_DNS
+  memset(r_name, 0, sizeof(r_name));
+#endif
+  while (r_held || fgets(r_line, sizeof(r_line), rin)) {
+    if (!r_held)
+      r_lineno++;
+    r_held = false;
+    char type = 0, arg[NAMELEN] = {0};
+    int at = -1;
+    if (sscanf(r_line, "%c %255s", &type, arg) < 2)
+      continue;
+    if (strchr("xhpd", type)) {
+      if ((sscanf(r_line, "%*c %d %255s", &at, arg) < 2) || (at < 0) || (at >= MAXHOST)) {
+        WARNX("line %lu: %s", r_lineno, strerror(EINVAL));
+        continue;
+      }
+    }
+    switch (type) {
+      case 's': {
+        if (family) { // the next one
+          r_held = true;
+          goto fin;
+        }
+        family = str2addr(arg, &tgt);
+        if (!family || !net_replay_start(family)) {
+          WARNX("line %lu: %s: %s", r_lineno, arg, strerror(EAFNOSUPPORT));
+          family = 0;
+        } else {
+          net_replay_target(&tgt);
+          has_target = true;
+        }
+      } break;
+      case 'c':
+        clk.tv_sec = strtoll(arg, NULL, 10);
+        clk.tv_nsec = 0;
+        break;
+      case 'h': {
+        t_ipaddr addr;
+        int f = str2addr(arg, &addr);
+        if (!family && f && net_replay_start(f))
+          family = f;
+        if (!f || (f != family))
+          break;
+        r_addr[at] = addr;
+        r_known[at] = true;
+        if (at > deepest) {
+          deepest = at;
+          last = addr;
+        }
+      } break;
+      case 'x':
+        if (family && in_range(&clk)) {
+          tick(&clk);
+          net_replay_sent(at, &clk);
+        }
+        break;
+      case 'p':
+        if (family && r_known[at] && in_range(&clk)) {
+          tick(&clk);
+          if (!net_replay_reply(at, &r_addr[at], lround(strtod(arg, NULL) * MIL), &clk))
+            break;
+          data = true;
+#ifdef ENABLE_DNS
+          if (r_name[at][0]) {
+            net_replay_name(at, &r_name_addr[at], r_name[at]);
+            r_name[at][0] = 0;
+          }
+#endif
+        }
+        break;
+#ifdef ENABLE_DNS
+      case 'd':
+        if (r_known[at]) {
+          r_name_addr[at] = r_addr[at];
+          snprinte(r_name[at], sizeof(r_name[at]), "%s", arg);
+        }
+        break;
+#endif
+      default: break; // unknown ones are skipped
+    }
+  }
+  if (ferror(rin)) {
+    WARN("line %lu", r_lineno);
+    return -1;
+  }
+fin:
+  if (!family)
+    return 0;
+  if (!has_target && (deepest >= 0)) { // assume the last hop
+    net_replay_target(&last);
+    tgt = last;
+  }
+  if (!inet_ntop(family, &tgt, target, size))
+    snprinte(target, size, "%s", UNKN_ITEM);
+  return (data || has_target) ? 1 : 0;
+}
+
+void replay_close(void) {
+  if (rin && (rin != stdin))
+    fclose(rin);
+  rin = NULL;
+  r_held = false;
+  r_lineno = 0;
+}
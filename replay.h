@@ -0,0 +1,36 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Replay of recorded raw output ('-o raw') instead of probing:
+//  s ADDR     target          c SECONDS   time (since the Epoch)
+//  x HOP SEQ  probe is sent   h HOP ADDR  new address at hop
+//  p HOP MSEC reply           d HOP NAME  hostname at hop
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool replay_open(const char *arg);  // "FILE[,FROM[,TO]]", "-" is stdin
+// feed records of the next target, set its address into 'target';
+// return 1 if there's one, 0 at the end, -1 on error
+int replay_next(size_t size, char target[size]);
+void replay_close(void);
+
+#endif
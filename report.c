@@ -66,7 +66,7 @@ enum INDENTS_N_DIVIDERS {
 #define ESCQUOTE(str, delim) strchr((str), (delim)) ? "\"" : "";
 
 static time_t started_at;
-void report_started_at(void) { started_at = time(NULL); }
+void report_started_at(void) { started_at = unixtime(); }
 
 #if (__GNUC__ >= 8) || (__clang_major__ >= 6) || (__STDC_VERSION__ >= 202311L)
 #define PRINT_DATETIME(fmt, ...) do {                           \
@@ -145,7 +145,7 @@ static int longest_hopname(int longest) {
   char buff[MAXNAME] = {0};
   int nmax = net_max();
   for (int at = net_min(); at < nmax; at++) {
-    for (uint i = 0; i < MAXPATH; i++) {
+    for (int i = 0; i < PATHS_AT(at); i++) {
       int len = snprint_addr(buff, sizeof(buff), at, i);
       if (len > longest)
         longest = len;
@@ -154,26 +154,6 @@ static int longest_hopname(int longest) {
   return longest;
 }
 
-#ifdef ENABLE_DNS
-void backresolv_lookups(void) {
-  if (run_opts.dns) {
-    int max = net_max();
-    for (int at = net_min(); at < max; at++) {
-      if (addr_exist(&CURRENT_IP(at))) {
-        dns_ptr_lookup(at, host[at].current);
-        for (int ndx = 0; ndx < MAXPATH; ndx++) { // multipath
-          if (ndx != host[at].current) { // not looked up yet
-            if (!addr_exist(&IP_AT_NDX(at, ndx)))
-              break;
-            dns_ptr_lookup(at, ndx);
-          }
-        }
-      }
-    }
-  }
-}
-#endif
-
 static void foreach_stat(int at, void (*body)(int at, const t_stat *stat), char fin) NONNULL(2);
 static void foreach_stat(int at, void (*body)(int at, const t_stat *stat), char fin) {
   for (uint i = 0; i < MAXFLD; i++) {
@@ -208,7 +188,62 @@ static void report_headstat(int at UNUSED, const t_stat *stat) {
     printf("%*s", stat->min, "");
 }
 
+// with several protocols (-A) stats of every lane go side by side
+static int lanes_max(void) {
+  int max = net_max();
+  for (int i = 1; i < net_lanes(); i++) {
+    net_lane_view(i);
+    int lmax = net_max();
+    if (lmax > max)
+      max = lmax;
+  }
+  net_lane_view(0);
+  return max;
+}
+
+static void lanes_stat(int at, void (*body)(int at, const t_stat *stat)) NONNULL(2);
+static void lanes_stat(int at, void (*body)(int at, const t_stat *stat)) {
+  foreach_stat(at, body, 0);
+  for (int i = 1; i < net_lanes(); i++) {
+    net_lane_view(i);
+    foreach_stat(at, body, 0);
+  }
+  net_lane_view(0);
+  putchar('\n');
+}
+
+static void report_lane_names(int hostlen, int infolen) {
+  int width = 0;
+  for (uint i = 0; i < MAXFLD; i++) {
+    const t_stat *stat = active_stats(i);
+    if (!stat)
+      break;
+    width += stat->min; // wider than its name
+  }
+  printf("%*s", IND_REP + (infolen ? (infolen + 1) : 0) + hostlen, "");
+  for (int i = 0; i < net_lanes(); i++)
+    printf("%*s", width, PROTO_NAME(net_lane_proto(i)));
+  putchar('\n');
+}
+
+// hop addresses of other lanes if they differ from the first one
+static void report_lane_addrs(int at, int infolen) {
+  t_ipaddr addr = CURRENT_IP(at);
+  for (int i = 1; i < net_lanes(); i++) {
+    net_lane_view(i);
+    if (addr_exist(&CURRENT_IP(at)) && !addr_equal(&CURRENT_IP(at), &addr)) {
+      printf("%*s", IND_REP, "");
+      REPORT_INFO(infolen, "");
+      print_nameaddr(at, host[at].current, -1);
+      printf(" (%s)\n", PROTO_NAME(net_lane_proto(i)));
+    }
+  }
+  net_lane_view(0);
+}
+
 static void report_print_header(int hostlen, int infolen) {
+  if (net_lanes())
+    report_lane_names(hostlen, infolen);
   printf("%*s", IND_REP, "");
   // left
   { char info[NAMELEN] = {0};
@@ -218,7 +253,7 @@ static void report_print_header(int hostlen, int infolen) {
     int len = hostlen - ustrnlen(HOST_STR, hostlen);
     if (len > 0) printf("%*s", len, ""); }
   // right
-  foreach_stat(0, report_headstat, '\n');
+  lanes_stat(0, report_headstat);
 }
 
 static void report_bodystat(int at, const t_stat *stat) NONNULL(2);
@@ -239,24 +274,30 @@ static void report_print_body(int at, const char *fmt, int hostlen, int infolen)
     REPORT_INFO(infolen, info); }
   print_nameaddr(at, host[at].current, hostlen);
   // body: right
-  foreach_stat(at, report_bodystat, '\n');
+  lanes_stat(at, report_bodystat);
+  if (net_lanes())
+    report_lane_addrs(at, infolen);
 #ifdef WITH_MPLS
   if (run_opts.mpls)
     print_mpls(&CURRENT_MPLS(at));
 #endif
 }
 
+// with MDA every path is listed with its own stats
 static void report_print_rest(int at, int hostlen, int infolen) {
-  for (int i = 0; i < MAXPATH; i++) {
-    if (i == host[at].current)
+  for (int i = 0; i < PATHS_AT(at); i++) {
+    if ((i == host[at].current) && !run_opts.mda)
       continue; // because already printed
-    if (!addr_exist(&IP_AT_NDX(at, i)))
-      break; // done
     printf("%*s", IND_REP, "");
     { char info[NAMELEN] = {0};
       ipinfo_data_fix(sizeof(info), info, at, i);
       REPORT_INFO(infolen, info); }
     print_nameaddr(at, i, hostlen);
+    if (run_opts.mda) {
+      const eaddr_t *path = &PATH_AT_NDX(at, i);
+      printf(" %d %s, %d %s, %.2f %s", __builtin_popcountll(path->flows), FLOWS_STR, path->recv, REPLIES_STR,
+        path->avg, MSEC_STR);
+    }
     putchar('\n');
 #ifdef WITH_MPLS
     if (run_opts.mpls)
@@ -278,7 +319,7 @@ void report_close(bool next, bool with_header) {
 #endif
     0;
   report_print_header(hostlen, infolen);
-  int max = net_max();
+  int max = lanes_max();
   for (int at = net_min(); at < max; at++) {
     report_print_body(at, AT_FMT " ", hostlen, infolen);
     report_print_rest(at, hostlen, infolen); // multipath, mpls, etc.
@@ -347,7 +388,34 @@ void json_head(void) {
   }
   printf("%c\n\"%s\":[", DIV_JSON, TARGETS_STR);
 }
-void json_tail(void) { printf("\n]}\n"); }
+// loop latencies of -S, in nanoseconds
+static void json_lat(void) {
+  printf("%c\n\"%s\":{", DIV_JSON, LOOP_STR);
+  bool next = false;
+  for (int i = 0; i < LAT_MAX; i++) {
+    const lathist_t *lat = &loop_lat[i];
+    if (!lat->count)
+      continue;
+    int last = LAT_BUCKETS - 1;
+    while ((last > 0) && !lat->hist[last])
+      last--;
+    printf("%s\n%*s\"%s\":{\"count\":%llu,\"sum\":%llu,\"p50\":%llu,\"p99\":%llu,\"max\":%llu,\"log2hist\":[",
+      next ? "," : "", IND_JSON, "", lat_name[i], (unsigned long long)lat->count, (unsigned long long)lat->sum,
+      (unsigned long long)lat_pct(lat, 50), (unsigned long long)lat_pct(lat, 99), (unsigned long long)lat->max);
+    for (int j = 0; j <= last; j++)
+      printf("%s%u", j ? "," : "", lat->hist[j]);
+    printf("]}");
+    next = true;
+  }
+  printf("}");
+}
+
+void json_tail(void) {
+  printf("\n]");
+  if (run_opts.stat)
+    json_lat();
+  printf("}\n");
+}
 
 static void json_statline(int at, const t_stat *stat) {
   const char *elem = net_elem(at, stat->key);
@@ -362,11 +430,44 @@ static void json_statline(int at, const t_stat *stat) {
   }
 }
 
+// paths found by MDA, with flows that took them
+static void json_paths(int at) {
+  printf("%c\"%s\":[", DIV_JSON, PATHS_STR);
+  for (int i = 0; i < PATHS_AT(at); i++) {
+    const eaddr_t *path = &PATH_AT_NDX(at, i);
+    printf("%s{\"%s\":\"", i ? "," : "", _(HOST_STR));
+    print_nameaddr(at, i, -1);
+    printf("\"%c\"%s\":%d%c\"%s\":%.2f%c\"%s\":[", DIV_JSON, _REPLIES_STR, path->recv,
+      DIV_JSON, _AVRG_STR, path->avg, DIV_JSON, _FLOWS_STR);
+    for (int flow = 0, n = 0; flow < MAXFLOW; flow++)
+      if (path->flows & (1ULL << flow))
+        printf("%s%d", n++ ? "," : "", flow);
+    printf("]}");
+  }
+  printf("]");
+}
+
+// the same hop probed with other protocols (-A)
+static void json_lanes(int at) {
+  printf("%c\"%s\":\"%s\"%c\"%s\":[", DIV_JSON, _(PROTO_STR), PROTO_NAME(net_lane_proto(0)), DIV_JSON, LANES_STR);
+  for (int i = 1; i < net_lanes(); i++) {
+    net_lane_view(i);
+    printf("%s{\"%s\":\"%s\"%c\"%s\":\"", (i > 1) ? "," : "", _(PROTO_STR), PROTO_NAME(net_lane_proto(i)),
+      DIV_JSON, _(HOST_STR));
+    print_nameaddr(at, host[at].current, -1);
+    printf("\"");
+    foreach_stat(at, json_statline, 0);
+    printf("}");
+  }
+  net_lane_view(0);
+  printf("]");
+}
+
 void json_close(bool next) {
   if (next) printf(",");
   printf("\n%*s{\"%s\":\"%s\"", IND_JSON, "", _(TARGET_STR), dsthost);
   printf("%c\"%s\":[", DIV_JSON, _(DATA_STR));
-  int min = net_min(), max = net_max();
+  int min = net_min(), max = lanes_max();
   for (int at = min; at < max; at++) {
     printf((at == min) ? "\n" : ",\n");
     printf("%*s{\"%s\":\"", IND_JSON * 2, "", _(HOST_STR));
@@ -382,6 +483,10 @@ void json_close(bool next) {
         printf("%c\"%s\":[%s]", DIV_JSON, _(IPINFO_STR), info);
     }
 #endif
+    if (run_opts.mda)
+      json_paths(at);
+    if (net_lanes())
+      json_lanes(at);
     printf("}");
   }
   printf("\n%*s]", IND_JSON, "");
@@ -530,7 +635,7 @@ void csv_close(bool next) {
 
 #ifdef OUTPUT_FORMAT_RAW
 
-void raw_rawping(int at, int usec) {
+void raw_rawping(int at, int ndx UNUSED, int usec) {
 #ifdef ENABLE_DNS
   static bool raw_printed_name[MAXHOST];
   if (!raw_printed_name[at]) {
@@ -542,8 +647,7 @@ void raw_rawping(int at, int usec) {
     }
   }
 #endif
-  LENVALMIL((double)usec / MIL);
-  printf("p %d %.*f\n", at, _l, _v); // ping in msec
+  printf("p %d %.3f\n", at, usec / (double)MIL); // ping in msec
   fflush(stdout);
 }
 
@@ -552,5 +656,20 @@ void raw_rawhost(int at, int ndx) {
   printf("h %d %s\n", at, addr2str(&IP_AT_NDX(at, ndx), sizeof(str), str));
   fflush(stdout);
 }
+
+void raw_rawxmit(int at, int seq) {
+  printf("x %d %d\n", at, seq);
+}
+
+void raw_rawtime(long cycle UNUSED) {
+  printf("c %lld\n", (long long)unixtime());
+  fflush(stdout);
+}
+
+void raw_rawtarget(void) {
+  char str[MAX_ADDRSTRLEN] = {0};
+  printf("s %s\n", addr2str(net_target(), sizeof(str), str));
+  raw_rawtime(0);
+}
 #endif
 
@@ -24,13 +24,13 @@
 
 void report_started_at(void);
 void report_close(bool next, bool with_header);
-#ifdef ENABLE_DNS
-void backresolv_lookups(void);
-#endif
 #ifdef OUTPUT_FORMAT_RAW
 #include "common.h"
-void raw_rawping(int at, int usec);
-void raw_rawhost(int at, t_ipaddr *ipaddr) NONNULL(2);
+void raw_rawping(int at, int ndx, int usec);
+void raw_rawhost(int at, int ndx);
+void raw_rawxmit(int at, int seq);
+void raw_rawtime(long cycle);
+void raw_rawtarget(void);
 #endif
 #ifdef OUTPUT_FORMAT_CSV
 void csv_head(void);
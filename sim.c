@@ -0,0 +1,157 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "sim.h"
+#include "net.h"
+#include "aux.h"
+
+enum { SIM_EPOCH = 1700000000 };  // realtime clock at start
+
+typedef struct sim_event {
+  struct timespec at;
+  int seq, hop;
+} sim_event_t;
+
+static sim_hop_t s_hop[MAXHOST];
+static int s_nhop;
+static uint32_t s_rand;
+static struct timespec s_now;
+static const struct timespec s_start = { .tv_sec = 1 };
+static sim_event_t s_heap[MAXSEQ]; // replies on the way, min-heap by time
+static int s_nev;
+static mtr_clock_t s_saved_clock;
+static bool (*s_saved_xmit)(int at, int seq);
+static bool s_running;
+
+static uint32_t sim_rand(void) { // xorshift32
+  s_rand ^= s_rand << 13;
+  s_rand ^= s_rand >> 17;
+  s_rand ^= s_rand << 5;
+  return s_rand;
+}
+
+static void add_usec(struct timespec *ts, long usec) {
+  struct timespec d = { .tv_sec = usec / MICRO, .tv_nsec = (usec % MICRO) * MIL };
+  timespecadd(ts, &d, ts);
+}
+
+static void heap_push(const sim_event_t *ev) {
+  if (s_nev >= (int)ARRAY_LEN(s_heap))
+    return; // lost on the way
+  int i = s_nev++;
+  while (i > 0) {
+    int up = (i - 1) / 2;
+    if (!timespeccmp(&ev->at, &s_heap[up].at, <))
+      break;
+    s_heap[i] = s_heap[up];
+    i = up;
+  }
+  s_heap[i] = *ev;
+}
+
+static sim_event_t heap_pop(void) {
+  sim_event_t top = s_heap[0], last = s_heap[--s_nev];
+  int i = 0;
+  for (int kid; (kid = 2 * i + 1) < s_nev; i = kid) {
+    if (((kid + 1) < s_nev) && timespeccmp(&s_heap[kid + 1].at, &s_heap[kid].at, <))
+      kid++;
+    if (!timespeccmp(&s_heap[kid].at, &last.at, <))
+      break;
+    s_heap[i] = s_heap[kid];
+  }
+  if (s_nev)
+    s_heap[i] = last;
+  return top;
+}
+
+static int sim_gettime(clockid_t clk, struct timespec *ts) {
+  *ts = s_now;
+  if (clk == CLOCK_REALTIME)
+    ts->tv_sec += SIM_EPOCH;
+  return 0;
+}
+
+// move the clock to the first reply or by 'timeout', and hand replies over
+static int sim_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  struct timespec until = s_now;
+  if (timeout > 0)
+    add_usec(&until, timeout * (long)MIL);
+  if (s_nev && ((timeout < 0) || timespeccmp(&s_heap[0].at, &until, <)))
+    until = s_heap[0].at;
+  if (timespeccmp(&until, &s_now, >))
+    s_now = until;
+  while (s_nev && !timespeccmp(&s_heap[0].at, &s_now, >)) {
+    sim_event_t ev = heap_pop();
+    net_xmit_reply(ev.seq, &s_hop[ev.hop].addr, &ev.at);
+  }
+  for (nfds_t i = 0; i < nfds; i++)
+    fds[i].revents = 0;
+  return 0;
+}
+
+static int sim_usleep(useconds_t usec) {
+  add_usec(&s_now, usec);
+  return 0;
+}
+
+static bool sim_xmit(int at, int seq) {
+  int hop = (at < s_nhop) ? at : (s_nhop - 1);
+  const sim_hop_t *h = &s_hop[hop];
+  if (!addr_exist(&h->addr) || ((int)(sim_rand() % 100) < h->loss))
+    return true;
+  long rtt = h->rtt;
+  if (h->jitter > 0)
+    rtt += (long)(sim_rand() % (2 * h->jitter + 1)) - h->jitter;
+  sim_event_t ev = { .at = s_now, .seq = seq, .hop = hop };
+  add_usec(&ev.at, (rtt > 0) ? rtt : 1);
+  heap_push(&ev);
+  return true;
+}
+
+bool sim_start(int nhop, const sim_hop_t hops[nhop], unsigned seed) { // NONNULL(2)
+  if ((nhop < 1) || (nhop > MAXHOST)) {
+    errno = EINVAL;
+    return false;
+  }
+  sim_stop();
+  memcpy(s_hop, hops, nhop * sizeof(sim_hop_t));
+  s_nhop = nhop;
+  s_rand = seed ? seed : 1;
+  s_now = s_start;
+  s_nev = 0;
+  s_saved_clock = mtr_clock;
+  s_saved_xmit = net_xmit_fn;
+  mtr_clock = (mtr_clock_t){ .gettime = sim_gettime, .poll = sim_poll, .usleep = sim_usleep };
+  net_xmit_fn = sim_xmit;
+  s_running = true;
+  return true;
+}
+
+void sim_stop(void) {
+  if (!s_running)
+    return;
+  mtr_clock = s_saved_clock;
+  net_xmit_fn = s_saved_xmit;
+  s_running = false;
+}
+
+void sim_elapsed(struct timespec *ts) { timespecsub(&s_now, &s_start, ts); } // NONNULL(1)
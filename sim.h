@@ -0,0 +1,43 @@
+/*
+    mtr  --  a network diagnostic tool
+    Copyright (C) 1997,1998  Matt Kimball
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+// Deterministic simulation: virtual clock in place of 'mtr_clock', and a path
+// answering probes of 'net_xmit_fn'. Waits only move the clock forward, so
+// cycles, timeouts, grace period and cache expiry take no real time.
+// The engine is to be set up without sockets (net_replay_start() and so on).
+
+#include <stdbool.h>
+#include <time.h>
+#include "common.h"
+
+typedef struct sim_hop {
+  t_ipaddr addr;  // replying address, the hop is silent if it's unset
+  int rtt;        // usec
+  int jitter;     // usec, uniform around 'rtt'
+  int loss;       // percent
+} sim_hop_t;
+
+// the last hop stands for the target and answers probes with bigger TTLs too
+bool sim_start(int nhop, const sim_hop_t hops[nhop], unsigned seed) NONNULL(2);
+void sim_stop(void);
+void sim_elapsed(struct timespec *ts) NONNULL(1);  // virtual time since start
+
+#endif
@@ -89,11 +89,9 @@ static void spl_print_row(const t_ipaddr *addr, int at, int ndx, void (*print_st
 }
 
 static inline void split_multipath(int at) {
-  for (int ndx = 0; ndx < MAXPATH; ndx++) { // multipath
+  for (int ndx = 0; ndx < PATHS_AT(at); ndx++) { // multipath
     if (ndx != host[at].current) { // .current is already printed
       t_ipaddr *addr = &IP_AT_NDX(at, ndx);
-      if (!addr_exist(addr))
-        break;
       printf("%2d:%d", at + 1, ndx);
       spl_print_row(addr, at, ndx, NULL);
     }
@@ -168,10 +168,8 @@ static int print_stat(WINDOW *win, int at, int y, int x, int max) { // statistic
 
 static void print_addr_extra(WINDOW *win, int at) NONNULL(1);
 static void print_addr_extra(WINDOW *win, int at) { // multipath + mpls
-  for (int ndx = 0; ndx < MAXPATH; ndx++) { // multipath
+  for (int ndx = 0; ndx < PATHS_AT(at); ndx++) { // multipath
     if (ndx != host[at].current) { // not printed yet
-      if (!addr_exist(&IP_AT_NDX(at, ndx)))
-        break;
       wprintw(win, "%*s", INDENT_NUMB, "");
       printw_addr(win, at, ndx);
       if (wmove(win, getcury(win) + 1, 0) == ERR)
@@ -542,7 +540,7 @@ static void redraw_status(WINDOW *win) {
   buff[0] = 0;
   // add datetime
   char str[64] = {0};
-  const char *date = tui_datetime ? tui_datetime(time(NULL), sizeof(str), str) : NULL;
+  const char *date = tui_datetime ? tui_datetime(unixtime(), sizeof(str), str) : NULL;
   int len = (date && date[0]) ? ((tuilook == OLDLOOK) ?
     snprinte(buff, sizeof(buff), "%.*s: %s",
       (int)strnlen(srchost, getmaxx(win) / 2), srchost, date) :
@@ -670,7 +668,7 @@ bool tui_open(void) {
   tui_datetime = (tuilook == NEWLOOK) ? datetime_FT : datetime_c;
 #ifdef LOGMOD
   { char str[64] = {0};
-    const char *date = tui_datetime(time(NULL), sizeof(str), str);
+    const char *date = tui_datetime(unixtime(), sizeof(str), str);
     LOGMSG("%s", date); }
 #endif
   screen_ready = initscr();
@@ -725,8 +723,8 @@ void tui_confirm(void) {
 void tui_close(void) {
 #ifdef LOGMOD
   { char str[64] = {0};
-    const char *date = tui_datetime ? tui_datetime(time(NULL), sizeof(str), str) : NULL;
-    LOGMSG("%s", date ? date : datetime_c(time(NULL), sizeof(str), str)); }
+    const char *date = tui_datetime ? tui_datetime(unixtime(), sizeof(str), str) : NULL;
+    LOGMSG("%s", date ? date : datetime_c(unixtime(), sizeof(str), str)); }
 #endif
 #ifdef WITH_MOUSE
   disable_mouse();